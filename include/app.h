@@ -1,11 +1,24 @@
 #pragma once
 
 #include "app_path.h"
+#include "blur.h"
+#include "compute.h"
+#include "context_objects.h"
 #include "events.h"
+#include "file_watcher.h"
+#include "frame_pacer.h"
 #include "geometry.h"
 #include "graph.h"
+#include "graph_scheduler.h"
+#include "jobs.h"
 #include "portable-file-dialogs.h"
+#include "project_loader.h"
+#include "project_saver.h"
+#include "render_thread.h"
 #include "shader.h"
+#include "shader_fusion.h"
+#include "shader_variants.h"
+#include "srpack.h"
 #include "texture.h"
 #include "widgets.h"
 #define GLFW_INCLUDE_NONE
@@ -13,11 +26,17 @@
 #include <filesystem>
 #include <glad/gl.h>
 #include <imgui.h>
+#include <chrono>
 #include <optional>
 #include <vector>
 
 using Workspace = std::pair<std::string, std::vector<std::shared_ptr<Widget>>>;
 
+// Main thread time spent per frame on uploading a project being opened
+static constexpr std::chrono::milliseconds LOAD_FRAME_BUDGET(4);
+// Main thread time spent per frame on a running GPU benchmark
+static constexpr std::chrono::milliseconds BENCHMARK_FRAME_BUDGET(8);
+
 struct App {
   std::shared_ptr<AssetManager> assets = std::make_shared<AssetManager>(AssetManager());
   std::vector<Workspace> workspaces;
@@ -32,12 +51,22 @@ struct App {
   std::string status_message = "This is a status bar!";
   bool is_project_dirty = false;
   bool show_metrics = false;
+  // Shows what the GraphScheduler spent on each graph
+  bool show_graph_costs = false;
+  // Evaluates graphs on a separate thread, see RenderThread
+  bool use_render_thread = false;
+  FileWatcher watcher;
+  ProjectSaver saver;
+  // Directory of a save requested while another one was running, see finish_save()
+  std::optional<std::filesystem::path> pending_save;
+  ProjectLoader loader;
 
   // Setup App Logic
   App() {
     ImGui::LoadIniSettingsFromDisk((getAppDir() / "assets/imgui.ini").string().c_str());
 
-    if (auto texture = Texture("Cat", getAppDir() / "assets/textures/cat.png"))
+    if (auto texture = Texture("Cat", getAppDir() / "assets/textures/cat.png");
+        texture.ensure_loaded())
       assets->insertTexture(std::make_shared<Texture>(texture));
     else
       spdlog::error("Failed to load texture assets/textures/cat.png");
@@ -67,13 +96,26 @@ struct App {
   }
   // Render the application
   void render() {
-    render_menubar();
-    render_statusbar();
+    {
+      auto lock = RenderThread::lock(); // Menu actions change assets
+      render_menubar();
+      render_statusbar();
+    }
 
     if (show_metrics)
       ImGui::ShowMetricsWindow(&show_metrics);
+    if (show_graph_costs) {
+      auto lock = RenderThread::lock();
+      render_graph_costs();
+    }
 
     render_dockspace();
+    for (size_t i = 0; i < workspaces.size(); i++) {
+      if (int(i) == current_workspace)
+        continue;
+      for (auto &widget : workspaces[i].second)
+        widget->set_visible(false);
+    }
     for (auto &widget : workspaces[current_workspace].second) {
       bool open = true;
       widget->render(&open);
@@ -91,8 +133,14 @@ struct App {
     graph = assets->getRenderGraph(graph_id).value();
     export_image.set_graph(graph);
     export_image.onStartup();
+    watch_assets();
   }
   void shutdown() {
+    // The assets are about to go, so a pending save snapshots them now
+    if (pending_save) {
+      if (auto success = saver.wait())
+        finish_save(success.value());
+    }
     for (auto &pair : workspaces) {
       for (auto &widget : pair.second)
         widget->onShutdown();
@@ -101,21 +149,62 @@ struct App {
     export_image.onShutdown();
     workspaces.clear();
     graph.reset();
+    RenderTargetPool::clear();
+    ShaderVariants::clear();
+    Blur::clear();
+    Compute::clear();
+    ContextObjects::clear(); // Last, the above release theirs
   }
   void update() {
+    // Toggled without holding the lock, stopping waits for the render thread
+    if (use_render_thread != RenderThread::is_running()) {
+      if (!use_render_thread)
+        RenderThread::stop();
+      else if (!RenderThread::start(glfwGetCurrentContext()))
+        use_render_thread = false;
+    }
+
+    auto lock = RenderThread::lock();
+    ContextObjects::collect(); // Released by the render thread in the meantime
     updateKeyStates();
     process_input();
 
+    Jobs::run_main();
+    watcher.poll();
+    if (auto success = saver.poll())
+      finish_save(success.value());
+    if (auto project = loader.poll(LOAD_FRAME_BUDGET))
+      apply_project(project.value());
+    else if (loader.take_failure())
+      EventQueue::push(StatusMessage("Failed to open project!"));
+    // Background work is polled, keep frames coming until it finished
+    if (loader.is_busy())
+      FramePacer::request_redraw();
+    if (saver.is_busy())
+      FramePacer::request_frame_at(glfwGetTime() + 0.1);
     handle_events();
 
     for (auto &widget : workspaces[current_workspace].second)
       widget->onUpdate();
+    // Evaluates the graphs the viewports submitted while updating
+    GraphScheduler::flush();
+    // Benchmarks run a slice per frame, so the app stays responsive meanwhile
+    ShaderFusion::update_benchmark(BENCHMARK_FRAME_BUDGET);
+    Blur::update_benchmark(BENCHMARK_FRAME_BUDGET);
   }
   // Handle deferred events from EventQueue
   void handle_events();
+  void handle_event(Event &event);
+  // Watches the files of all assets for external changes
+  void watch_assets() {
+    watcher.clear();
+    for (auto &path : assets->get_watched_files())
+      watcher.watch(path);
+  }
   void process_input();
   void render_menubar();
   void render_statusbar();
+  void render_graph_costs();
   void new_shader();
   void import_texture();
   void render_dockspace();
@@ -136,7 +225,19 @@ struct App {
     project_root = dir;
     save_project(project_root.value());
   }
-  // Save everything related to a project
+  // Save everything related to a project, files are written in the background
   void save_project(std::filesystem::path);
+  // Reports the result of a background save and starts the pending one, if any
+  void finish_save(bool success);
   void open_project();
+  // Opens a project directory or pack in the background, see ProjectLoader
+  void open_project(std::filesystem::path path);
+  // Opens a project packed into a single *.srpack file
+  void open_pack();
+  // Saves the project and packs it into a single file
+  void export_pack();
+  // Extracts a pack into a project directory and opens it
+  void unpack_pack();
+  // Replaces the current project with one opened by the loader
+  void apply_project(LoadedProject &project);
 };
@@ -44,3 +44,22 @@ static std::string getAppPath() {
 static inline std::filesystem::path getAppDir() {
   return std::filesystem::path(getAppPath()).parent_path();
 }
+
+#include <cstdlib>
+
+// Directory for generated data which is safe to delete
+static inline std::filesystem::path getCacheDir() {
+#if defined(_WIN32)
+  if (const char *dir = std::getenv("LOCALAPPDATA"))
+    return std::filesystem::path(dir) / "ShaderRinth" / "cache";
+#elif defined(__APPLE__)
+  if (const char *home = std::getenv("HOME"))
+    return std::filesystem::path(home) / "Library" / "Caches" / "ShaderRinth";
+#else
+  if (const char *dir = std::getenv("XDG_CACHE_HOME"))
+    return std::filesystem::path(dir) / "ShaderRinth";
+  if (const char *home = std::getenv("HOME"))
+    return std::filesystem::path(home) / ".cache" / "ShaderRinth";
+#endif
+  return getAppDir() / "cache";
+}
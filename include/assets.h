@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <map>
 #include <memory>
+#include <vector>
 
 #include <toml++/toml.hpp>
 
@@ -11,6 +12,8 @@ class Shader;
 class Texture;
 class RenderGraph;
 class Geometry;
+class ProjectPack;
+struct FileWrite;
 
 template <typename T> using AssetId = unsigned int;
 template <typename T> using Assets = std::map<AssetId<T>, std::shared_ptr<T>>;
@@ -40,6 +43,8 @@ public:
   std::shared_ptr<Assets<RenderGraph>> mRenderGraph = std::make_shared<Assets<RenderGraph>>();
 
   std::filesystem::path project_root;
+  // Set if the project was opened from a pack
+  std::shared_ptr<ProjectPack> pack = nullptr;
 
   AssetManager() {};
   // Generates the next widget id
@@ -95,7 +100,23 @@ public:
   std::shared_ptr<Assets<Geometry>> getGeometryCollection() { return mGeometry; }
   std::shared_ptr<Assets<RenderGraph>> getRenderGraphCollection() { return mRenderGraph; }
 
+  // Loads every shader and texture which is still a stub, e.g. before exporting
+  void preload_all();
+  // Files backing assets which should be watched for external changes
+  std::vector<std::filesystem::path> get_watched_files();
+  // Reloads the assets backed by a changed file and invalidates dependent graphs
+  // Textures are reloaded in the background, see on_asset_loaded()
+  void on_file_changed(const std::filesystem::path &path);
+  // Swaps in an asset loaded in the background and invalidates dependent graphs
+  void on_asset_loaded(AssetId<Asset> asset_id, std::shared_ptr<Asset> asset);
+  // Invalidates the graphs depending on an asset
+  void on_asset_changed(AssetId<Asset> asset_id);
+
   toml::table save(std::filesystem::path project_root);
+  // Collects the asset files which changed since the last save
+  std::vector<FileWrite> save_files(std::filesystem::path project_root);
+  // Forces the next save to write all asset files, e.g. after a failed save
+  void mark_unsaved();
   // Attempts to load asssets from config file, throwing std::bad_optional_access if failed
   void load(toml::table &tbl, std::filesystem::path project_root);
 };
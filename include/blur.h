@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <glad/gl.h>
+#include <imgui.h>
+#include <memory>
+#include <optional>
+
+// Forward declares
+struct RenderGraph;
+class Geometry;
+class RenderTarget;
+
+// Built-in blur passes shared by the blur nodes
+//
+// The Gaussian is separable and merges every pair of taps into one bilinear
+// fetch between them, so a radius of r takes r + 1 fetches per pixel instead
+// of 2r + 1. Radii beyond MAX_RADIUS are blurred on a copy downsampled by
+// powers of two and scaled back up, which bounds the fetches per pixel.
+//
+// The dual-Kawase blur halves the resolution per level with 5 fetches and
+// doubles it again with 8, the levels grow with the logarithm of the radius
+// while their cost shrinks by 4 each. It approximates a Gaussian less exactly
+// but is cheaper for very large radii.
+//
+// Both only cost a little more than a copy of the image whatever the radius.
+// Intermediate targets are requested from the caller, nodes take them from
+// EvalContext::get_target(), so they are pooled and recycled between frames.
+//
+// Must be used while holding RenderThread::lock_evaluation().
+struct Blur {
+public:
+  // Returns the target of an index with the size, index 0 receives the result
+  using Targets = std::function<RenderTarget &(size_t index, int width, int height)>;
+
+  // Radius blurred at full resolution, larger radii are downsampled first
+  static constexpr int MAX_RADIUS = 16;
+  static constexpr int MAX_LEVELS = 8;
+
+  // Copies the input into a target of the size, scaled bilinearly
+  static RenderTarget *copy(const Targets &targets, const std::shared_ptr<Geometry> &geometry,
+                            GLuint input, int width, int height);
+  // Blurs the input into a target of the size, returns the target or nullptr on failure
+  static RenderTarget *gaussian(const Targets &targets, const std::shared_ptr<Geometry> &geometry,
+                                GLuint input, int width, int height, float radius);
+  static RenderTarget *kawase(const Targets &targets, const std::shared_ptr<Geometry> &geometry,
+                              GLuint input, int width, int height, float radius);
+
+  // Destroys the programs and stops a running benchmark, e.g. before the OpenGL
+  // context goes away
+  static void clear();
+  // Times both blurs against a plain two pass Gaussian taking one fetch per texel
+  // at several radii over the next frames, the result is logged and reported in
+  // the status bar
+  static void start_benchmark(std::shared_ptr<RenderGraph> graph, ImVec2 resolution,
+                              int frames = 60);
+  // Runs a running benchmark for about the budget, called once per frame
+  static void update_benchmark(std::chrono::milliseconds budget);
+  // Progress of a running benchmark in [0, 1]
+  static std::optional<float> get_benchmark_progress();
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <glad/gl.h>
+#include <string>
+
+// Forward declares
+class RenderTarget;
+
+// Compute passes shared by the compute nodes, available on OpenGL 4.3 and later
+//
+// The windows ask for a 3.3 core context, which drivers usually upgrade to the
+// newest version they support. If they don't, the compute nodes show
+// get_fallback_message() and output nothing instead of failing the graph.
+//
+// Reductions run a shared memory tree over 256 values per work group, every
+// invocation combining two values first, so each dispatch shrinks the input
+// by 512 until one value is left. The result stays on the GPU as a 1x1 float
+// texture that downstream passes read with texelFetch(u_result, ivec2(0), 0).
+// Histograms count the luminance of every pixel into BINS bins with shared
+// memory atomics, normalized by the number of pixels into a BINS x 1 texture.
+//
+// Must be used while holding RenderThread::lock_evaluation().
+struct Compute {
+public:
+  // Returns the target of an index with the size and format, index 0 receives the result
+  using Targets =
+      std::function<RenderTarget &(size_t index, int width, int height, GLenum format)>;
+
+  enum class Reduction { Average, Minimum, Maximum, Sum, Histogram };
+  static constexpr Reduction ALL_REDUCTIONS[] = {Reduction::Average, Reduction::Minimum,
+                                                 Reduction::Maximum, Reduction::Sum,
+                                                 Reduction::Histogram};
+  static constexpr int BINS = 256;
+
+  // True if the current context runs compute shaders
+  static bool is_supported();
+  // Explains why compute nodes don't run on the current context
+  static const std::string &get_fallback_message();
+  static const char *reduction_name(Reduction reduction);
+  // Size of the first level of a texture, returns false if it has none
+  static bool get_size(GLuint texture, int &width, int &height);
+
+  // Reduces the pixels of the input into a 1x1 GL_RGBA32F target, or a BINS x 1
+  // GL_R32F target for histograms, returns the target or nullptr on failure
+  static RenderTarget *reduce(const Targets &targets, GLuint input, Reduction reduction);
+  // Returns the storage buffer bound by compute nodes, resized and cleared to zero
+  static GLuint get_scratch_buffer(size_t size);
+
+  // Destroys the programs and buffers, e.g. before the OpenGL context goes away
+  static void clear();
+};
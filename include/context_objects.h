@@ -0,0 +1,27 @@
+#pragma once
+
+#include <glad/gl.h>
+
+// Framebuffers and vertex arrays kept per OpenGL context
+//
+// Container objects are not shared between contexts, so objects used by both
+// the UI and the render thread (render targets, geometry) keep one per context
+// instead of creating one per pass. They are cached by their owner, which must
+// release() them once it is destroyed. Containers of contexts which are not
+// current at that point are deleted the next time their context collects.
+// Safe to use from any thread.
+struct ContextObjects {
+public:
+  // Framebuffer of the owner in the current context, created on first use
+  // created is set if it is new, the owner then has to attach its textures
+  static GLuint get_framebuffer(const void *owner, bool &created);
+  // Vertex array of the owner in the current context, created on first use
+  // created is set if it is new, the owner then has to set up its attributes
+  static GLuint get_vertex_array(const void *owner, bool &created);
+  // Deletes the containers of the owner in all contexts
+  static void release(const void *owner);
+  // Deletes the containers released while another context was current
+  static void collect();
+  // Deletes all containers of the current context, before it goes away
+  static void clear();
+};
@@ -9,12 +9,12 @@
 enum DataType {
   Int = 0,       // int
   IVec2 = 1,     // std::array<int, 2>
-  IVec3 = 2,     // std::array<int, 2>
-  IVec4 = 3,     // std::array<int, 2>
+  IVec3 = 2,     // std::array<int, 3>
+  IVec4 = 3,     // std::array<int, 4>
   Float = 4,     // float
   Vec2 = 5,      // std::array<float, 2>
-  Vec3 = 6,      // std::array<float, 2>
-  Vec4 = 7,      // std::array<float, 2>
+  Vec3 = 6,      // std::array<float, 3>
+  Vec4 = 7,      // std::array<float, 4>
   Texture2D = 8, // GLuint
 };
 
@@ -25,12 +25,12 @@ private:
 public:
   using Int = int;
   using IVec2 = std::array<int, 2>;
-  using IVec3 = std::array<int, 2>;
-  using IVec4 = std::array<int, 2>;
+  using IVec3 = std::array<int, 3>;
+  using IVec4 = std::array<int, 4>;
   using Float = float;
   using Vec2 = std::array<float, 2>;
-  using Vec3 = std::array<float, 2>;
-  using Vec4 = std::array<float, 2>;
+  using Vec3 = std::array<float, 3>;
+  using Vec4 = std::array<float, 4>;
   using Texture2D = GLuint;
 
   inline static constexpr DataType ALL[] = {
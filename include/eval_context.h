@@ -0,0 +1,170 @@
+#pragma once
+
+#include "data.h"
+#include "eval_tape.h"
+#include "render_target.h"
+
+#include <any>
+#include <cstdint>
+#include <imgui.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Forward declares
+struct RenderGraph;
+
+// Outputs of a node run for a given signature
+//
+// The signature hashes the node, the graph revision, the context state the node
+// reads and the signatures of its inputs. Contexts arriving at the same
+// signature share the result instead of running the node again. Pure nodes
+// are hashed by their type instead of their id, identical passes (e.g. pasted
+// copies of a branch) then only run once and share the result as well.
+struct NodeResult {
+  uint64_t signature = 0;
+  int node_id = -1; // Node which produced the result
+  std::vector<std::pair<int, Data>> outputs = {};           // Values written to output pins
+  std::optional<std::pair<std::string, GLuint>> image = {}; // Set by output nodes
+  std::unique_ptr<RenderTarget> target = nullptr;
+  // Targets of the further outputs of a pass, e.g. multiple render targets
+  std::vector<std::unique_ptr<RenderTarget>> attachments = {};
+
+  NodeResult() = default;
+  NodeResult(const NodeResult &) = delete;
+  NodeResult &operator=(const NodeResult &) = delete;
+  // Hands the targets back to the RenderTargetPool
+  ~NodeResult() {
+    RenderTargetPool::release(std::move(target));
+    for (auto &attachment : attachments)
+      RenderTargetPool::release(std::move(attachment));
+  }
+};
+
+// Render targets of a pass reading its own previous output, see FragmentShaderNode
+//
+// Kept by the context between evaluations. Each step renders into current
+// while sampling previous, the targets are swapped by handle, never copied.
+struct FeedbackBuffers {
+  std::unique_ptr<RenderTarget> previous = nullptr;
+  std::unique_ptr<RenderTarget> current = nullptr;
+  int frame = 0;                   // Steps since the last reset
+  double time = 0.0;               // Time of the last step
+  uint64_t resets = 0, clears = 0; // Requests of the node already handled
+
+  FeedbackBuffers() = default;
+  FeedbackBuffers(const FeedbackBuffers &) = delete;
+  FeedbackBuffers &operator=(const FeedbackBuffers &) = delete;
+  // Hands the targets back to the RenderTargetPool
+  ~FeedbackBuffers() {
+    RenderTargetPool::release(std::move(previous));
+    RenderTargetPool::release(std::move(current));
+  }
+};
+
+// Results of a graph shared by all of its contexts
+// Only weak references are kept, results live as long as a context shows them
+class ResultCache {
+private:
+  std::mutex mutex;
+  std::map<uint64_t, std::weak_ptr<NodeResult>> results = {}; // By signature
+
+public:
+  std::shared_ptr<NodeResult> find(uint64_t signature);
+  void insert(std::shared_ptr<NodeResult> result);
+};
+
+// State of one evaluation of a RenderGraph, e.g. of a viewport or an export
+//
+// Graphs only hold the topology, everything an evaluation produces lives here:
+// resolution, time, pin values and the render targets of the nodes. Contexts
+// are independent of each other, so any number of them can evaluate the same
+// graph. They still have to be evaluated under RenderThread::lock_evaluation(),
+// since programs keep their uniforms as shared state.
+class EvalContext {
+private:
+  // Identifies the frame produced by the last evaluation
+  struct Key {
+    uint64_t revision;
+    ImVec2 resolution;
+    double time;
+    std::vector<std::string> outputs;
+    uint64_t overrides;
+  };
+
+  RenderGraph *graph = nullptr; // Only set while evaluating
+  std::unordered_map<int, Data> pin_values = {}; // Written by passes
+  // Values of the CPU-evaluable nodes, see Tape
+  std::shared_ptr<const Tape> tape = nullptr;
+  TapeState tape_state = {};
+  // Results of the last evaluation by node id
+  std::map<int, std::shared_ptr<NodeResult>> results = {};
+  // State of an evaluation in progress, see RenderGraph::begin_evaluation()
+  std::map<int, std::shared_ptr<NodeResult>> pending = {};
+  std::map<int, uint64_t> signatures = {};
+  std::optional<Key> pending_key = {};
+  // Producers which may be folded into their consumer, see ShaderFusion
+  std::map<int, int> fusion = {};
+  std::set<int> deferred = {}; // Producers left for their consumer to run
+  std::shared_ptr<NodeResult> current = nullptr; // Result of the running node
+  // Feedback of the passes by node id, outlives the evaluations
+  std::map<int, std::shared_ptr<FeedbackBuffers>> feedback = {};
+  std::map<std::string, GLuint> images = {}; // Named outputs of the last evaluation
+  std::string primary = "";                  // Output returned by get_output()
+  bool stopped = false;
+  std::optional<Key> last_key = {};
+
+  friend struct RenderGraph;
+
+public:
+  ImVec2 resolution = ImVec2(640, 480);
+  double time = 0.0;
+  // Names of the outputs to produce, the default output if empty
+  // Their dependencies are evaluated once, shared nodes only run once
+  std::vector<std::string> outputs = {};
+  // Values replacing output pins of the nodes lowered into the Tape, e.g. for
+  // parameter sweeps. Pins of passes can't be overridden.
+  std::map<int, Data> overrides = {};
+
+  //! Used by nodes while running
+
+  RenderGraph &get_graph() { return *graph; }
+  // Returns the value of an input pin, empty if nothing is connected
+  Data get_pin_data(int pinid);
+  // Writes an output pin and passes the value on to connected input pins
+  void set_pin_data(int pinid, std::any value);
+  // Returns the render target of the running node, taken from the pool if the size changed
+  // Further targets of the node (e.g. multiple outputs) are numbered from 1
+  RenderTarget &get_target(int width, int height, GLenum format = GL_RGB8, size_t index = 0);
+  // Sets the image of a named output
+  void set_output(const std::string &name, GLuint image);
+  // Stops the evaluation, e.g. if a shader failed to compile
+  void stop() { stopped = true; }
+  // True if the node was left for its consumer to fuse with
+  bool is_deferred(int nodeid) const { return deferred.contains(nodeid); }
+  // Runs a deferred node on its own after all, e.g. if it can't be fused
+  void run_deferred(int nodeid);
+  // Marks a deferred node as run as part of the running node
+  void consume_deferred(int nodeid) { deferred.erase(nodeid); }
+  // Returns the feedback buffers of a node, empty ones on its first run
+  FeedbackBuffers &get_feedback(int nodeid);
+
+  //! Used by consumers
+
+  // Image of the first requested (or the default) output, 0 if there is none
+  GLuint get_output() const { return get_output(primary); }
+  // Image of a named output of the last evaluation, 0 if there is none
+  GLuint get_output(const std::string &name) const {
+    auto it = images.find(name);
+    return it != images.end() ? it->second : 0;
+  }
+  bool is_failed() const { return stopped; }
+  // Drops all results and feedback, e.g. before the OpenGL context goes away
+  void release();
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "data.h"
+#include "expression.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Forward declares
+struct RenderGraph;
+class EvalContext;
+
+// Value of a register, wide enough for every DataType besides textures
+struct Register {
+  std::array<float, 4> f = {};
+  std::array<int, 4> i = {};
+
+  static Register from_data(Data data);
+  Data to_data(DataType type) const;
+  // Lanes of an expression input, integers are converted
+  Expression::Lanes to_lanes(DataType type) const;
+};
+
+enum class TapeOp {
+  Time,       // f[0] = time of the context
+  Resolution, // f[0], f[1] = resolution of the context
+  Expression, // f = result of an Expression
+  Parameter,  // Value the context overrides the pin with, see EvalContext::overrides
+};
+struct TapeInstruction {
+  TapeOp op;
+  int dst;        // Register written
+  int index = -1; // Index into Tape::programs or Tape::parameters
+  int args = 0;   // Index of the first argument of a program in Tape::args
+};
+
+// Register file and scratch buffers of a context, reused between runs
+struct TapeState {
+  std::vector<Register> registers = {};
+  std::vector<Expression::Lanes> inputs = {};
+  std::vector<Expression::Lanes> scratch = {};
+};
+
+// The CPU side of a graph lowered into a flat list of instructions
+//
+// Nodes implementing Node::lower() don't run as passes, they write their
+// outputs into a register file instead. Consumers read them through
+// EvalContext::get_pin_data(). Nodes emitting no instructions (e.g. FloatNode)
+// are folded: their registers are initialized when the tape is compiled, so
+// only the instructions depending on the context run per frame. Only the GPU
+// passes are left to RenderGraph::run_node().
+struct Tape {
+  uint64_t revision = 0;    // Graph revision it was compiled for
+  uint64_t folded_hash = 0; // Hashed contexts of the folded nodes, see RenderGraph::compile()
+
+  std::vector<int> passes = {};  // Nodes to run as passes, inputs first
+  std::vector<int> lowered = {}; // Nodes running on the tape, inputs first
+  std::vector<std::pair<int, uint64_t>> folded = {}; // Folded nodes and their signatures
+
+  std::vector<TapeInstruction> code = {};
+  std::vector<Register> constants = {}; // Initial register file
+  std::vector<DataType> types = {};     // Types of the registers
+  std::unordered_map<int, int> pins = {}; // Input pins reading a register
+  std::vector<std::shared_ptr<const Expression>> programs = {};
+  std::vector<int> args = {}; // Registers read by programs, -1 reads zeros
+  std::vector<int> parameters = {}; // Output pins the contexts override
+
+  // Runs the instructions on the register file of the state, reset to the constants
+  void run(const EvalContext &context, TapeState &state) const;
+  // Runs the instructions for count contexts at once, e.g. the variants of a sweep
+  // Expressions evaluate all contexts in one Expression::run_batch(), buffered in batch
+  void run_batch(const EvalContext *const *contexts, TapeState *const *states, size_t count,
+                 TapeState &batch) const;
+};
+
+// Passed to Node::lower() to emit the instructions of a node
+class TapeBuilder {
+private:
+  RenderGraph &graph;
+  Tape &tape;
+  const std::set<int> &parameters; // Output pins the contexts override
+  std::set<int> written = {};      // Registers written by instructions
+
+  int allocate(DataType type);
+
+public:
+  TapeBuilder(RenderGraph &graph, Tape &tape, const std::set<int> &parameters)
+      : graph(graph), tape(tape), parameters(parameters) {}
+  // Allocates the register of an output pin, the input pins connected to it read it
+  // Overridden pins read the parameter instead, the node writes a register nobody reads
+  int output(int pinid);
+  // Folds an output pin to a value
+  void constant(int pinid, Data value);
+  // Register an input pin reads, -1 if it is unconnected
+  // Empty if a pass writes it, the node has to run as a pass as well then
+  std::optional<int> input(int pinid);
+  void emit(TapeOp op, int dst);
+  // Emits an expression reading the registers, folded if they all hold constants
+  void emit(std::shared_ptr<const Expression> expression, const std::vector<int> &args, int dst);
+};
@@ -1,51 +1,130 @@
 #pragma once
 
-#include <deque>
+#include "assets.h"
+#include "frame_pacer.h"
+#include "mpsc_queue.h"
+
+#include <filesystem>
 #include <memory>
 #include <optional>
+#include <spdlog/spdlog.h>
 #include <string>
 #include <variant>
+#include <vector>
 
 // Forward declares
 class Widget;
 
+// Events are moved through the queue and never copied
+struct MoveOnlyEvent {
+  MoveOnlyEvent() = default;
+  MoveOnlyEvent(MoveOnlyEvent &&) = default;
+  MoveOnlyEvent &operator=(MoveOnlyEvent &&) = default;
+  MoveOnlyEvent(const MoveOnlyEvent &) = delete;
+  MoveOnlyEvent &operator=(const MoveOnlyEvent &) = delete;
+};
+
 // Request to delete a widget, calls onShutdown()
-struct DeleteWidget {
+struct DeleteWidget : MoveOnlyEvent {
   int widget_id;
   DeleteWidget(int widget_id) : widget_id(widget_id) {}
 };
 
 // Request to add a widget, calls onStartup()
-struct AddWidget {
+struct AddWidget : MoveOnlyEvent {
   std::shared_ptr<Widget> widget;
   AddWidget(std::shared_ptr<Widget> widget) : widget(widget) {}
 };
 
 // Request to update status bar message
-struct StatusMessage {
+struct StatusMessage : MoveOnlyEvent {
   std::string message;
   StatusMessage(std::string message) : message(message) {}
 };
 
+// Notifies that a watched file was modified externally
+struct FileChanged : MoveOnlyEvent {
+  std::filesystem::path path;
+  FileChanged(std::filesystem::path path) : path(path) {}
+};
+
+// Notifies that an asset was loaded in the background
+// The asset is a loaded copy which AssetManager swaps in on the main thread
+struct AssetLoaded : MoveOnlyEvent {
+  AssetId<Asset> asset_id;
+  std::shared_ptr<Asset> asset;
+  AssetLoaded(AssetId<Asset> asset_id, std::shared_ptr<Asset> asset)
+      : asset_id(asset_id), asset(asset) {}
+};
+
+// Notifies that an asset was edited in place, e.g. a shader source
+struct AssetChanged : MoveOnlyEvent {
+  AssetId<Asset> asset_id;
+  AssetChanged(AssetId<Asset> asset_id) : asset_id(asset_id) {}
+};
+
+// Notifies that a shader was compiled
+struct CompileFinished : MoveOnlyEvent {
+  AssetId<Shader> shader_id;
+  bool success;
+  std::string log;
+  CompileFinished(AssetId<Shader> shader_id, bool success, std::string log = "")
+      : shader_id(shader_id), success(success), log(log) {}
+};
+
+// Reports the progress of an export running in the background
+struct ExportProgress : MoveOnlyEvent {
+  float progress; // 1 once finished
+  std::string message;
+  ExportProgress(float progress, std::string message) : progress(progress), message(message) {}
+};
+
 using Event = std::variant< //
     DeleteWidget,           //
     AddWidget,              //
-    StatusMessage           //
+    StatusMessage,          //
+    FileChanged,            //
+    AssetLoaded,            //
+    AssetChanged,           //
+    CompileFinished,        //
+    ExportProgress          //
     >;
 
 // Global event queue used to communicate certain
 // actions to the main Application that the senders
 // themselves cannot solve
+//
+// Events may be pushed from any thread but are only handled on the main thread.
 struct EventQueue {
 public:
-  static void push(Event event) { instance().queue.push_back(event); }
-  static std::optional<Event> pop() {
-    if (instance().queue.empty())
-      return {};
-    Event event = instance().queue.front();
-    instance().queue.pop_front();
-    return event;
+  static constexpr size_t CAPACITY = 4096;
+
+  // Returns false (and drops the event) if the queue is full
+  static bool push(Event &&event) {
+    if (instance().queue.push(std::move(event))) {
+      FramePacer::request_redraw(); // Wakes up an idle main loop
+      return true;
+    }
+    spdlog::warn("Event queue is full, dropping event!");
+    return false;
+  }
+  static std::optional<Event> pop() { return instance().queue.pop(); }
+  // Moves up to max_count queued events to the end of batch, returns the count
+  static size_t drain(std::vector<Event> &batch, size_t max_count = CAPACITY) {
+    size_t count = 0;
+    for (; count < max_count; count++) {
+      auto event = pop();
+      if (!event)
+        break;
+      batch.push_back(std::move(event.value()));
+    }
+    return count;
   }
+  // Pushes values from many producer threads into a queue like this one while the
+  // calling thread consumes them, checks that every value arrives once and in the
+  // order of its producer, the result is logged and reported in the status bar
+  // Blocks until all values arrived, so it should not run on the UI thread
+  static bool stress_test(int producers = 16, size_t values = 20000);
 
 private:
   // Access a static instance of EventQueue
@@ -54,5 +133,5 @@ private:
     return instance;
   }
 
-  std::deque<Event> queue;
+  MpscQueue<Event, CAPACITY> queue;
 };
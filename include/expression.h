@@ -0,0 +1,68 @@
+#pragma once
+
+#include "data.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// A typed arithmetic expression compiled to register bytecode
+//
+// Expressions use GLSL syntax, operators and functions over float and
+// vec2-vec4 values, e.g. `0.5 + 0.5 * sin(t * 2.0)`, plus `^` for pow().
+// Identifiers which are neither functions nor constants (pi, tau) are the free
+// variables of the expression, i.e. its inputs. Integer inputs are converted.
+//
+// The program is a flat list of instructions over registers of four lanes,
+// every instruction writing a register of its own. Instructions only reading
+// constants are folded while compiling. Evaluation runs on a scratch buffer
+// owned by the caller, which only grows, so evaluating does not allocate.
+class Expression {
+public:
+  using Lanes = std::array<float, 4>;
+
+  struct Variable {
+    std::string name;
+    DataType type;
+  };
+
+private:
+  enum class Op : uint8_t;
+  struct Instruction {
+    Op op;
+    uint8_t width; // Components written, read by reductions
+    uint16_t dst, a, b, c;
+  };
+  struct Compiler;
+
+  std::vector<Variable> variables = {}; // Held by the first registers
+  std::vector<Instruction> code = {};
+  std::vector<std::pair<uint16_t, Lanes>> constants = {}; // Registers read by the code
+  uint16_t registers = 0;
+  uint16_t result = 0;
+  int width = 1;
+  std::string error = "";
+
+  static void execute(const Instruction &instruction, Lanes *regs, size_t count);
+
+public:
+  // Compiles the expression, variables missing in types are floats
+  // Returns false on syntax and type errors, see get_error()
+  bool compile(const std::string &source, const std::map<std::string, DataType> &types = {});
+  const std::string &get_error() const { return error; }
+  // Inputs in order of their first occurrence
+  const std::vector<Variable> &get_variables() const { return variables; }
+  // Type of the result, Float or Vec2-Vec4
+  DataType get_type() const;
+  size_t get_size() const { return code.size(); }
+
+  // Evaluates the expression with one value per variable
+  Lanes run(const Lanes *inputs, std::vector<Lanes> &scratch) const;
+  // Evaluates the expression for count sets of inputs at once, e.g. for sweeps
+  // Inputs are variable-major, i.e. the count values of the first variable come first
+  void run_batch(const Lanes *inputs, size_t count, Lanes *results,
+                 std::vector<Lanes> &scratch) const;
+};
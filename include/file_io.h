@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Pending write of a whole file
+struct FileWrite {
+  std::filesystem::path path;
+  std::vector<unsigned char> data;
+};
+
+// Read-only memory mapping of a whole file
+//
+// The mapping stays valid for the lifetime of the object and is shared when
+// copied, empty files and failures result in an invalid mapping
+class MappedFile {
+private:
+  struct Mapping;
+  std::shared_ptr<Mapping> mapping;
+
+public:
+  operator bool() const { return mapping != nullptr; }
+
+  MappedFile() = default;
+  MappedFile(const std::filesystem::path &path);
+  const unsigned char *get_data() const;
+  size_t get_size() const;
+};
+
+// Reads a whole file into memory
+std::optional<std::vector<unsigned char>> read_file(const std::filesystem::path &path);
+// Writes a file through a temporary file and a rename so that readers never
+// observe a partially written file
+bool write_file_atomic(const std::filesystem::path &path, std::span<const unsigned char> data);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <vector>
+
+// Watches individual files for external modifications
+//
+// On Linux the parent directories are watched with inotify so that editors
+// saving through a rename are picked up as well, other platforms fall back to
+// polling modification times. Bursts of changes to the same file are coalesced
+// into a single FileChanged event once the file has been quiet for a while.
+class FileWatcher {
+private:
+  using Clock = std::chrono::steady_clock;
+
+  // Time a file must stay unmodified before its change is reported
+  static constexpr std::chrono::milliseconds QUIET_PERIOD{100};
+  // Interval between modification time scans when polling
+  static constexpr std::chrono::milliseconds POLL_INTERVAL{500};
+
+  std::set<std::filesystem::path> files = {};
+  // Files with unreported changes and the time of their last change
+  std::map<std::filesystem::path, Clock::time_point> pending = {};
+
+#if defined(__linux__)
+  int fd = -1;
+  std::map<int, std::filesystem::path> directories = {}; // Watch descriptor -> directory
+#else
+  std::map<std::filesystem::path, std::filesystem::file_time_type> mtimes = {};
+  Clock::time_point last_scan = {};
+#endif
+
+  // Reads change notifications without blocking
+  void read_changes();
+
+public:
+  FileWatcher();
+  ~FileWatcher();
+  FileWatcher(const FileWatcher &) = delete;
+  FileWatcher &operator=(const FileWatcher &) = delete;
+
+  // Starts watching a file, paths are normalized to absolute paths
+  void watch(const std::filesystem::path &path);
+  // Stops watching all files
+  void clear();
+  // Pushes a FileChanged event for every file that settled since the last poll
+  void poll();
+  // Normalized form of a path as reported by FileChanged
+  static std::filesystem::path normalize(const std::filesystem::path &path);
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <optional>
+
+// Forward declares
+struct GLFWwindow;
+
+// Average usage of the main loop over the last sample interval
+struct FrameStats {
+  float fps = 0.0f;
+  float busy = 0.0f; // Share of wall time the main thread spent on frames
+  float cpu = 0.0f;  // Process CPU time per wall time, summed over all threads
+  float gpu = 0.0f;  // Share of wall time the GPU spent on UI frames
+};
+
+// Decides when the main loop renders a frame
+//
+// The loop only renders continuously while something needs it: input, queued
+// events, pending background work or viewports playing an animated graph.
+// Otherwise it blocks in glfwWaitEventsTimeout() until woken. Frames can also
+// be capped to a maximum rate, the limiter sleeps most of the remaining frame
+// time and yields for the last bit to hit the target precisely.
+struct FramePacer {
+public:
+  // Frames rendered after waking up, ImGui needs a few to settle after input
+  static constexpr int SETTLE_FRAMES = 3;
+  // Longest time the loop sleeps without any reason to wake up
+  static constexpr double IDLE_TIMEOUT = 0.5;
+
+  // Must be called from the main thread after the window was created
+  static void init(GLFWwindow *window);
+  static void shutdown();
+
+  // Processes window events, blocking until a frame is due if idling
+  static void wait_events();
+  // Marks the start and end of the rendering of a frame
+  static void begin_frame();
+  static void end_frame();
+
+  // Renders the next frame as soon as possible, safe to call from any thread
+  static void request_redraw();
+  // Renders a frame no later than the given glfwGetTime()
+  static void request_frame_at(double time);
+
+  // Disabling idling renders frames continuously, e.g. for comparisons
+  static void set_idle_enabled(bool enabled);
+  static bool is_idle_enabled();
+  // Caps the frame rate of the main loop, 0 disables the cap
+  static void set_max_fps(float fps);
+  static float get_max_fps();
+
+  static FrameStats get_stats();
+  // Measures usage without and then with idling for the given seconds each
+  // The result is logged and reported in the status bar
+  static void start_benchmark(double seconds = 5.0);
+  // Progress of a running benchmark in [0, 1]
+  static std::optional<float> get_benchmark_progress();
+};
@@ -38,13 +38,18 @@ void main()
 }
 )";
 
-  unsigned int vao;
-  unsigned int vbo;
-  unsigned int ebo;
+  // Buffers are shared between contexts, vertex arrays are kept per context, see ContextObjects
+  unsigned int vbo = 0;
+  unsigned int ebo = 0;
+
+  // Creates the buffers on first draw
+  void create_buffers();
 
 public:
   // Creates a new ScreenQuadGeometry
   ScreenQuadGeometry(std::string name = "FullscreenQuad");
+  ~ScreenQuadGeometry();
+  ScreenQuadGeometry(const ScreenQuadGeometry &) = default;
   void compile_vertex_shader(unsigned int &vert_shader) override;
   void draw_geometry() override;
   void destroy() override;
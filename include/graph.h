@@ -2,10 +2,15 @@
 
 #include "assets.h"
 #include "data.h"
+#include "eval_context.h"
 #include <any>
 #include <imgui.h>
 #include <map>
 #include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
 
 #include <toml++/toml.hpp>
 
@@ -32,6 +37,14 @@ struct Edge {
 
 std::shared_ptr<Node> load_node(toml::table &tbl, std::shared_ptr<AssetManager> assets);
 
+// What RenderGraph::run_node() did with a node
+enum class NodeRun {
+  Ran,          // The node ran
+  Reused,       // A result of the node itself was reused
+  Deduplicated, // An identical node already produced the result
+  Deferred,     // Left for its consumer to fuse with, see ShaderFusion
+};
+
 // RenderGraph
 struct RenderGraph : Asset {
 private:
@@ -45,15 +58,28 @@ private:
   int next_edge_id = 0;
   int next_pin_id = 0;
 
-  std::vector<int> run_order = {};
-  bool should_stop = false;
+  // Incremented whenever the output of the graph is invalidated
+  uint64_t revision = 0;
+  // Node results shared between the contexts evaluating this graph
+  std::shared_ptr<ResultCache> results = std::make_shared<ResultCache>();
+  // Compiled tapes by the roots they evaluate and the pins overridden
+  std::map<std::pair<std::vector<int>, std::set<int>>, std::shared_ptr<const Tape>> tapes = {};
+  // Last status reported by end_evaluation(), only changes are pushed
+  std::string status;
+  // Graph a snapshot was taken of, see snapshot()
+  std::weak_ptr<RenderGraph> origin = {};
+  bool frozen = false; // Set on snapshots, their assets must not be compiled or loaded
 
   // Calls onLoad() on all nodes
   void setup_nodes_on_load();
+  // Hashes the node, its context and its inputs by position, see NodeResult
+  uint64_t sign_node(EvalContext &context, int nodeid);
 
 public:
-  ImVec2 viewport_resolution = ImVec2(640, 480);
-  double time;
+  // Time of the latest evaluation, the default time of exports
+  double time = 0.0;
+  // Folds chains of per-pixel shader passes into one, see ShaderFusion
+  bool fuse_shaders = false;
   std::shared_ptr<Geometry> graph_geometry = nullptr;
 
   RenderGraph(std::shared_ptr<AssetManager> assets = std::make_shared<AssetManager>(),
@@ -65,8 +91,6 @@ public:
   void set_node_positions(ImNodesEditorContext *context);
   // Gets node position for serialization
   void get_node_positions() const;
-  void set_resolution(ImVec2 res) { viewport_resolution = res; }
-  void set_time(double time) { this->time = time; }
   void set_geometry(std::shared_ptr<Geometry> geo) { graph_geometry = geo; }
   std::map<int, std::shared_ptr<Node>> &get_nodes() { return nodes; }
   std::map<int, Edge> &get_edges() { return edges; }
@@ -86,10 +110,13 @@ public:
   /// Delete a pin from the graph including related edges
   void delete_pin(int pinid);
   /// Delete an edge from the graph
-  void delete_edge(int edgeid) { edges.erase(edges.find(edgeid)); };
+  void delete_edge(int edgeid) {
+    edges.erase(edges.find(edgeid));
+    invalidate();
+  };
   void render();
+  // Returns an empty value of the pin type, values live in an EvalContext
   Data get_pin_data(int pinid);
-  void set_pin_data(int pinid, std::any ptr);
   void get_pins(int nodeid, std::vector<int> &pins) {
     for (auto &pair : this->pins) {
       if (pair.second.node_id == nodeid)
@@ -121,16 +148,57 @@ public:
       traverse(order, child);
     }
   }
-  // Creates a topological run order of the DAG
-  void topological_order() {
-    if (!get_root_node())
-      return;
-    traverse(run_order, root_node);
+  // Creates a topological run order of the union of the DAGs below the roots,
+  // run from back to front
+  std::vector<int> topological_order(const std::vector<int> &roots) {
+    std::vector<int> order;
+    for (int root : roots)
+      traverse(order, root);
+    return order;
   };
-  void stop() { should_stop = true; }
-  void evaluate();
+  // Lowers the nodes below the roots into a Tape, the remaining nodes run as passes
+  // Cached until the graph is invalidated or the value of a folded node changes
+  std::shared_ptr<const Tape> compile(EvalContext &context, const std::vector<int> &roots);
+  // Invalidates the graph if any node depends on the asset, returns true if so
+  bool on_asset_changed(AssetId<Asset> asset_id);
+  // Forces viewports to evaluate the graph again, called on every edit
+  void invalidate() { revision++; }
+  uint64_t get_revision() { return revision; }
+  // Returns true if any node depends on time, otherwise frames only change on edits
+  bool is_animated() const;
+  // Returns true if the context already holds the frame for its resolution and time
+  bool is_evaluated(const EvalContext &context) const;
+  // Copies the graph to be evaluated without holding RenderThread::lock()
+  //
+  // Nodes are cloned after preparing the assets they use, so only state guarded
+  // by RenderThread::lock_evaluation() is shared with the UI. Results are shared
+  // with the graph, tapes and the status are carried over from the previous
+  // snapshot of the graph. Must be called while holding RenderThread::lock().
+  static std::shared_ptr<RenderGraph> snapshot(std::shared_ptr<RenderGraph> graph,
+                                               const RenderGraph *previous = nullptr);
+  bool is_snapshot() const { return frozen; }
+  // Graph the snapshot was taken of, nullptr if it is none or the graph is gone
+  std::shared_ptr<RenderGraph> get_origin() const { return origin.lock(); }
+  // Runs the nodes for a context, reusing results other contexts share with it
+  void evaluate(EvalContext &context);
+  // Evaluation split into steps, so the GraphScheduler can interleave graphs
+  // Prepares the context and returns the nodes to run, inputs come first
+  // The tape is left to run_tapes() if run_tape is false
+  std::vector<int> begin_evaluation(EvalContext &context, bool run_tape = true);
+  // Runs the tapes of prepared contexts, contexts sharing one (e.g. the variants of a
+  // sweep) evaluate their expressions as a batch
+  static void run_tapes(const std::vector<EvalContext *> &contexts);
+  // Runs a node or reuses a shared result
+  // Producers fused into their consumer are deferred to it unless allow_defer is false
+  NodeRun run_node(EvalContext &context, int nodeid, bool allow_defer = true);
+  // Publishes the results of the context
+  void end_evaluation(EvalContext &context);
   int get_root_node_id() { return root_node; }
   void set_root_node(int root_node) { this->root_node = root_node; }
+  // Returns the node id of the OutputNode with the name
+  std::optional<int> find_output(const std::string &name);
+  // Names of all outputs, ordered by node id
+  std::vector<std::string> get_output_names();
   std::optional<Node *> get_root_node() {
     try {
       return nodes.at(root_node).get();
@@ -141,8 +209,6 @@ public:
   Node *get_node(int nodeid) { return nodes.at(nodeid).get(); }
   Edge get_edge(int edgeid) { return edges.at(edgeid); }
   Pin get_pin(int pinid) { return pins.at(pinid); }
-  // Prevents nodes from reusing previous data
-  void clear_graph_data();
   // Default node layout
   void default_layout(std::shared_ptr<AssetManager> assets, AssetId<Shader> shader_id);
   toml::table save(std::filesystem::path project_root) override;
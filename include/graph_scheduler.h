@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+// Forward declares
+struct RenderGraph;
+class EvalContext;
+
+// Cost of a graph in the latest batch it was evaluated in
+struct GraphCost {
+  int contexts = 0; // Contexts evaluated, e.g. viewports
+  int runs = 0;     // Nodes which actually ran
+  int reused = 0;   // Nodes reusing a result shared by another context
+  int deduped = 0;  // Nodes sharing the result of an identical node
+  float cpu = 0.0f; // Seconds spent running nodes, averaged over recent batches
+};
+
+// Summary of the latest batch
+struct BatchStats {
+  int graphs = 0;
+  int passes = 0;          // Nodes which actually ran
+  int deduped = 0;         // Passes skipped since an identical one already ran
+  int binds = 0;           // Program binds, i.e. changes of the pass key
+  int unbatched_binds = 0; // Binds if the graphs were evaluated one by one
+  size_t idle_targets = 0; // Render targets waiting in the RenderTargetPool
+};
+
+// Evaluates a set of graphs as one batch per frame
+//
+// Contexts are submitted while the widgets update and evaluated together by
+// flush(). Nodes are run in waves by their depth in the graph, so every node
+// of a wave only depends on earlier waves. Within a wave the passes of all
+// graphs are ordered by their pass key, graphs using the same shader are
+// drawn back to back instead of switching programs for every graph. Programs
+// already are shared assets and render targets come from the shared
+// RenderTargetPool, so variant graphs scale with the number of distinct passes.
+//
+// Contexts are queued per thread, either thread may flush the contexts it
+// submitted. Flushing takes RenderThread::lock_evaluation(), graphs which are
+// no snapshot must be submitted and flushed while holding RenderThread::lock().
+struct GraphScheduler {
+public:
+  // Queues a context for the next flush(), skipped if it already holds its frame
+  // The context must stay alive until then
+  static void submit(std::shared_ptr<RenderGraph> graph, EvalContext &context);
+  // Evaluates all queued contexts
+  static void flush();
+
+  // Cost of a graph, empty if it was not evaluated by a batch recently
+  static std::optional<GraphCost> get_cost(const RenderGraph *graph);
+  static BatchStats get_stats();
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Incremental 64-bit FNV-1a hash
+// Used for cache keys and content addressing, NOT cryptographically secure
+struct Hash {
+private:
+  static constexpr uint64_t OFFSET_BASIS = 14695981039346656037ull;
+  static constexpr uint64_t PRIME = 1099511628211ull;
+
+  uint64_t value = OFFSET_BASIS;
+
+public:
+  Hash() {}
+  Hash &add(const void *data, size_t size) {
+    auto bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) {
+      value ^= bytes[i];
+      value *= PRIME;
+    }
+    return *this;
+  }
+  Hash &add(std::string_view str) { return add(str.data(), str.size()); }
+  // Hashes the object representation of a trivially copyable value
+  template <typename T> Hash &add_value(const T &v) {
+    static_assert(std::is_trivially_copyable_v<T>, "Value must be trivially copyable!");
+    return add(&v, sizeof(T));
+  }
+  uint64_t get() const { return value; }
+  // Hashes a single string
+  static uint64_t of(std::string_view str) { return Hash().add(str).get(); }
+
+  // Parses a hash formatted by to_hex()
+  static std::optional<uint64_t> from_hex(std::string_view str) {
+    uint64_t hash = 0;
+    auto res = std::from_chars(str.data(), str.data() + str.size(), hash, 16);
+    if (str.empty() || res.ec != std::errc() || res.ptr != str.data() + str.size())
+      return {};
+    return hash;
+  }
+  // Formats a hash as a fixed-width hexadecimal string
+  static std::string to_hex(uint64_t hash) {
+    static constexpr char DIGITS[] = "0123456789abcdef";
+    std::string str(16, '0');
+    for (int i = 15; i >= 0; i--, hash >>= 4)
+      str[i] = DIGITS[hash & 0xf];
+    return str;
+  }
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Forward declares
+struct JobState;
+
+// Handle to a scheduled job, empty handles count as finished
+class Job {
+private:
+  std::shared_ptr<JobState> state;
+
+  friend struct Jobs;
+  Job(std::shared_ptr<JobState> state) : state(state) {}
+
+public:
+  Job() = default;
+  operator bool() const { return state != nullptr; }
+
+  bool is_done() const;
+  // Blocks until the job has finished, running other jobs in the meantime
+  void wait() const;
+};
+
+// Work-stealing job system shared by the whole application
+//
+// Every worker owns a deque: it pushes and pops its own jobs at the back and
+// idle workers steal from the front of others. Jobs may depend on other jobs
+// and only become runnable once all of them finished.
+//
+// OpenGL may only be used from the main thread, so jobs submitted with
+// submit_main() are queued separately and run by run_main() once per frame.
+struct Jobs {
+public:
+  // Starts the workers, 0 uses one thread per core besides the main thread
+  // Must be called from the main thread
+  static void init(unsigned int threads = 0);
+  // Finishes all queued jobs and stops the workers
+  static void shutdown();
+  // Number of worker threads
+  static unsigned int get_thread_count();
+
+  // Schedules a job on a worker once all dependencies have finished
+  static Job submit(std::function<void()> fn, std::vector<Job> deps = {});
+  // Schedules a job on the main thread once all dependencies have finished
+  static Job submit_main(std::function<void()> fn, std::vector<Job> deps = {});
+  // Runs fn(i) for every i in [0, count) split into jobs of a few iterations each
+  // Non-zero workers split it into that many jobs, so at most as many threads run it
+  static Job parallel_for(size_t count, std::function<void(size_t)> fn,
+                          std::vector<Job> deps = {}, unsigned int workers = 0);
+  // Returns a job finishing once all given jobs have finished
+  static Job when_all(std::vector<Job> jobs) { return submit([] {}, std::move(jobs)); }
+
+  // Runs the main thread jobs queued so far, called once per frame
+  static void run_main();
+  // True if called on the thread which called init()
+  static bool is_main_thread();
+
+  // Times a CPU-bound parallel_for on 1 to get_thread_count() workers in the background,
+  // the speedup over a single worker is logged and reported in the status bar
+  static void benchmark(size_t iterations = 4096);
+
+private:
+  static Job schedule(std::function<void()> fn, std::vector<Job> deps, bool main_thread);
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+// Bounded lock-free queue for many producers and a single consumer
+//
+// Every cell carries a sequence number telling whether it is free for the
+// producer claiming a position or filled for the consumer. Producers claim
+// positions with a CAS and never wait on each other, the consumer does not
+// need any atomic read-modify-write at all. Capacity must be a power of two.
+template <typename T, size_t Capacity> class MpscQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two!");
+
+private:
+  static constexpr size_t MASK = Capacity - 1;
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    std::optional<T> value;
+  };
+
+  std::unique_ptr<Cell[]> cells = std::make_unique<Cell[]>(Capacity);
+  // Producers and the consumer live on separate cache lines
+  alignas(64) std::atomic<size_t> enqueue_pos = 0;
+  alignas(64) size_t dequeue_pos = 0;
+
+public:
+  MpscQueue() {
+    for (size_t i = 0; i < Capacity; i++)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  // Moves a value into the queue, returns false if the queue is full
+  // Safe to call from any thread
+  bool push(T &&value) {
+    Cell *cell;
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells[pos & MASK];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false; // The consumer has not freed the cell yet
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value.emplace(std::move(value));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+  // Moves the oldest value out of the queue, if any
+  // Must only be called from the consumer thread
+  std::optional<T> pop() {
+    Cell &cell = cells[dequeue_pos & MASK];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (intptr_t(sequence) - intptr_t(dequeue_pos + 1) < 0)
+      return {}; // Empty, or the producer is still writing
+    std::optional<T> value = std::move(cell.value);
+    cell.value.reset();
+    cell.sequence.store(dequeue_pos + Capacity, std::memory_order_release);
+    dequeue_pos++;
+    return value;
+  }
+};
@@ -6,9 +6,12 @@
 #include "nodes/node.h" // IWYU pragma: export
 
 // Custom nodes
-#include "nodes/output_node.h"   // IWYU pragma: export
-#include "nodes/shader_node.h"   // IWYU pragma: export
-#include "nodes/texture_node.h"  // IWYU pragma: export
-#include "nodes/time_node.h"     // IWYU pragma: export
-#include "nodes/value_nodes.h"   // IWYU pragma: export
-#include "nodes/viewport_node.h" // IWYU pragma: export
+#include "nodes/blur_nodes.h"      // IWYU pragma: export
+#include "nodes/compute_nodes.h"   // IWYU pragma: export
+#include "nodes/expression_node.h" // IWYU pragma: export
+#include "nodes/output_node.h"     // IWYU pragma: export
+#include "nodes/shader_node.h"     // IWYU pragma: export
+#include "nodes/texture_node.h"    // IWYU pragma: export
+#include "nodes/time_node.h"       // IWYU pragma: export
+#include "nodes/value_nodes.h"     // IWYU pragma: export
+#include "nodes/viewport_node.h"   // IWYU pragma: export
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "blur.h"
+#include "node.h"
+
+// Blurs its input at the resolution of the context, see Blur
+class BlurNode : public Node {
+protected:
+  using Blurring = decltype(&Blur::gaussian);
+
+  int input_pin;
+  int output_pin;
+  float radius = 8.0f; // In pixels of the result
+
+  const float node_width = 120.0f;
+
+  void render_node(const char *title);
+  void run_blur(EvalContext &context, Blurring blur);
+  toml::table save_node(const char *type);
+  void load_node(toml::table &tbl);
+
+public:
+  void onEnter(RenderGraph &graph) override;
+  void onExit(RenderGraph &graph) override;
+  uint64_t hash_context(const EvalContext &context) const override;
+  bool is_pure() const override { return true; }
+  std::vector<int> layout() const override { return {output_pin, input_pin}; }
+};
+
+// Separable Gaussian, exact up to Blur::MAX_RADIUS and downsampled beyond
+class GaussianBlurNode : public BlurNode {
+public:
+  void render(RenderGraph &) override { render_node("Gaussian Blur"); }
+  void run(EvalContext &context) override { run_blur(context, Blur::gaussian); }
+  uint64_t pass_key() const override { return Hash::of("GaussianBlurNode"); }
+
+  std::shared_ptr<Node> clone() const override { return std::make_shared<GaussianBlurNode>(*this); }
+  toml::table save() override { return save_node("GaussianBlurNode"); }
+  static std::shared_ptr<Node> load(toml::table &tbl, std::shared_ptr<AssetManager>) {
+    auto n = GaussianBlurNode();
+    n.load_node(tbl);
+    return std::make_shared<GaussianBlurNode>(n);
+  }
+};
+
+// Dual-Kawase blur, the cheapest for large radii
+class KawaseBlurNode : public BlurNode {
+public:
+  void render(RenderGraph &) override { render_node("Dual-Kawase Blur"); }
+  void run(EvalContext &context) override { run_blur(context, Blur::kawase); }
+  uint64_t pass_key() const override { return Hash::of("KawaseBlurNode"); }
+
+  std::shared_ptr<Node> clone() const override { return std::make_shared<KawaseBlurNode>(*this); }
+  toml::table save() override { return save_node("KawaseBlurNode"); }
+  static std::shared_ptr<Node> load(toml::table &tbl, std::shared_ptr<AssetManager>) {
+    auto n = KawaseBlurNode();
+    n.load_node(tbl);
+    return std::make_shared<KawaseBlurNode>(n);
+  }
+};
+
+// Copies its input into a target with a full mip chain, e.g. for textureLod()
+// The number of levels is output as well
+class MipChainNode : public Node {
+private:
+  int input_pin;
+  int output_pin;
+  int levels_pin;
+
+  const float node_width = 120.0f;
+
+public:
+  void render(RenderGraph &graph) override;
+  void onEnter(RenderGraph &graph) override;
+  void onExit(RenderGraph &graph) override;
+  void run(EvalContext &context) override;
+  uint64_t hash_context(const EvalContext &context) const override;
+  bool is_pure() const override { return true; }
+
+  std::shared_ptr<Node> clone() const override { return std::make_shared<MipChainNode>(*this); }
+  std::vector<int> layout() const override { return {output_pin, levels_pin, input_pin}; }
+  toml::table save() override {
+    return toml::table{
+        {"type", "MipChainNode"},      //
+        {"node_id", id},               //
+        {"position", Node::save(pos)}, //
+        {"input_pin", input_pin},      //
+        {"output_pin", output_pin},    //
+        {"levels_pin", levels_pin},    //
+    };
+  }
+  static std::shared_ptr<Node> load(toml::table &tbl, std::shared_ptr<AssetManager>) {
+    auto n = MipChainNode();
+    n.id = tbl["node_id"].value<int>().value();
+    n.pos = Node::load_pos(*tbl["position"].as_table());
+    n.input_pin = tbl["input_pin"].value<int>().value();
+    n.output_pin = tbl["output_pin"].value<int>().value();
+    n.levels_pin = tbl["levels_pin"].value<int>().value();
+    return std::make_shared<MipChainNode>(n);
+  }
+};
+
+REGISTER_NODE_FACTORY(GaussianBlurNode)
+REGISTER_NODE_FACTORY(KawaseBlurNode)
+REGISTER_NODE_FACTORY(MipChainNode)
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "assets.h"
+#include "compute.h"
+#include "node.h"
+
+// Runs a compute shader over the pixels of its output, needs OpenGL 4.3
+//
+// The shader writes its result to `layout(rgba16f, binding = 0) uniform image2D u_output`
+// and may use `layout(std430, binding = 0) buffer` as scratch, cleared to zero every
+// run. The output has the size of the context or of a texture uniform, scaled, and
+// one invocation runs per pixel whatever the local size the shader declares.
+class ComputeShaderNode : public Node {
+  static constexpr GLenum OUTPUT_FORMAT = GL_RGBA16F;
+  static constexpr int MAX_BUFFER_SIZE = 1 << 24; // In floats
+
+  struct UniformPin {
+    int pinid;
+    DataType type;
+    std::string identifier;
+  };
+
+  std::vector<UniformPin> uniform_pins;
+  AssetId<Shader> shader_id;
+  int output_pin;
+  // Texture uniform whose size is dispatched, the context resolution if empty
+  std::string size_from;
+  float scale = 1.0f;
+  int buffer_size = 1024; // In floats
+
+  std::weak_ptr<Assets<Shader>> shaders;
+  std::weak_ptr<Shader> shader;
+
+  const float node_width = 240.0f;
+
+  // Compiles the shader if needed and reports the result, nullptr on failure
+  std::shared_ptr<Shader> get_compiled_shader(RenderGraph &graph);
+  // Size of the output, zero if the chosen input has none
+  void get_dispatch_size(EvalContext &context, int &width, int &height);
+
+public:
+  ComputeShaderNode(std::shared_ptr<AssetManager> assets)
+      : shaders(assets->getShaderCollection()) {}
+  int add_uniform_pin(RenderGraph &graph, DataType type, std::string name);
+  void render(RenderGraph &graph) override;
+  void onEnter(RenderGraph &graph) override;
+  void onExit(RenderGraph &graph) override;
+  void prepare(RenderGraph &graph) override { get_compiled_shader(graph); }
+  void run(EvalContext &context) override;
+  uint64_t hash_context(const EvalContext &context) const override;
+  bool is_pure() const override { return true; }
+  bool uses_asset(AssetId<Asset> asset_id) const override { return asset_id == shader_id; }
+  uint64_t pass_key() const override { return shader_id; }
+
+  std::shared_ptr<Node> clone() const override {
+    return std::make_shared<ComputeShaderNode>(*this);
+  }
+  std::vector<int> layout() const override {
+    std::vector<int> l = {output_pin};
+    for (auto &pin : uniform_pins)
+      l.push_back(pin.pinid);
+    return l;
+  }
+  toml::table save() override {
+    toml::array uniform_pins;
+    for (auto &pin : this->uniform_pins) {
+      toml::table t{
+          {"pin_id", pin.pinid},
+          {"identifier", pin.identifier},
+          {"type", pin.type},
+      };
+      t.is_inline(true);
+      uniform_pins.push_back(t);
+    }
+    return toml::table{
+        {"type", "ComputeShaderNode"},  //
+        {"node_id", id},                //
+        {"position", Node::save(pos)},  //
+        {"output_pin", output_pin},     //
+        {"uniform_pins", uniform_pins}, //
+        {"shader_id", shader_id},       //
+        {"size_from", size_from},       //
+        {"scale", scale},               //
+        {"buffer_size", buffer_size},   //
+    };
+  }
+  static std::shared_ptr<Node> load(toml::table &tbl, std::shared_ptr<AssetManager> assets) {
+    auto n = ComputeShaderNode(assets);
+    n.id = tbl["node_id"].value<int>().value();
+    n.pos = Node::load_pos(*tbl["position"].as_table());
+    n.output_pin = tbl["output_pin"].value<int>().value();
+    n.shader_id = tbl["shader_id"].value<int>().value();
+    n.shader = assets->getShader(n.shader_id).value();
+    n.size_from = tbl["size_from"].value_or(std::string());
+    n.scale = tbl["scale"].value_or(1.0f);
+    n.buffer_size = tbl["buffer_size"].value_or(1024);
+
+    if (!tbl["uniform_pins"].is_array_of_tables())
+      throw std::bad_optional_access();
+    for (auto &n_pin : *tbl["uniform_pins"].as_array()) {
+      toml::table *t_pin = n_pin.as_table();
+      n.uniform_pins.push_back(UniformPin{
+          .pinid = (*t_pin)["pin_id"].value<int>().value(),
+          .type = DataType((*t_pin)["type"].value<int>().value()),
+          .identifier = (*t_pin)["identifier"].value<std::string>().value(),
+      });
+    }
+    return std::make_shared<ComputeShaderNode>(n);
+  }
+};
+
+// Reduces the pixels of its input on the GPU, see Compute
+//
+// The result is a Texture2D rather than a Float or Vec4 pin: those hold CPU values set
+// with glUniform, so producing one would read the result back and stall on the GPU.
+// Consumers sample it instead, texelFetch(u_result, ivec2(0), 0) holds the value.
+class ReductionNode : public Node {
+private:
+  int input_pin;
+  int output_pin;
+  Compute::Reduction reduction = Compute::Reduction::Average;
+
+  const float node_width = 120.0f;
+
+public:
+  void render(RenderGraph &graph) override;
+  void onEnter(RenderGraph &graph) override;
+  void onExit(RenderGraph &graph) override;
+  void run(EvalContext &context) override;
+  uint64_t hash_context(const EvalContext &) const override {
+    return Hash().add_value(int(reduction)).get();
+  }
+  bool is_pure() const override { return true; }
+  uint64_t pass_key() const override { return Hash::of("ReductionNode"); }
+
+  std::shared_ptr<Node> clone() const override { return std::make_shared<ReductionNode>(*this); }
+  std::vector<int> layout() const override { return {output_pin, input_pin}; }
+  toml::table save() override {
+    return toml::table{
+        {"type", "ReductionNode"},     //
+        {"node_id", id},               //
+        {"position", Node::save(pos)}, //
+        {"input_pin", input_pin},      //
+        {"output_pin", output_pin},    //
+        {"reduction", int(reduction)}, //
+    };
+  }
+  static std::shared_ptr<Node> load(toml::table &tbl, std::shared_ptr<AssetManager>) {
+    auto n = ReductionNode();
+    n.id = tbl["node_id"].value<int>().value();
+    n.pos = Node::load_pos(*tbl["position"].as_table());
+    n.input_pin = tbl["input_pin"].value<int>().value();
+    n.output_pin = tbl["output_pin"].value<int>().value();
+    n.reduction = Compute::Reduction(tbl["reduction"].value_or(0));
+    return std::make_shared<ReductionNode>(n);
+  }
+};
+
+REGISTER_NODE_FACTORY(ComputeShaderNode)
+REGISTER_NODE_FACTORY(ReductionNode)
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "expression.h"
+#include "node.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Computes a value from an Expression, e.g. `0.5 + 0.5 * sin(t * 2.0)`
+// Input pins are generated from the free variables of the expression
+class ExpressionNode : public Node {
+  struct InputPin {
+    int pinid;
+    DataType type;
+    std::string name;
+  };
+
+  std::string source = "0.5 + 0.5 * sin(t)";
+  std::string edited = source; // Applied once the input is deactivated
+  std::vector<InputPin> input_pins;
+  int output_pin;
+  DataType output_type = DataType::Float;
+  // Shared by clones, nullptr if the source does not compile
+  std::shared_ptr<const Expression> expression = nullptr;
+  std::string error = "";
+
+  // Pin read by each variable, -1 if it has none or nothing is connected
+  std::vector<int> variable_pins;
+  const RenderGraph *bound_graph = nullptr; // Graph and revision variable_pins belong to
+  uint64_t bound_revision = 0;
+  // Buffers of run(), sized by bind() so evaluating does not allocate
+  std::vector<Expression::Lanes> inputs, scratch;
+
+  const float node_width = 200.0f;
+
+  // Compiles the source with the types of the input pins
+  void compile();
+  // Compiles the source and updates the pins to its variables and result
+  void rebuild(RenderGraph &graph);
+  // Looks up the pins of the variables for the current edges of the graph
+  void bind(RenderGraph &graph);
+
+public:
+  void render(RenderGraph &graph) override;
+  void onEnter(RenderGraph &graph) override;
+  void onExit(RenderGraph &graph) override;
+  // Only runs if an input is written by a pass, otherwise the node is lowered
+  void run(EvalContext &context) override;
+  bool lower(TapeBuilder &tape) const override;
+  uint64_t hash_context(const EvalContext &) const override { return Hash::of(source); }
+  bool is_pure() const override { return true; }
+
+  std::shared_ptr<Node> clone() const override { return std::make_shared<ExpressionNode>(*this); }
+  std::vector<int> layout() const override {
+    std::vector<int> l = {output_pin};
+    for (auto &pin : input_pins)
+      l.push_back(pin.pinid);
+    return l;
+  }
+  toml::table save() override {
+    toml::array input_pins;
+    for (auto &pin : this->input_pins) {
+      toml::table t{
+          {"pin_id", pin.pinid},
+          {"name", pin.name},
+          {"type", pin.type},
+      };
+      t.is_inline(true);
+      input_pins.push_back(t);
+    }
+    return toml::table{
+        {"type", "ExpressionNode"},    //
+        {"node_id", id},               //
+        {"position", Node::save(pos)}, //
+        {"source", source},            //
+        {"output_pin", output_pin},    //
+        {"output_type", output_type},  //
+        {"input_pins", input_pins},    //
+    };
+  }
+  static std::shared_ptr<Node> load(toml::table &tbl, std::shared_ptr<AssetManager>) {
+    auto n = ExpressionNode();
+    n.id = tbl["node_id"].value<int>().value();
+    n.pos = Node::load_pos(*tbl["position"].as_table());
+    n.edited = n.source = tbl["source"].value<std::string>().value();
+    n.output_pin = tbl["output_pin"].value<int>().value();
+    n.output_type = DataType(tbl["output_type"].value<int>().value());
+
+    if (!tbl["input_pins"].is_array())
+      throw std::bad_optional_access();
+    for (auto &n_pin : *tbl["input_pins"].as_array()) {
+      toml::table *t_pin = n_pin.as_table();
+      if (!t_pin)
+        throw std::bad_optional_access();
+      n.input_pins.push_back(InputPin{
+          .pinid = (*t_pin)["pin_id"].value<int>().value(),
+          .type = DataType((*t_pin)["type"].value<int>().value()),
+          .name = (*t_pin)["name"].value<std::string>().value(),
+      });
+    }
+    n.compile();
+    return std::make_shared<ExpressionNode>(n);
+  }
+};
+
+REGISTER_NODE_FACTORY(ExpressionNode)
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "assets.h"
 #include "data.h"
+#include "hash.h"
 #include <functional>
 #include <memory>
 #include <unordered_map>
@@ -33,6 +35,8 @@
 
 // Forward declares
 struct RenderGraph;
+class EvalContext;
+class TapeBuilder;
 struct AssetManager;
 class Node;
 
@@ -92,8 +96,34 @@ public:
   virtual void onExit(RenderGraph &) {}
   // Called when the Node is serialized and needs to perform additional setup
   virtual void onLoad(RenderGraph &) {}
+  // Called when an asset the Node uses changed, e.g. a shader was edited or reloaded
+  virtual void onAssetChanged(RenderGraph &) {}
+  // Loads or compiles the assets run() uses, called before the graph is snapshotted
+  virtual void prepare(RenderGraph &) {}
   // Runs the Node and writes to output pins
-  virtual void run(RenderGraph &) {}
+  // The node must not keep any state of the run, it belongs to the context
+  virtual void run(EvalContext &) {}
+  // Emits instructions computing the outputs on the CPU instead of running, see Tape
+  // Returns false (without emitting anything) if the node has to run as a pass
+  virtual bool lower(TapeBuilder &) const { return false; }
+  // Hashes everything the outputs depend on besides the inputs and the graph revision,
+  // e.g. parameters or the resolution, results are shared while the hash matches
+  virtual uint64_t hash_context(const EvalContext &) const { return 0; }
+  // Returns true if the output of the Node depends on the asset
+  virtual bool uses_asset(AssetId<Asset>) const { return false; }
+  // Returns true if the output of the Node changes over time
+  virtual bool is_animated() const { return false; }
+  // Returns true if the outputs only depend on the type, hash_context() and the inputs
+  // Identical pure nodes are evaluated once and share their outputs, so only nodes
+  // hashing all of their state may return true
+  virtual bool is_pure() const { return false; }
+  // Returns true if the outputs are fixed values, which shaders may bake into their source
+  virtual bool is_constant() const { return false; }
+  // Returns true while the user edits the value of a constant node, e.g. scrubs it
+  virtual bool is_editing() const { return false; }
+  // Identifies the GPU state (e.g. the program) a run binds, 0 if it does not render
+  // The GraphScheduler runs passes sharing a key back to back
+  virtual uint64_t pass_key() const { return 0; }
 
   static inline toml::table save(Data::Vec2 &pos) {
     toml::table t{
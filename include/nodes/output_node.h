@@ -4,18 +4,21 @@
 #include "imnodes.h"
 #include "node.h"
 #include <glad/gl.h>
+#include <imgui_stdlib.h>
 #include <spdlog/spdlog.h>
 
+// A named output of the graph, the checked one is the default output
 class OutputNode : public Node {
 private:
   int input_pin;
-  GLuint out_texture;
+  std::string name = "Image";
+  std::string edited = name; // Applied once the input is deactivated
 
-  float node_width = 80.0f;
+  float node_width = 120.0f;
 
 public:
   int get_input_pin() { return input_pin; }
-  GLuint get_image() { return out_texture; }
+  const std::string &get_name() const { return name; }
   void render(RenderGraph &graph) override {
     ImNodes::BeginNode(id);
 
@@ -34,7 +37,15 @@ public:
     ImNodes::EndNodeTitleBar();
     {
       BEGIN_INPUT_PIN(input_pin, DataType::Texture2D);
-      ImGui::Text("Image");
+      ImGui::SetNextItemWidth(node_width);
+      ImGui::InputText("##name", &edited);
+      if (ImGui::IsItemDeactivatedAfterEdit() && edited != name) {
+        if (edited.empty() || graph.find_output(edited)) { // Names must be unique
+          spdlog::error("Output names must be unique and not empty!");
+          edited = name;
+        } else
+          name = edited;
+      }
       END_INPUT_PIN();
     }
     ImGui::Dummy(ImVec2(node_width, 15.0f));
@@ -43,14 +54,17 @@ public:
   }
   void onEnter(RenderGraph &graph) override {
     graph.register_pin(id, DataType::Texture2D, &input_pin);
-    graph.set_root_node(id);
+    if (graph.find_output(name)) // Names must be unique, e.g. after pasting
+      edited = name = fmt::format("Output{}", id);
+    if (!graph.get_root_node())
+      graph.set_root_node(id);
   }
   void onExit(RenderGraph &graph) override { graph.delete_pin(input_pin); }
-  void run(RenderGraph &graph) override {
+  void run(EvalContext &context) override {
     static bool logged = false;
-    Data data = graph.get_pin_data(input_pin);
+    Data data = context.get_pin_data(input_pin);
     try {
-      out_texture = data.get<Data::Texture2D>();
+      context.set_output(name, data.get<Data::Texture2D>());
       logged = false;
     } catch (std::bad_any_cast &) {
       if (!logged) {
@@ -60,6 +74,10 @@ public:
     }
   }
 
+  uint64_t hash_context(const EvalContext &) const override { return Hash::of(name); }
+  // Outputs are sinks, each one names its own image
+  bool is_pure() const override { return false; }
+
   std::shared_ptr<Node> clone() const override { return std::make_shared<OutputNode>(*this); }
   std::vector<int> layout() const override { return {input_pin}; }
   toml::table save() override {
@@ -68,7 +86,7 @@ public:
         {"node_id", id},               //
         {"position", Node::save(pos)}, //
         {"input_pin", input_pin},      //
-        {"out_texture", out_texture},  //
+        {"name", name},                //
     };
   }
   static std::shared_ptr<Node> load(toml::table &tbl, std::shared_ptr<AssetManager>) {
@@ -76,7 +94,7 @@ public:
     n.id = tbl["node_id"].value<int>().value();
     n.pos = Node::load_pos(*tbl["position"].as_table());
     n.input_pin = tbl["input_pin"].value<int>().value();
-    n.out_texture = tbl["out_texture"].value<int>().value();
+    n.edited = n.name = tbl["name"].value_or<std::string>("Image");
     return std::make_shared<OutputNode>(n);
   }
 };
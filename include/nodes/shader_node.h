@@ -6,24 +6,63 @@
 #include "glad/gl.h"
 #endif
 
+#include <algorithm>
+
 class FragmentShaderNode : public Node {
+  static constexpr int MAX_ITERATIONS = 64;
+  // Draw buffers every OpenGL 3.3 implementation supports
+  static constexpr int MAX_OUTPUTS = 8;
+  // Simulations need more precision than 8 bits
+  static constexpr GLenum FEEDBACK_FORMAT = GL_RGBA16F;
+
   struct UniformPin {
     int pinid;
     DataType type;
     std::string identifier;
   };
 
+  struct OutputPin {
+    int pinid;
+    int location;
+    std::string identifier;
+  };
+
   std::vector<UniformPin> uniform_pins;
   AssetId<Shader> shader_id;
-  int output_pin;
+  int output_pin; // Location 0, the only output of most shaders
+  // Further `layout(location = N) out` declarations, rendered in the same pass
+  // Feedback passes only write location 0
+  std::vector<OutputPin> output_pins;
+  uint64_t outputs_hash = 0; // Shader and revision the output pins were synced with
+  // Bakes uniforms driven by constant nodes into the source, see ShaderVariants
+  bool specialize = false;
+  // Samples the previous output as u_previous, see FeedbackBuffers
+  bool feedback = false;
+  int iterations = 1; // Steps per frame, at most MAX_ITERATIONS
+  // Requested by the controls, the buffers of every context follow them
+  uint64_t resets = 0, clears = 0;
 
   std::weak_ptr<Assets<Shader>> shaders;
   std::weak_ptr<Shader> shader;
-  GLuint image_fbo;
-  GLuint image_colorbuffer;
 
   const float node_width = 240.0f;
 
+  // Compiles the shader if needed and reports the result, nullptr on failure
+  std::shared_ptr<Shader> get_compiled_shader(RenderGraph &graph);
+  // Returns the variant with the constant uniforms baked in, nullptr to use the generic
+  // program, e.g. while a constant is being edited
+  std::shared_ptr<Shader> get_specialized_shader(EvalContext &context,
+                                                 const std::shared_ptr<Shader> &shader);
+  // Matches the output pins to the declarations of the shader, pins keep their
+  // connections as long as the name is declared
+  void sync_outputs(RenderGraph &graph);
+  // Sets the uniforms of the pins and draws into the bound target
+  void draw(EvalContext &context, Shader &shader);
+  // Steps the feedback buffers of the context if the time advanced
+  void run_feedback(EvalContext &context, Shader &shader);
+
+  friend struct ShaderFusion;
+
 public:
   FragmentShaderNode(std::shared_ptr<AssetManager> assets)
       : shaders(assets->getShaderCollection()) {}
@@ -33,18 +72,27 @@ public:
     this->shader_id = shader_id;
   }
   int get_output_pin() { return output_pin; }
+  const std::vector<UniformPin> &get_uniform_pins() const { return uniform_pins; }
   // Sets up a new uniform
   int add_uniform_pin(RenderGraph &graph, DataType type, std::string name);
   // Renders the node
   void render(RenderGraph &graph) override;
   // Sets up existing uniform and output pins
   void onEnter(RenderGraph &graph) override;
-  // Sets up necessary OpenGL resources on load
-  void onLoad(RenderGraph &graph) override;
-  // Cleans up OpenGL resources and deletes registered pins
+  // Deletes registered pins
   void onExit(RenderGraph &graph) override;
-  // Executes the shader
-  void run(RenderGraph &graph) override;
+  // Hidden node editors don't render, so edits from elsewhere resync the output pins here
+  void onAssetChanged(RenderGraph &graph) override { sync_outputs(graph); }
+  void prepare(RenderGraph &graph) override { get_compiled_shader(graph); }
+  // Executes the shader into the render target of the context, fused with the
+  // producers deferred to it if any, see ShaderFusion
+  void run(EvalContext &context) override;
+  uint64_t hash_context(const EvalContext &context) const override;
+  // Feedback depends on the history of the context
+  bool is_animated() const override { return feedback; }
+  bool is_pure() const override { return !feedback; }
+  bool uses_asset(AssetId<Asset> asset_id) const override { return asset_id == shader_id; }
+  uint64_t pass_key() const override { return shader_id; }
 
   // OnEnter() will overwrite registered pins
   std::shared_ptr<Node> clone() const override {
@@ -52,9 +100,11 @@ public:
   }
   std::vector<int> layout() const override {
     std::vector<int> l = {output_pin};
-    l.reserve(uniform_pins.size() + 1);
+    l.reserve(uniform_pins.size() + output_pins.size() + 1);
     for (auto &pin : uniform_pins)
       l.push_back(pin.pinid);
+    for (auto &pin : output_pins)
+      l.push_back(pin.pinid);
     return l;
   }
   toml::table save() override {
@@ -69,6 +119,16 @@ public:
       t.is_inline(true);
       uniform_pins.push_back(t);
     }
+    toml::array output_pins;
+    for (auto &pin : this->output_pins) {
+      toml::table t{
+          {"pin_id", pin.pinid},
+          {"location", pin.location},
+          {"identifier", pin.identifier},
+      };
+      t.is_inline(true);
+      output_pins.push_back(t);
+    }
 
     return toml::table{
         {"type", "FragmentShaderNode"}, //
@@ -76,7 +136,11 @@ public:
         {"position", Node::save(pos)},  //
         {"output_pin", output_pin},     //
         {"uniform_pins", uniform_pins}, //
+        {"output_pins", output_pins},   //
         {"shader_id", shader_id},       //
+        {"specialize", specialize},     //
+        {"feedback", feedback},         //
+        {"iterations", iterations},     //
     };
   }
   static std::shared_ptr<Node> load(toml::table &tbl, std::shared_ptr<AssetManager> assets) {
@@ -86,6 +150,9 @@ public:
     n.output_pin = tbl["output_pin"].value<int>().value();
     n.shader_id = tbl["shader_id"].value<int>().value();
     n.shader = assets->getShader(n.shader_id).value();
+    n.specialize = tbl["specialize"].value_or(false);
+    n.feedback = tbl["feedback"].value_or(false);
+    n.iterations = std::clamp(tbl["iterations"].value_or(1), 1, MAX_ITERATIONS);
 
     if (!tbl["uniform_pins"].is_array_of_tables())
       throw std::bad_optional_access();
@@ -102,6 +169,19 @@ public:
           .identifier = identifier,
       });
     }
+    // Missing in projects saved before multiple outputs
+    if (auto output_pins = tbl["output_pins"].as_array()) {
+      for (auto &n_pin : *output_pins) {
+        toml::table *t_pin = n_pin.as_table();
+        if (!t_pin)
+          throw std::bad_optional_access();
+        n.output_pins.push_back(OutputPin{
+            .pinid = (*t_pin)["pin_id"].value<int>().value(),
+            .location = (*t_pin)["location"].value<int>().value(),
+            .identifier = (*t_pin)["identifier"].value<std::string>().value(),
+        });
+      }
+    }
 
     return std::make_shared<FragmentShaderNode>(n);
   }
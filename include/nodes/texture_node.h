@@ -67,10 +67,20 @@ public:
     graph.register_pin(id, DataType::Texture2D, &output_pin);
   }
   void onExit(RenderGraph &graph) override { graph.delete_pin(output_pin); }
-  void run(RenderGraph &graph) override {
+  void prepare(RenderGraph &) override {
     if (auto texture = this->texture.lock())
-      graph.set_pin_data(output_pin, (Data::Texture2D)texture->get_texture());
+      texture->ensure_loaded();
   }
+  void run(EvalContext &context) override {
+    if (auto texture = this->texture.lock())
+      context.set_pin_data(output_pin, (Data::Texture2D)texture->get_texture());
+  }
+  uint64_t hash_context(const EvalContext &) const override {
+    return Hash().add_value(texture_id).get();
+  }
+  bool is_pure() const override { return true; }
+
+  bool uses_asset(AssetId<Asset> asset_id) const override { return asset_id == texture_id; }
 
   std::shared_ptr<Node> clone() const override { return std::make_shared<Texture2DNode>(*this); }
   std::vector<int> layout() const override { return {output_pin}; }
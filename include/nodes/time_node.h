@@ -31,7 +31,18 @@ public:
     graph.register_pin(id, DataType::Float, &output_pin);
   }
   void onExit(RenderGraph &graph) override { graph.delete_pin(output_pin); }
-  void run(RenderGraph &graph) override { graph.set_pin_data(output_pin, (Data::Float)graph.time); }
+  void run(EvalContext &context) override {
+    context.set_pin_data(output_pin, (Data::Float)context.time);
+  }
+  bool lower(TapeBuilder &tape) const override {
+    tape.emit(TapeOp::Time, tape.output(output_pin));
+    return true;
+  }
+  uint64_t hash_context(const EvalContext &context) const override {
+    return Hash().add_value(context.time).get();
+  }
+  bool is_pure() const override { return true; }
+  bool is_animated() const override { return true; }
 
   std::shared_ptr<Node> clone() const override { return std::make_shared<TimeNode>(*this); }
   std::vector<int> layout() const override { return {output_pin}; }
@@ -40,7 +40,18 @@ public:
     graph.register_pin(id, DataType::Float, &output_pin);
   }
   void onExit(RenderGraph &graph) override { graph.delete_pin(output_pin); }
-  void run(RenderGraph &graph) override { graph.set_pin_data(output_pin, (Data::Float)value); }
+  void run(EvalContext &context) override { context.set_pin_data(output_pin, (Data::Float)value); }
+  bool lower(TapeBuilder &tape) const override {
+    tape.constant(output_pin, Data(DataType::Float, value));
+    return true;
+  }
+  uint64_t hash_context(const EvalContext &) const override {
+    return Hash().add_value(value).get();
+  }
+  bool is_pure() const override { return true; }
+  bool is_constant() const override { return true; }
+  // The value is only committed once the input is deactivated
+  bool is_editing() const override { return value != prev_value; }
 
   std::shared_ptr<Node> clone() const override { return std::make_shared<FloatNode>(*this); }
   std::vector<int> layout() const override { return {output_pin}; }
@@ -58,7 +69,7 @@ public:
     n.id = tbl["node_id"].value<int>().value();
     n.pos = Node::load_pos(*tbl["position"].as_table());
     n.output_pin = tbl["output_pin"].value<int>().value();
-    n.value = tbl["value"].value<float>().value();
+    n.value = n.prev_value = tbl["value"].value<float>().value();
     return std::make_shared<FloatNode>(n);
   }
 };
@@ -74,8 +85,8 @@ class Vec2Node : public Node {
 
 public:
   void set_value(float x, float y) {
-    value[0] = x;
-    value[1] = y;
+    prev_value[0] = value[0] = x;
+    prev_value[1] = value[1] = y;
   }
   int get_output_pin() { return output_pin; }
   void render(RenderGraph &) override {
@@ -102,7 +113,18 @@ public:
   }
   void onEnter(RenderGraph &graph) override { graph.register_pin(id, DataType::Vec2, &output_pin); }
   void onExit(RenderGraph &graph) override { graph.delete_pin(output_pin); }
-  void run(RenderGraph &graph) override { graph.set_pin_data(output_pin, (Data::Vec2)value); }
+  void run(EvalContext &context) override { context.set_pin_data(output_pin, (Data::Vec2)value); }
+  bool lower(TapeBuilder &tape) const override {
+    tape.constant(output_pin, Data(DataType::Vec2, value));
+    return true;
+  }
+  uint64_t hash_context(const EvalContext &) const override {
+    return Hash().add_value(value).get();
+  }
+  bool is_pure() const override { return true; }
+  bool is_constant() const override { return true; }
+  // The value is only committed once the input is deactivated
+  bool is_editing() const override { return value != prev_value; }
 
   std::shared_ptr<Node> clone() const override { return std::make_shared<Vec2Node>(*this); }
   std::vector<int> layout() const override { return {output_pin}; }
@@ -120,7 +142,7 @@ public:
     n.id = tbl["node_id"].value<int>().value();
     n.pos = Node::load_pos(*tbl["position"].as_table());
     n.output_pin = tbl["output_pin"].value<int>().value();
-    n.value = Node::load_pos(*tbl["value"].as_table());
+    n.value = n.prev_value = Node::load_pos(*tbl["value"].as_table());
     return std::make_shared<Vec2Node>(n);
   }
 };
@@ -30,10 +30,18 @@ public:
   }
   void onEnter(RenderGraph &graph) override { graph.register_pin(id, DataType::Vec2, &output_pin); }
   void onExit(RenderGraph &graph) override { graph.delete_pin(output_pin); }
-  void run(RenderGraph &graph) override {
-    ImVec2 res = graph.viewport_resolution;
-    graph.set_pin_data(output_pin, Data::Vec2({res.x, res.y}));
+  void run(EvalContext &context) override {
+    ImVec2 res = context.resolution;
+    context.set_pin_data(output_pin, Data::Vec2({res.x, res.y}));
   }
+  bool lower(TapeBuilder &tape) const override {
+    tape.emit(TapeOp::Resolution, tape.output(output_pin));
+    return true;
+  }
+  uint64_t hash_context(const EvalContext &context) const override {
+    return Hash().add_value(context.resolution.x).add_value(context.resolution.y).get();
+  }
+  bool is_pure() const override { return true; }
 
   std::shared_ptr<Node> clone() const override { return std::make_shared<ViewportNode>(*this); }
   std::vector<int> layout() const override { return {output_pin}; }
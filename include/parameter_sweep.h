@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Forward declares
+struct RenderGraph;
+class RenderTarget;
+
+// A pin varied over a range, or the time if pin is -1
+struct SweepAxis {
+  int pin = -1;
+  float from = 0.0f, to = 1.0f;
+  int steps = 4;
+
+  // Value of a step, from and to are both included
+  float get_value(int step) const {
+    return steps > 1 ? from + (to - from) * float(step) / float(steps - 1) : from;
+  }
+};
+
+// Renders every combination of a set of axes into a contact sheet
+//
+// Each variant is a context overriding the swept pins, see EvalContext::overrides.
+// Only pins of nodes lowered into the Tape can be swept, so the passes of a
+// variant just read other registers and the shaders are shared by all of them.
+// Variants are submitted to the GraphScheduler in chunks, which orders the
+// passes of a chunk by their pass key: each program is bound once per chunk
+// and only its uniforms change between variants. Expressions reading the swept
+// pins run for the whole chunk at once, see Tape::run_batch(). Contexts are
+// reused between chunks and recycle their render targets, nothing is
+// reallocated per variant.
+//
+// Must be used while holding RenderThread::lock().
+struct ParameterSweep {
+public:
+  static constexpr int MAX_VARIANTS = 1024;
+  // Variants evaluated per flush, a 16x16 sweep runs as one batch
+  static constexpr int CHUNK = 256;
+
+  // Float outputs of the constant nodes, e.g. FloatNode
+  static std::vector<int> get_sweepable_pins(RenderGraph &graph);
+  // Name of a swept pin in the UI
+  static std::string get_axis_name(RenderGraph &graph, int pin);
+  static int count_variants(const std::vector<SweepAxis> &axes);
+  // Cells of the sheet, the first axis runs along the columns
+  // A single axis wraps into a near square grid instead of one long row
+  static void get_layout(const std::vector<SweepAxis> &axes, int &columns, int &rows);
+  // Largest width or height of a sheet, needs the OpenGL context
+  static int get_max_size();
+  // Returns true if the sheet of cells of width x height is within get_max_size()
+  static bool fits(const std::vector<SweepAxis> &axes, int width, int height);
+
+  // Renders the variants as cells of width x height laid out by get_layout()
+  // Returns the sheet taken from the RenderTargetPool, nullptr on failure
+  static std::unique_ptr<RenderTarget> render(std::shared_ptr<RenderGraph> graph,
+                                              const std::vector<SweepAxis> &axes, int width,
+                                              int height, double time, const std::string &output);
+};
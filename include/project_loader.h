@@ -0,0 +1,73 @@
+#pragma once
+
+#include "assets.h"
+#include "jobs.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <toml++/toml.hpp>
+
+// Forward declares
+class ProjectPack;
+class Texture;
+
+// Project read by ProjectLoader, ready to replace the current one
+struct LoadedProject {
+  std::filesystem::path path;             // Project directory or pack file
+  std::filesystem::path root;             // Base of relative asset paths
+  std::shared_ptr<ProjectPack> pack = {}; // Set if opened from a pack
+  toml::table project;                    // Contents of srproject.toml
+  std::optional<std::string> imgui_ini = {};
+  // Assets created from the project, shaders are read and textures prepared
+  std::shared_ptr<AssetManager> assets = std::make_shared<AssetManager>();
+  // Textures waiting for their OpenGL texture to be created
+  std::vector<std::shared_ptr<Texture>> uploads = {};
+};
+
+// Opens projects in the background
+//
+// Parsing, file reads and texture decoding run as jobs while the current
+// project stays interactive. Creating OpenGL objects has to happen on the main
+// thread, so poll() uploads prepared textures in slices of a time budget per
+// frame and hands the project over once everything is in place.
+class ProjectLoader {
+private:
+  Job task;
+  std::optional<LoadedProject> result; // Written by the job, read once it is done
+  // Project read by the job, being uploaded on the main thread
+  std::optional<LoadedProject> loaded;
+  size_t next_upload = 0;
+
+  std::atomic<bool> cancelled = false;
+  std::atomic<bool> failed = false;
+  std::atomic<size_t> steps_done = 0;
+  std::atomic<size_t> steps_total = 0;
+
+  // Reads a project directory or pack, runs as a job
+  std::optional<LoadedProject> read(std::filesystem::path path);
+
+public:
+  ~ProjectLoader() {
+    cancel();
+    task.wait();
+  }
+
+  bool is_busy() { return task || loaded.has_value(); }
+  // Starts opening a project directory or *.srpack file, returns false if busy
+  bool open(std::filesystem::path path);
+  // Abandons the current load, the current project is kept
+  void cancel();
+  // Fraction of the load completed so far, between 0 and 1
+  float get_progress();
+  // Returns true once after a load failed, the reason is logged
+  bool take_failure() { return failed.exchange(false); }
+  // Advances the load by at most the given budget of main thread time,
+  // returns the project once it is ready to be swapped in
+  std::optional<LoadedProject> poll(std::chrono::milliseconds budget);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "file_io.h"
+#include "jobs.h"
+
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <toml++/toml.hpp>
+
+// Immutable state of a project to be written to disk
+struct ProjectSnapshot {
+  std::filesystem::path root;
+  toml::table project;               // Contents of srproject.toml
+  std::vector<FileWrite> files = {}; // Other files to write, e.g. shader sources
+};
+
+// Writes projects to disk on a background thread
+//
+// Snapshots are built on the main thread and serialized and written by a
+// worker, so saving never blocks the UI on disk. Files whose content matches
+// the last save are skipped and every file goes through a temporary file and
+// a rename, so a crash never leaves a truncated file behind.
+class ProjectSaver {
+private:
+  Job task;
+  bool result = false; // Written by the job, read once it is done
+
+  std::mutex mutex;
+  // Content hashes of files written by previous saves
+  std::map<std::filesystem::path, uint64_t> written = {};
+
+  // Writes a snapshot, runs on the worker
+  bool write(ProjectSnapshot snapshot);
+
+public:
+  ~ProjectSaver() { wait(); }
+
+  bool is_busy() { return task; }
+  // Starts writing a snapshot, returns false if a save is still in progress
+  bool save(ProjectSnapshot snapshot);
+  // Returns the result of a finished save, if any
+  std::optional<bool> poll();
+  // Blocks until the current save (if any) has finished and returns its result
+  std::optional<bool> wait();
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <glad/gl.h>
+#include <memory>
+#include <vector>
+
+// A color texture nodes render into
+//
+// Targets belong to the evaluation result of a node and are recycled by the
+// next evaluation of the same context unless another context still shows them.
+// Otherwise they go back to the RenderTargetPool once the result is dropped.
+class RenderTarget {
+private:
+  GLuint texture = 0;
+  size_t attached = 0; // Further targets attached by begin(), detached again by end()
+  int width = 0, height = 0;
+  GLenum format = 0;
+  bool mipmapped = false; // Sampled trilinearly, see generate_mipmaps()
+
+public:
+  RenderTarget() = default;
+  RenderTarget(const RenderTarget &) = delete;
+  RenderTarget &operator=(const RenderTarget &) = delete;
+  ~RenderTarget();
+
+  // Reallocates the texture if the size or format changed
+  void resize(int width, int height, GLenum format = GL_RGB8);
+  // Binds a framebuffer rendering into the texture and clears it, returns false if incomplete
+  // Framebuffers are not shared between contexts, one is kept per context, see ContextObjects
+  // Attachments of the same size are drawn to by the outputs at location 1 onwards,
+  // nullptr skips a location
+  bool begin(const std::vector<RenderTarget *> &attachments = {});
+  void end();
+  // Generates the mip levels of the texture, which is then sampled trilinearly
+  // Rendering into the target again with begin() drops them
+  void generate_mipmaps();
+  // Number of mip levels of the size
+  int get_levels() const;
+
+  GLuint get_texture() const { return texture; }
+  int get_width() const { return width; }
+  int get_height() const { return height; }
+  GLenum get_format() const { return format; }
+};
+
+// Idle render targets shared by all graphs and contexts
+//
+// Graphs rendering at the same resolution keep reusing each others textures
+// instead of reallocating them. Safe to use from any thread, since textures
+// are shared between the UI and the render thread context.
+struct RenderTargetPool {
+public:
+  // Idle targets kept at most, the oldest are deleted first
+  static constexpr size_t MAX_IDLE = 32;
+
+  // Takes an idle target of the size and format or creates a new one
+  static std::unique_ptr<RenderTarget> acquire(int width, int height, GLenum format = GL_RGB8);
+  // Returns a target no longer shown by anything
+  static void release(std::unique_ptr<RenderTarget> target);
+  // Deletes all idle targets, e.g. before the OpenGL context goes away
+  static void clear();
+  static size_t get_idle_count();
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "eval_context.h"
+
+#include <glad/gl.h>
+#include <imgui.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Forward declares
+struct RenderGraph;
+struct GLFWwindow;
+
+// Frames of a graph rendered on the render thread, shown by a ViewportWidget
+//
+// Frames are triple buffered: the render thread writes the back texture while
+// the UI shows the front one and finished frames wait in the ready slot. Each
+// frame is fenced before it becomes ready, so the UI never waits on the GPU,
+// and textures the UI stops showing are fenced before they are written again.
+class AsyncViewport {
+private:
+  struct Slot {
+    GLuint texture = 0;
+    int width = 0, height = 0;
+    GLsync release = nullptr; // Signalled once the UI is done sampling the texture
+  };
+  struct Request {
+    std::shared_ptr<RenderGraph> graph;
+    ImVec2 resolution;
+    double time;
+    std::vector<std::string> outputs;
+  };
+
+  std::mutex mutex;
+  Slot slots[3];
+  int front = 0, ready = 1, back = 2;
+  bool fresh = false; // Ready holds a frame the UI has not shown yet
+  std::optional<Request> request;
+  bool closed = false; // Guarded by RenderThread::lock()
+  // Only used by the render thread
+  EvalContext context;
+  std::optional<Request> taken;
+  std::shared_ptr<RenderGraph> snapshot; // See RenderGraph::snapshot()
+  GLsync done = nullptr; // Signalled once the frame was copied into the back slot
+
+  friend struct RenderThread;
+  // Frames of all viewports are rendered as one batch by the render thread:
+  // Takes the latest request, returns false if there is none
+  bool take_request();
+  // Copies the graph of the taken request, under RenderThread::lock()
+  void take_snapshot();
+  // Submits the snapshot to the GraphScheduler, under RenderThread::lock_evaluation()
+  void submit();
+  // Copies the evaluated output into the back slot, under RenderThread::lock_evaluation()
+  void copy_output();
+  // Waits for the copy and hands the frame to the UI
+  void present();
+
+public:
+  AsyncViewport() = default;
+  AsyncViewport(const AsyncViewport &) = delete;
+  AsyncViewport &operator=(const AsyncViewport &) = delete;
+  ~AsyncViewport();
+
+  // Requests a frame, replacing any request not picked up yet
+  void request_frame(std::shared_ptr<RenderGraph> graph, ImVec2 resolution, double time,
+                     std::vector<std::string> outputs = {});
+  // Returns the texture of the latest finished frame, 0 if there is none yet
+  GLuint acquire();
+  // Stops rendering frames, e.g. before the graph is destroyed
+  // Must be called while holding RenderThread::lock()
+  void close() { closed = true; }
+};
+
+// Evaluates graphs on a separate thread with its own OpenGL context
+//
+// The context shares objects with the UI context, so programs, textures and
+// buffers can be used by both. Container objects (framebuffers, vertex arrays)
+// are not shared and are kept per context, see ContextObjects. Graphs and
+// assets are shared with the render thread as well, the main thread must hold
+// lock() while changing them. The render thread only holds it to snapshot the
+// requested graphs and evaluates the snapshots under lock_evaluation()
+// instead, so the UI is not stalled by evaluations. Anything the snapshots
+// still share with the UI (programs and their uniforms, asset images, caches of
+// compiled shaders) is guarded by lock_evaluation(), which the main thread
+// takes for its own evaluations and while changing assets in place.
+struct RenderThread {
+public:
+  // Starts the render thread, must be called from the main thread
+  static bool start(GLFWwindow *main_window);
+  // Stops the render thread, must be called from the main thread
+  static void stop();
+  static bool is_running();
+
+  // Registers a viewport to render frames for, it is dropped once expired
+  static void add(std::shared_ptr<AsyncViewport> viewport);
+  // Locks graphs and assets against the render thread, recursive
+  static std::unique_lock<std::recursive_mutex> lock();
+  // Locks evaluations and the state they share against each other, recursive
+  // Taken after lock() if both are needed
+  static std::unique_lock<std::recursive_mutex> lock_evaluation();
+
+private:
+  static void run();
+  static void wake();
+
+  friend class AsyncViewport;
+};
@@ -2,6 +2,8 @@
 
 #include "app_path.h"
 #include "assets.h"
+#include "file_io.h"
+#include <array>
 #include <filesystem>
 #include <glad/gl.h>
 #include <spdlog/spdlog.h>
@@ -14,6 +16,7 @@ static const std::filesystem::path DEFAULT_FRAG_PATH =
 
 // Forward declares
 class Geometry;
+class ProjectPack;
 struct Data;
 
 class Shader : public Asset {
@@ -21,20 +24,40 @@ private:
   char log[512] = {'\0'};
   std::filesystem::path path; //  is RELATIVE to project_root
   std::string source;
+  // Where the source is loaded from on first use
+  std::filesystem::path source_root;
+  std::shared_ptr<ProjectPack> pack;
+  bool loaded = true;
 
   std::vector<GLuint> bound_textures = {};
   GLuint program = 0;
   bool compiled = false;
+  bool compute = false; // Compiled by compile_compute()
+  // Incremented whenever the source changes
+  uint64_t revision = 0;
+  // File and source hash of the last save (or load), used to skip unchanged shaders
+  std::filesystem::path saved_path;
+  uint64_t saved_hash = 0;
 
 public:
   operator bool() const { return compiled; }
 
   // Creates a new default fragment shader
   Shader(std::string name);
-  // Creates a new fragment shader and loads its source
-  Shader(std::string name, std::filesystem::path project_root, std::filesystem::path path);
+  // Creates a fragment shader from source, e.g. a generated one
+  Shader(std::string name, std::string source) : source(source) { this->name = name; }
+  // Creates a fragment shader whose source is loaded on first use
+  Shader(std::string name, std::filesystem::path project_root, std::filesystem::path path,
+         std::shared_ptr<ProjectPack> pack = nullptr);
+  // Loads the source if it was not loaded yet, returns false on failure
+  bool ensure_loaded();
+  bool is_loaded() { return loaded; }
   // Compiles the shader given a Geometry (mesh, vertex shader)
   bool compile(std::shared_ptr<Geometry> geo);
+  // Compiles the source as a compute shader instead, needs OpenGL 4.3, see Compute
+  bool compile_compute();
+  // Local size declared by the compiled compute shader
+  std::array<int, 3> get_work_group_size();
   // Destroys created program
   void destroy() { glDeleteProgram(program); }
   // Use the shader for render
@@ -44,8 +67,12 @@ public:
   // Marks the shader for recompilation
   void recompile_with_source(std::string src) {
     source = src;
+    loaded = true;
     compiled = false;
+    revision++;
   }
+  // Reloads the source from disk, returns true if it changed
+  bool reload(std::filesystem::path project_root);
   // Sets shader uniforms
   void set_uniform(const char *name, Data data);
   // Clears bound textures
@@ -53,15 +80,22 @@ public:
   // If one needs to manually set uniforms
   GLuint get_uniform_loc(const char *name) { return glGetUniformLocation(program, name); }
   bool is_compiled() { return compiled; }
-  std::string &get_source() { return source; }
+  bool is_compute() { return compute; }
+  // Loads the source on first use
+  std::string &get_source() {
+    ensure_loaded();
+    return source;
+  }
   std::filesystem::path get_path() { return path; }
+  uint64_t get_revision() { return revision; }
   char *get_log() { return log; }
 
+  // True if the source differs from the file it was last saved to or loaded from
+  bool is_dirty(std::filesystem::path project_root);
+  // Returns the write of the source file if it is dirty and marks it as saved
+  std::optional<FileWrite> save_source(std::filesystem::path project_root);
+  // Forces the next save to write the source again
+  void mark_unsaved() { saved_path.clear(); }
   toml::table save(std::filesystem::path project_root) override;
-  static std::shared_ptr<Shader> load(toml::table &tbl, std::shared_ptr<AssetManager> assets) {
-    std::string name = tbl["name"].value<std::string>().value();
-    std::string path_str = tbl["path"].value<std::string>().value(); // Relative path
-
-    return std::make_shared<Shader>(Shader(name, assets->project_root, path_str));
-  }
+  static std::shared_ptr<Shader> load(toml::table &tbl, std::shared_ptr<AssetManager> assets);
 };
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <imgui.h>
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Forward declares
+struct RenderGraph;
+class EvalContext;
+class FragmentShaderNode;
+
+// Totals of all fused evaluations so far
+struct FusionStats {
+  uint64_t fused_passes = 0; // Producer passes folded into their consumer
+  uint64_t bytes_saved = 0;  // Render target writes and reads avoided
+};
+
+// Folds chains of per-pixel FragmentShaderNodes into a single pass
+//
+// A producer is folded into its consumer if nothing else reads its output
+// and the consumer only samples it at the texel of its own fragment, i.e.
+// texture(s, gl_FragCoord.xy / u_resolution), possibly through a vec2 local
+// initialized that way, or texelFetch(s, ivec2(gl_FragCoord.xy), 0). The
+// source of the producer becomes a function of the combined shader, with its
+// globals prefixed by its position so uniforms of the members never clash.
+//
+// All FragmentShaderNodes render at the resolution of the context, so the
+// texel matches as long as the resolution uniform does, which is checked when
+// the consumer runs. Otherwise the producer runs on its own after all. Fused
+// results only differ from unfused ones by the 8-bit rounding of the
+// intermediate targets, which no longer exist.
+struct ShaderFusion {
+public:
+  // Returns the producers which may be folded into their consumer, keyed by producer
+  static std::map<int, int> plan(RenderGraph &graph, const std::vector<int> &order);
+  // Runs the consumer with its deferred producers as one pass
+  // Returns false if nothing was fused, the consumer has to run on its own then
+  static bool run(EvalContext &context, FragmentShaderNode &consumer);
+
+  static FusionStats get_stats();
+  // Evaluates the graph repeatedly without and with fusion over the next frames,
+  // the result is logged and reported in the status bar
+  static void start_benchmark(std::shared_ptr<RenderGraph> graph, ImVec2 resolution,
+                              int frames = 120);
+  // Runs a running benchmark for about the budget, called once per frame
+  static void update_benchmark(std::chrono::milliseconds budget);
+  // Progress of a running benchmark in [0, 1]
+  static std::optional<float> get_benchmark_progress();
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "data.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Forward declares
+class Geometry;
+class Shader;
+
+// Totals of the variant cache
+struct VariantStats {
+  size_t variants = 0;   // Programs in the cache
+  uint64_t compiles = 0; // Variants compiled so far
+  uint64_t hits = 0;     // Runs served by a cached variant
+};
+
+// Compiles shaders with constant uniforms baked into their source
+//
+// A declaration `uniform float u_x;` becomes `const float u_x = float(...);`,
+// which lets the driver fold the value, e.g. unroll loops bounded by it. Each
+// set of values is a variant of its own, so variants are kept in an LRU cache
+// keyed by the source and the baked values. Uniforms which can't be baked
+// (textures, mismatching types, declarations occurring more than once) stay
+// uniforms and may be set on the variant as usual.
+//
+// Must be used while holding RenderThread::lock_evaluation().
+struct ShaderVariants {
+public:
+  static constexpr size_t MAX_VARIANTS = 32;
+
+  // Returns the compiled variant of the shader with the constants baked in,
+  // nullptr if none of them could be baked or the variant failed to compile
+  static std::shared_ptr<Shader> get(const std::shared_ptr<Shader> &shader,
+                                     const std::vector<std::pair<std::string, Data>> &constants,
+                                     std::shared_ptr<Geometry> geometry);
+  // Destroys all variants, e.g. before the OpenGL context goes away
+  static void clear();
+  static VariantStats get_stats();
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "file_io.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// Entry of a pack to be written
+struct PackEntry {
+  std::string name;
+  std::vector<unsigned char> data;
+};
+
+// Single file project archive (*.srpack)
+//
+// A header and an index of named entries followed by one blob per entry,
+// each aligned to BLOB_ALIGNMENT bytes. The pack is memory mapped on open and
+// entries are read straight from the mapping.
+//
+// Entries mirror the project directory (srproject.toml, sr_imgui.ini and
+// shaders/) with textures copied into textures/. Pre-decoded texture payloads
+// are stored as cache/<key>.srtex using the keys of TextureCache.
+class ProjectPack {
+private:
+  struct Blob {
+    uint64_t offset, size;
+  };
+
+  std::filesystem::path path;
+  MappedFile file;
+  std::map<std::string, Blob> index = {};
+
+public:
+  static constexpr uint64_t BLOB_ALIGNMENT = 4096;
+
+  operator bool() const { return bool(file); }
+
+  // Maps a pack and reads its index
+  ProjectPack(const std::filesystem::path &path);
+  // Returns the data of an entry, valid as long as the pack is alive
+  std::optional<std::span<const unsigned char>> find(const std::string &name) const;
+  bool contains(const std::string &name) const { return index.contains(name); }
+  std::vector<std::string> get_entries() const;
+  std::filesystem::path get_path() const { return path; }
+  // Extracts all entries except cached payloads into a project directory
+  bool extract(const std::filesystem::path &dir) const;
+
+  // Writes a pack with write_file_atomic(), so an existing file is only replaced once complete
+  static bool write(const std::filesystem::path &path, const std::vector<PackEntry> &entries);
+  // Name of the entry holding a pre-decoded texture payload
+  static std::string cache_entry(uint64_t key);
+};
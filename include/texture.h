@@ -1,6 +1,8 @@
 #pragma once
 
 #include "assets.h"
+#include "texture_cache.h"
+#include "texture_codec.h"
 
 #include <filesystem>
 #include <glad/gl.h>
@@ -9,46 +11,95 @@
 
 #include <toml++/toml.h>
 
+// Forward declares
+class ProjectPack;
+
+// Image data loaded off the main thread, waiting to be uploaded to OpenGL
+struct PreparedTexture {
+  std::optional<CachedPayload> cached = {}; // Keeps a mapped cache entry alive
+  TexturePayload payload = {};              // Freshly processed payload, if not cached
+  TextureView view = {}; // Points into the pack, the cache entry or the payload
+};
+
 class Texture : public Asset {
 private:
-  std::filesystem::path path;
-  int width = 0, height = 0;
-  int channels = 0;
+  std::filesystem::path path; // Entry name if loaded from a pack
+  std::shared_ptr<ProjectPack> pack;
+  TextureSettings settings;
+  // Key of the processed payload in TextureCache
+  uint64_t cache_key = 0;
+  // Key of the shared OpenGL texture, also covers settings applied on upload
+  uint64_t gpu_key = 0;
+  // Source metadata, known without loading if saved in the project
+  std::optional<SourceInfo> source;
+  bool load_attempted = false;
+  // Loads started so far, results of background loads started before the latest are stale
+  uint64_t generation = 0;
+  // Possibly shared with other textures of the same content and settings
+  std::shared_ptr<GpuTexture> gpu;
+  std::shared_ptr<PreparedTexture> prepared;
 
-  bool loaded = false;
-  GLuint texture = 0;
+  // Loads the image with the current settings
+  void load_image();
+  // Hashes the source and derives the cache keys, returns false if it is missing
+  bool resolve_keys();
+  // Reads the payload from a pack or the cache, or processes the image
+  bool prepare_payload();
+  // Creates the OpenGL texture from payload data
+  void upload(const TextureView &view);
 
 public:
-  operator bool() const { return loaded; }
+  operator bool() const { return gpu != nullptr; }
 
-  Texture(std::string name, std::filesystem::path path);
-  void destroy() override {
-    if (texture != 0)
-      glDeleteTextures(1, &texture);
-  }
-  GLuint get_texture() { return texture; }
-  bool is_loaded() { return loaded; }
-  toml::table save() {
-    return toml::table{
-        {"name", name},
-        {"path", path.string()},
-    };
-  };
-
-  toml::table save(std::filesystem::path) override {
-    return toml::table{
-        {"name", name},         //
-        {"path", path.string()} //
-    };
-  };
-  static std::shared_ptr<Texture> load(toml::table &tbl, std::shared_ptr<AssetManager>) {
-    std::string name = tbl["name"].value<std::string>().value();
-    std::string path_str = tbl["path"].value<std::string>().value(); // Absolute path
-                                                                     //
-    Texture texture(name, path_str);
-    if (!texture)
-      spdlog::warn("Missing texture \"{}\" in {}", name, path_str);
-
-    return std::make_shared<Texture>(texture);
+  // Creates an unloaded texture, the image is loaded on first use
+  Texture(std::string name, std::filesystem::path path, TextureSettings settings = {},
+          std::shared_ptr<ProjectPack> pack = nullptr);
+  // Loads the image if this has not been attempted yet, returns true if loaded
+  bool ensure_loaded();
+  // True once loading was attempted, successful or not
+  bool is_load_attempted() { return load_attempted; }
+  // Loads the image without touching OpenGL, safe to call off the main thread
+  // as long as no other thread uses the texture
+  bool prepare();
+  // Creates the OpenGL texture of a prepared image, must run on the main thread
+  bool finish_load();
+  // Unloaded copy of the texture, used to reload it in the background
+  // Starts a new generation, see get_generation()
+  std::shared_ptr<Texture> make_staging_copy() {
+    generation++;
+    auto copy = std::make_shared<Texture>(*this);
+    copy->gpu.reset();
+    copy->prepared.reset();
+    copy->source.reset();
+    return copy;
   }
+  // Takes over the image loaded by a staging copy, everything else is kept
+  void adopt_image(Texture &staging);
+  // Generation of the latest load, a staging copy is stale once it differs
+  uint64_t get_generation() { return generation; }
+  void destroy() override { gpu.reset(); }
+  // Reloads the texture with new import settings
+  void reload(TextureSettings settings);
+  // Reloads the texture from disk
+  void reload() { reload(settings); }
+  // Loads the texture on first use
+  GLuint get_texture() { return ensure_loaded() ? gpu->id : 0; }
+  std::filesystem::path get_path() { return path; }
+  // True if the source image is read from a pack instead of a file
+  bool is_packed() { return pack != nullptr; }
+  uint64_t get_cache_key() { return cache_key; }
+  bool is_loaded() { return gpu != nullptr; }
+  const TextureSettings &get_settings() { return settings; }
+  // Estimated video memory used by the texture in bytes, counted once per shared texture
+  size_t get_vram_size() { return gpu ? gpu->vram_size : 0; }
+  int get_width() { return gpu ? gpu->width : 0; }
+  int get_height() { return gpu ? gpu->height : 0; }
+  int get_levels() { return gpu ? gpu->levels : 0; }
+  // Size of the source image file in bytes, if known
+  uint64_t get_source_size() { return source ? source->size : 0; }
+  bool is_compressed() { return gpu ? gpu->compressed : false; }
+  // Packed textures are extracted when saved as a directory
+  std::optional<FileWrite> save_source(std::filesystem::path project_root);
+  toml::table save(std::filesystem::path project_root) override;
+  static std::shared_ptr<Texture> load(toml::table &tbl, std::shared_ptr<AssetManager> assets);
 };
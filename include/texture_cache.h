@@ -0,0 +1,73 @@
+#pragma once
+
+#include "file_io.h"
+#include "texture_codec.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <glad/gl.h>
+#include <memory>
+#include <optional>
+#include <span>
+
+// OpenGL texture shared by every Texture with the same content and settings
+struct GpuTexture {
+  GLuint id = 0;
+  int width = 0, height = 0;
+  int levels = 0;
+  size_t vram_size = 0;
+  bool compressed = false;
+
+  GpuTexture() = default;
+  GpuTexture(const GpuTexture &) = delete;
+  GpuTexture &operator=(const GpuTexture &) = delete;
+  ~GpuTexture() {
+    if (id != 0)
+      glDeleteTextures(1, &id);
+  }
+};
+
+// Identity of a source image file
+struct SourceInfo {
+  uint64_t size = 0;
+  int64_t mtime = 0;
+  uint64_t hash = 0; // Content hash
+};
+
+// Cache entry mapped into memory, the view points into the mapping
+struct CachedPayload {
+  MappedFile file;
+  TextureView view;
+};
+
+// Content addressed cache of processed (decoded, mipped and/or compressed)
+// texture payloads
+//
+// Payloads are stored as *.srtex files in the user cache directory and keyed
+// by a hash of the source file content and its import settings, so identical
+// images share one entry across projects. GPU textures are shared in the same
+// way while at least one Texture holds them.
+struct TextureCache {
+public:
+  // Directory containing cached texture payloads
+  static std::filesystem::path directory();
+  // Hashes the content of a file, memoized by path, size and modification time
+  static std::optional<SourceInfo> hash_file(const std::filesystem::path &path);
+  // Seeds the memo of hash_file, e.g. with metadata saved in a project
+  static void remember(const std::filesystem::path &path, const SourceInfo &info);
+  // Derives a cache key from the source content hash and import settings
+  static uint64_t make_key(uint64_t content_hash, const TextureSettings &settings);
+  // Maps a cached payload into memory, if any
+  static std::optional<CachedPayload> load(uint64_t key);
+  // Reads the raw bytes of a cache entry, used to embed payloads in packs
+  static std::optional<std::vector<unsigned char>> read(uint64_t key);
+  // Parses a cache entry held in memory, the view points into the entry
+  static std::optional<TextureView> parse(std::span<const unsigned char> entry);
+  // Writes a payload to the cache, replacing any previous entry
+  static bool store(uint64_t key, const TexturePayload &payload);
+
+  // Returns the GPU texture registered for a key if it is still alive
+  static std::shared_ptr<GpuTexture> find_gpu(uint64_t key);
+  // Registers a GPU texture so later loads with the same key can share it
+  static void insert_gpu(uint64_t key, std::shared_ptr<GpuTexture> gpu);
+};
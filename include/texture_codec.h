@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+// Block compression applied to imported textures
+enum class TextureCompression {
+  None = 0, // Uncompressed RGBA8
+  BC1 = 1,  // RGB 4bpp, 1-bit alpha (S3TC DXT1)
+  BC3 = 2,  // RGBA 8bpp, interpolated alpha (S3TC DXT5)
+  BC7 = 3,  // RGBA 8bpp, high quality (BPTC)
+};
+
+inline static constexpr const char *TEXTURE_COMPRESSION_NAMES[] = {
+    "None", // None
+    "BC1",  // BC1
+    "BC3",  // BC3
+    "BC7",  // BC7
+};
+
+// Import settings of a Texture
+struct TextureSettings {
+  bool mipmaps = true;
+  float anisotropy = 1.0f; // 1.0 disables anisotropic filtering
+  TextureCompression compression = TextureCompression::None;
+
+  bool operator==(const TextureSettings &) const = default;
+};
+
+// CPU side image data ready to be uploaded to OpenGL
+// Level 0 is the full resolution image, followed by its mips (if any)
+struct TexturePayload {
+  struct Level {
+    int width = 0, height = 0;
+    size_t offset = 0, size = 0;
+  };
+
+  unsigned int format = 0; // OpenGL internal format
+  bool compressed = false;
+  std::vector<Level> levels = {};
+  std::vector<unsigned char> data = {};
+
+  int width() const { return levels.empty() ? 0 : levels[0].width; }
+  int height() const { return levels.empty() ? 0 : levels[0].height; }
+  const unsigned char *level_data(size_t level) const { return data.data() + levels[level].offset; }
+  bool empty() const { return levels.empty(); }
+};
+
+// Non-owning view of texture data, used to upload from memory mapped cache entries
+struct TextureView {
+  unsigned int format = 0;
+  bool compressed = false;
+  std::vector<TexturePayload::Level> levels = {};
+  const unsigned char *data = nullptr;
+
+  TextureView() = default;
+  TextureView(const TexturePayload &payload)
+      : format(payload.format), compressed(payload.compressed), levels(payload.levels),
+        data(payload.data.data()) {}
+  int width() const { return levels.empty() ? 0 : levels[0].width; }
+  int height() const { return levels.empty() ? 0 : levels[0].height; }
+  const unsigned char *level_data(size_t level) const { return data + levels[level].offset; }
+};
+
+// Decodes an encoded image (PNG, JPEG, ...) into RGBA8, flipped for OpenGL
+std::optional<TexturePayload> decode_image(const unsigned char *data, size_t size);
+// Appends a box filtered mip chain to an uncompressed payload
+void generate_mipmaps(TexturePayload &payload);
+// Compresses every level of an uncompressed payload, returns false if unsupported
+bool compress_payload(TexturePayload &payload, TextureCompression compression);
+// Returns the OpenGL internal format of a compression mode
+unsigned int compression_format(TextureCompression compression);
+// Returns true if the current OpenGL context can sample the compressed format
+bool is_compression_supported(TextureCompression compression);
+
+// Encodes a 4x4 RGBA8 block (row major) into a 8 byte BC1 block
+void encode_bc1_block(const uint8_t rgba[64], uint8_t out[8]);
+// Encodes a 4x4 RGBA8 block (row major) into a 16 byte BC3 block
+void encode_bc3_block(const uint8_t rgba[64], uint8_t out[16]);
+// Encodes a 4x4 RGBA8 block (row major) into a 16 byte BC7 block (mode 6)
+void encode_bc7_block(const uint8_t rgba[64], uint8_t out[16]);
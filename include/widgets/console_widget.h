@@ -30,7 +30,12 @@ public:
   void set_colored(bool col) { colored = col; }
   void render(bool *p_open) override {
     ImGui::SetNextWindowSize({400, 200}, ImGuiCond_FirstUseEver);
-    ImGui::Begin(title.c_str(), p_open);
+    bool shown = ImGui::Begin(title.c_str(), p_open);
+    set_visible(shown);
+    if (!shown) {
+      ImGui::End();
+      return;
+    }
 
     if (colored) {
       auto buf = Global::instance().get_ringbuffer_sink()->last_raw();
@@ -24,6 +24,8 @@ private:
   bool is_dirty = false;
   bool is_focused = false;
   uint64_t last_update = 0;
+  // Shader revision of the buffer text
+  uint64_t revision = 0;
 
 public:
   EditorWidget(int id, std::shared_ptr<AssetManager> assets, AssetId<Shader> shader_id);
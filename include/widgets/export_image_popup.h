@@ -1,7 +1,10 @@
 #pragma once
 
+#include "parameter_sweep.h"
 #include "widget.h"
 #include <filesystem>
+#include <set>
+#include <vector>
 
 // Forward declares
 struct RenderGraph;
@@ -20,9 +23,19 @@ private:
   int quality = 90;
 
   bool override_time = false;
+  // Names of the outputs to export, the default output if empty
+  std::set<std::string> outputs = {};
+
+  // Renders all combinations of the axes into one contact sheet instead
+  bool sweep = false;
+  std::vector<SweepAxis> axes = {};
+  int thumbnail[2] = {128, 128}; // Size of a cell
 
   float widget_width = 480;
 
+  // Settings of the axes, shown in place of the resolution
+  void render_sweep();
+
 public:
   ExportImagePopup() {}
   ExportImagePopup(std::shared_ptr<RenderGraph> graph) { this->graph = graph; }
@@ -32,8 +45,12 @@ public:
     path.replace_extension(ext);
     export_path = path.string();
   }
-  // Saves a render with specified settings
+  // Renders with specified settings and saves the images in the background
   void export_image();
+  // Renders the sweep and saves the contact sheet in the background
+  void export_sweep();
+  // Reads back an image and encodes it to the path in the background
+  void encode(unsigned int image, int width, int height, std::string path);
   virtual void onStartup() override {
     // Default image path
     auto pwd = std::filesystem::current_path();
@@ -1,11 +1,13 @@
 #pragma once
 
 #include "assets.h"
+#include "eval_context.h"
 #include "widget.h"
 #include <fmt/format.h>
 
 // Forward declares
 struct RenderGraph;
+class AsyncViewport;
 
 /// A viewport to evaluate a RenderGraph in real-time
 class ViewportWidget : public Widget {
@@ -16,8 +18,30 @@ private:
   std::string title;
   ImVec2 wsize = ImVec2(640, 480);
   double last_time = 0.0f;
+  // Viewports on the same graph keep their own clock
+  double time = 0.0;
+  // Time of the frame currently shown, only advances at the frame rate cap
+  double frame_time = 0.0;
 
   bool paused = false;
+  // Frame rate of animated graphs, 0 renders a frame every UI frame
+  float max_fps = 60.0f;
+  double next_frame = 0.0;
+  // Name of the shown output, the default output if empty
+  std::string output_name = "";
+  // Graph revision, time and output of the last frame requested from the render thread
+  uint64_t last_revision = 0;
+  double requested_time = 0.0;
+  std::string requested_output = "";
+  // Evaluation state while the graph is evaluated on this thread
+  EvalContext context;
+  // Frames rendered by the render thread, if it is running
+  std::shared_ptr<AsyncViewport> async = nullptr;
+
+  // Advances the time and decides which frame to show
+  void update_clock();
+  // Outputs to evaluate, the default output if empty
+  std::vector<std::string> get_outputs();
 
 public:
   ViewportWidget(int id, std::shared_ptr<AssetManager> assets, AssetId<RenderGraph> graph_id) {
@@ -27,18 +51,25 @@ public:
     this->graph_id = graph_id;
   }
   void render(bool *p_open) override;
+  void onUpdate() override;
+  void onShutdown() override;
+  void onVisibilityChanged(bool visible) override;
 
   toml::table save() override {
     return toml::table{
         {"type", "ViewportWidget"},
         {"widget_id", id},
         {"graph_id", graph_id},
+        {"max_fps", max_fps},
+        {"output", output_name},
     };
   }
   static std::shared_ptr<Widget> load(toml::table &tbl, std::shared_ptr<AssetManager> assets) {
     int id = tbl["widget_id"].value<int>().value();
     AssetId<RenderGraph> graph_id = tbl["graph_id"].value<int>().value();
     auto w = ViewportWidget(id, assets, graph_id);
+    w.max_fps = tbl["max_fps"].value_or(60.0f);
+    w.output_name = tbl["output"].value_or<std::string>("");
     return std::make_shared<ViewportWidget>(w);
   }
 };
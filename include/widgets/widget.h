@@ -43,15 +43,28 @@ private:
 class Widget {
 protected:
   int id = -1;
+  bool visible = false;
 
 public:
   int get_id() { return id; }
+  // True if the widget was on screen the last time it was rendered
+  bool is_visible() { return visible; }
+  // Widgets pass the result of ImGui::Begin(), the App hides inactive workspaces
+  void set_visible(bool visible) {
+    if (this->visible == visible)
+      return;
+    this->visible = visible;
+    onVisibilityChanged(visible);
+  }
   // Runs on the first frame when loaded
   virtual void onStartup() {};
   // Runs on shutdown or otherwise destroyed
   virtual void onShutdown() {};
   // Runs every frame
   virtual void onUpdate() {};
+  // Runs when the widget gets collapsed, hidden behind another tab or on another
+  // workspace and when it is shown again, hidden widgets should skip costly work
+  virtual void onVisibilityChanged(bool) {};
   // Runs every frame if visible
   // Setting p_open to false will close the widget
   virtual void render(bool *p_open) = 0;
@@ -1,7 +1,10 @@
 #include "app.h"
+#include "hash.h"
+#include "shader_fusion.h"
 
 #include <events.h>
-#include <fstream>
+#include <set>
+#include <utility>
 #include <imgui_internal.h>
 #include <toml++/toml.hpp>
 
@@ -25,28 +28,42 @@ void App::process_input() {
   }
 }
 void App::handle_events() {
-  while (auto if_event = EventQueue::pop()) {
-    auto event = if_event.value();
-    if (std::holds_alternative<AddWidget>(event)) {
-      auto ev = std::get<AddWidget>(event);
-      ev.widget->onStartup();
-      workspaces[current_workspace].second.push_back(ev.widget);
-    } else if (std::holds_alternative<DeleteWidget>(event)) {
-      auto ev = std::get<DeleteWidget>(event);
-      // Find widget
-      auto it = std::find_if(
-          workspaces[current_workspace].second.begin(), workspaces[current_workspace].second.end(),
-          [ev](std::shared_ptr<Widget> &widget) { return widget->get_id() == ev.widget_id; });
-      if (it == workspaces[current_workspace].second.end()) {
-        spdlog::warn("Trying to delete non-existant widget!");
-        continue;
-      }
-      it->get()->onShutdown();
-      workspaces[current_workspace].second.erase(it);
-    } else if (std::holds_alternative<StatusMessage>(event)) {
-      auto ev = std::get<StatusMessage>(event);
-      status_message = ev.message;
+  // Events pushed while handling a batch end up in the next one
+  std::vector<Event> batch;
+  while (EventQueue::drain(batch) > 0) {
+    for (auto &event : batch)
+      handle_event(event);
+    batch.clear();
+  }
+}
+void App::handle_event(Event &event) {
+  if (auto ev = std::get_if<AddWidget>(&event)) {
+    ev->widget->onStartup();
+    workspaces[current_workspace].second.push_back(ev->widget);
+  } else if (auto ev = std::get_if<DeleteWidget>(&event)) {
+    // Find widget
+    int widget_id = ev->widget_id;
+    auto it = std::find_if(
+        workspaces[current_workspace].second.begin(), workspaces[current_workspace].second.end(),
+        [widget_id](std::shared_ptr<Widget> &widget) { return widget->get_id() == widget_id; });
+    if (it == workspaces[current_workspace].second.end()) {
+      spdlog::warn("Trying to delete non-existant widget!");
+      return;
     }
+    it->get()->onShutdown();
+    workspaces[current_workspace].second.erase(it);
+  } else if (auto ev = std::get_if<StatusMessage>(&event)) {
+    status_message = std::move(ev->message);
+  } else if (auto ev = std::get_if<FileChanged>(&event)) {
+    assets->on_file_changed(ev->path);
+  } else if (auto ev = std::get_if<AssetLoaded>(&event)) {
+    assets->on_asset_loaded(ev->asset_id, ev->asset);
+  } else if (auto ev = std::get_if<AssetChanged>(&event)) {
+    assets->on_asset_changed(ev->asset_id);
+  } else if (auto ev = std::get_if<CompileFinished>(&event)) {
+    status_message = ev->success ? "Shader compiled" : "Shader failed to compile!";
+  } else if (auto ev = std::get_if<ExportProgress>(&event)) {
+    status_message = std::move(ev->message);
   }
 }
 void App::render_menubar() {
@@ -60,6 +77,16 @@ void App::render_menubar() {
         save_project_as();
       if (ImGui::MenuItem("Import Texture"))
         import_texture();
+
+      ImGui::Separator();
+      if (ImGui::MenuItem("Open Pack"))
+        open_pack();
+      if (ImGui::MenuItem("Export Pack"))
+        export_pack();
+      if (ImGui::MenuItem("Unpack"))
+        unpack_pack();
+      ImGui::Separator();
+
       if (ImGui::MenuItem("Export Image"))
         export_image.open_popup();
 
@@ -68,6 +95,8 @@ void App::render_menubar() {
     if (ImGui::BeginMenu("Edit")) {
       if (ImGui::MenuItem("New Shader", "Ctrl+N"))
         new_shader();
+      if (ImGui::MenuItem("Preload All Assets"))
+        assets->preload_all();
 
       ImGui::Separator();
 
@@ -118,6 +147,24 @@ void App::render_menubar() {
       ImGui::Checkbox("Show Tab Bar", &show_tab_bar);
       ImGui::Checkbox("Show Status Bar", &show_status_bar);
       ImGui::Checkbox("Show Metrics", &show_metrics);
+      ImGui::Checkbox("Show Graph Costs", &show_graph_costs);
+      ImGui::Checkbox("Render Thread", &use_render_thread);
+      ImGui::Separator();
+      if (bool idle = FramePacer::is_idle_enabled(); ImGui::Checkbox("Idle When Inactive", &idle))
+        FramePacer::set_idle_enabled(idle);
+      float max_fps = FramePacer::get_max_fps();
+      ImGui::SetNextItemWidth(120);
+      if (ImGui::DragFloat("Frame Rate Cap", &max_fps, 1.0f, 0.0f, 240.0f,
+                           max_fps > 0.0f ? "%.0f fps" : "Vsync", ImGuiSliderFlags_AlwaysClamp))
+        FramePacer::set_max_fps(max_fps);
+      if (ImGui::MenuItem("Benchmark Idle Usage"))
+        FramePacer::start_benchmark();
+      if (ImGui::MenuItem("Benchmark Job Scaling"))
+        Jobs::benchmark();
+#ifndef NDEBUG // A check of the queue itself, not something to ship
+      if (ImGui::MenuItem("Stress Test Event Queue")) // Consumed by a worker
+        Jobs::submit([] { EventQueue::stress_test(); });
+#endif
 
       ImGui::EndMenu();
     }
@@ -158,28 +205,83 @@ void App::render_statusbar() {
   if (ImGui::BeginMenuBar()) {
     ImGui::TextUnformatted(status_message.c_str());
 
-    // Calculate framerate
-    static float prev = 0.0f;
-    float curr = glfwGetTime();
-    float frame = 1 / (curr - prev);
-    prev = curr;
-
-    // Sample framerate every interval
-    constexpr static float sample_interval = 0.5f;
-    static float prev_sample_t = 0.0f;
-    static float sample_frame = 0.0f;
-    if (glfwGetTime() - prev_sample_t > sample_interval) {
-      sample_frame = frame;
-      prev_sample_t = glfwGetTime();
+    if (loader.is_busy()) {
+      ImGui::ProgressBar(loader.get_progress(), ImVec2(120, 0));
+      if (ImGui::SmallButton("Cancel")) {
+        loader.cancel();
+        EventQueue::push(StatusMessage("Opening project cancelled"));
+      }
     }
 
-    ImGui::Indent(width - ImGui::CalcTextSize("FPS: 00.00 ").x);
-    ImGui::Text("FPS: %.1f", sample_frame);
+    if (auto progress = FramePacer::get_benchmark_progress())
+      ImGui::ProgressBar(progress.value(), ImVec2(120, 0), "Benchmark");
+    if (auto progress = ShaderFusion::get_benchmark_progress())
+      ImGui::ProgressBar(progress.value(), ImVec2(120, 0), "Fusion Benchmark");
+    if (auto progress = Blur::get_benchmark_progress())
+      ImGui::ProgressBar(progress.value(), ImVec2(120, 0), "Blur Benchmark");
+
+    // Frames are only rendered on demand, so this is not the display refresh rate
+    FrameStats stats = FramePacer::get_stats();
+    ImGui::Indent(width - ImGui::CalcTextSize("FPS: 000.0 CPU: 000% ").x);
+    ImGui::Text("FPS: %.1f CPU: %.0f%%", stats.fps, stats.cpu * 100);
 
     ImGui::EndMenuBar();
   }
   ImGui::End();
 }
+void App::render_graph_costs() {
+  ImGui::SetNextWindowSize({360, 240}, ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin("Graph Costs", &show_graph_costs)) {
+    ImGui::End();
+    return;
+  }
+
+  BatchStats stats = GraphScheduler::get_stats();
+  ImGui::Text("Graphs: %d Passes: %d (%d deduplicated)", stats.graphs, stats.passes,
+              stats.deduped);
+  ImGui::Text("Program binds: %d (%d unbatched)", stats.binds, stats.unbatched_binds);
+  ImGui::Text("Idle render targets: %zu", stats.idle_targets);
+  FusionStats fusion = ShaderFusion::get_stats();
+  ImGui::Text("Fused passes: %llu (%.1f MB of traffic saved)",
+              (unsigned long long)fusion.fused_passes, fusion.bytes_saved / 1e6);
+  VariantStats variants = ShaderVariants::get_stats();
+  ImGui::Text("Shader variants: %zu (%llu compiled, %llu hits)", variants.variants,
+              (unsigned long long)variants.compiles, (unsigned long long)variants.hits);
+  ImGui::Separator();
+
+  if (ImGui::BeginTable("Costs", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+    ImGui::TableSetupColumn("Graph");
+    ImGui::TableSetupColumn("Contexts");
+    ImGui::TableSetupColumn("Runs");
+    ImGui::TableSetupColumn("Reused");
+    ImGui::TableSetupColumn("Dedup");
+    ImGui::TableSetupColumn("CPU (ms)");
+    ImGui::TableHeadersRow();
+    for (auto &[id, graph] : *assets->getRenderGraphCollection()) {
+      auto cost = GraphScheduler::get_cost(graph.get());
+      if (!cost)
+        continue;
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      if (graph->get_name().empty())
+        ImGui::Text("Graph %u", id);
+      else
+        ImGui::TextUnformatted(graph->get_name().c_str());
+      ImGui::TableNextColumn();
+      ImGui::Text("%d", cost->contexts);
+      ImGui::TableNextColumn();
+      ImGui::Text("%d", cost->runs);
+      ImGui::TableNextColumn();
+      ImGui::Text("%d", cost->reused);
+      ImGui::TableNextColumn();
+      ImGui::Text("%d", cost->deduped);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", cost->cpu * 1000.0f);
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
 void App::new_shader() {
   auto shader_id = assets->insertShader(std::make_shared<Shader>(Shader("NewShader")));
   EventQueue::push(AddWidget(
@@ -194,10 +296,11 @@ void App::import_texture() {
   std::filesystem::path path(res[0]);
 
   Texture texture(path.filename().string(), path);
-  if (!texture)
+  if (!texture.ensure_loaded())
     spdlog::error("Failed to load texture: {}", path.string());
 
   assets->insertTexture(std::make_shared<Texture>(texture));
+  watcher.watch(path);
 }
 void App::render_dockspace() {
   // Create a window just below the menu to host the docking space
@@ -260,7 +363,8 @@ public:
     app->assets = this->assets;
     app->workspaces = this->workspaces;
   }
-  bool load_toml(toml::table &tbl, std::filesystem::path project_root) {
+  // Loads everything except the assets, which are loaded by ProjectLoader
+  bool load_toml(toml::table &tbl) {
     try {
       // Load Settings
       show_tab_bar = tbl["Settings"]["show_tab_bar"].value_or<bool>(true);
@@ -268,11 +372,6 @@ public:
       current_workspace = tbl["Settings"]["current_workspace"].value<int>().value();
       graph_id = tbl["Settings"]["graph_id"].value<int>().value();
 
-      // Load Assets
-      if (!tbl["Assets"].is_table())
-        throw std::bad_optional_access();
-      assets->load(*tbl["Assets"].as_table(), project_root);
-
       // Load Workspaces
       if (!tbl["Workspaces"].is_array_of_tables())
         throw std::bad_optional_access();
@@ -337,19 +436,42 @@ private:
 };
 
 void App::save_project(std::filesystem::path proj_dir) {
-  std::ofstream ofs(proj_dir / "srproject.toml");
-  if (!ofs) {
-    spdlog::error("Failed to save project file in {}", proj_dir.string());
+  if (saver.is_busy()) {
+    // Snapshotted once the running save finished, so the newest edits make it to disk
+    pending_save = proj_dir;
+    EventQueue::push(StatusMessage("Saving project after the current save..."));
     return;
   }
 
+  // Snapshot the project, serialization and writes happen on the saver thread
   AppData data;
   data.from_app(this);
-  ofs << data.save_toml(proj_dir);
-
-  ImGui::SaveIniSettingsToDisk((proj_dir / "sr_imgui.ini").string().c_str());
-
-  spdlog::info("Project saved in {}", proj_dir.string());
+  ProjectSnapshot snapshot;
+  snapshot.root = proj_dir;
+  snapshot.project = data.save_toml(proj_dir);
+  snapshot.files = assets->save_files(proj_dir);
+
+  size_t ini_size = 0;
+  const char *ini = ImGui::SaveIniSettingsToMemory(&ini_size);
+  snapshot.files.push_back(
+      {proj_dir / "sr_imgui.ini", std::vector<unsigned char>(ini, ini + ini_size)});
+
+  saver.save(std::move(snapshot));
+  EventQueue::push(StatusMessage("Saving project..."));
+}
+void App::finish_save(bool success) {
+  if (!success) {
+    assets->mark_unsaved(); // Unknown which files made it to disk
+    spdlog::error("Failed to save project in {}", project_root.value_or("").string());
+    EventQueue::push(StatusMessage("Failed to save project!"));
+  } else {
+    watch_assets(); // New shaders exist on disk now
+    spdlog::info("Project saved in {}", project_root.value_or("").string());
+    EventQueue::push(StatusMessage("Project saved"));
+  }
+  // Requested while this save was running, written from the current state
+  if (auto path = std::exchange(pending_save, std::nullopt))
+    save_project(path.value());
 }
 void App::open_project() {
   if (is_project_dirty) {
@@ -359,52 +481,152 @@ void App::open_project() {
   auto dir_str = pfd::select_folder("Select an existing project directory").result();
   if (dir_str.empty()) // User cancel
     return;
+  open_project(dir_str);
+}
+void App::open_project(std::filesystem::path path) {
+  if (!loader.open(path)) {
+    spdlog::warn("Another project is still being opened!");
+    return;
+  }
+  EventQueue::push(StatusMessage("Opening project..."));
+}
+void App::apply_project(LoadedProject &project) {
+  AppData data;
+  data.assets = project.assets;
+  if (!data.load_toml(project.project)) {
+    spdlog::error("Invalid project file!");
+    EventQueue::push(StatusMessage("Failed to open project!"));
+    return;
+  }
+  // Apply changes
+  shutdown();
+  data.to_app(this);
+
+  if (project.imgui_ini) {
+    ImGui::ClearIniSettings();
+    ImGui::LoadIniSettingsFromMemory(project.imgui_ini->c_str(), project.imgui_ini->size());
+  }
 
-  std::ifstream file(std::filesystem::path(dir_str) / "srproject.toml");
-  if (!file) {
-    spdlog::error("Unknown project directory format!");
+  startup();
+  if (project.pack)
+    project_root.reset(); // Saving asks for a directory to unpack into
+  else
+    project_root = project.root;
+
+  spdlog::info("Project loaded {}", project.path.string());
+  EventQueue::push(StatusMessage("Project loaded"));
+}
+void App::open_pack() {
+  auto res = pfd::open_file("Select a project pack", "", {"ShaderRinth Pack", "*.srpack"}).result();
+  if (res.empty() || res[0].empty())
+    return;
+  open_project(res[0]);
+}
+void App::export_pack() {
+  // Every texture should have a processed payload to embed
+  assets->preload_all();
+  save_project();
+  if (!project_root)
     return;
+  // The pack is built from the files on disk, including those of a pending save
+  while (auto success = saver.wait()) {
+    finish_save(success.value());
+    if (!success.value())
+      return;
   }
+  std::filesystem::path root = project_root.value();
+
+  auto res = pfd::save_file("Export project pack", (root / "project.srpack").string(),
+                            {"ShaderRinth Pack", "*.srpack"})
+                 .result();
+  if (res.empty())
+    return;
+  std::filesystem::path pack_path(res);
 
-  // Parse project file
   toml::table tbl;
   try {
-    tbl = toml::parse(file);
+    tbl = toml::parse_file((root / "srproject.toml").string());
   } catch (const toml::parse_error &error) {
     spdlog::error("Failed to parse project file:\n{}", error.what());
     return;
   }
 
-  // Load project
-  project_root = dir_str;
-  AppData data;
-  if (!data.load_toml(tbl, project_root.value())) {
-    spdlog::error("Invalid project file!");
-    return;
+  std::vector<PackEntry> entries;
+  auto add_file = [&](std::string name, std::filesystem::path path) {
+    if (auto data = read_file(path)) {
+      entries.push_back({name, std::move(data.value())});
+      return true;
+    }
+    spdlog::error("Failed to pack {}", path.string());
+    return false;
+  };
+
+  if (auto shaders = tbl["Assets"]["Shaders"].as_array()) {
+    for (auto &node : *shaders) {
+      std::string path = (*node.as_table())["path"].value_or<std::string>("");
+      add_file(std::filesystem::path(path).generic_string(), root / path);
+    }
   }
-  // Apply changes
-  shutdown();
-  data.to_app(this);
 
-  // Load ImGui settings
-  auto imgui_filepath = project_root.value() / "sr_imgui.ini";
-  if (std::filesystem::exists(imgui_filepath)) {
-    std::ifstream imgui_file(imgui_filepath);
+  // Textures are copied into the pack together with their processed payloads
+  std::set<uint64_t> payloads;
+  if (auto textures = tbl["Assets"]["Textures"].as_array()) {
+    for (auto &node : *textures) {
+      toml::table &t = *node.as_table();
+      AssetId<Texture> asset_id = t["asset_id"].value_or<int>(0);
+      std::filesystem::path path = root / t["path"].value_or<std::string>("");
 
-    if (!imgui_file) {
-      spdlog::error("Failed to load ImGui layout!");
-      return;
+      std::string name = fmt::format("textures/{}_{}", asset_id, path.filename().string());
+      if (!add_file(name, path))
+        continue;
+      t.insert_or_assign("path", name);
+      // Metadata of the packed copy, so opening the pack doesn't need to hash it
+      auto &data = entries.back().data;
+      t.insert_or_assign("size", int64_t(data.size()));
+      t.insert_or_assign("hash", Hash::to_hex(Hash().add(data.data(), data.size()).get()));
+      t.erase("mtime");
+
+      auto texture = assets->getTexture(asset_id);
+      if (!texture || !texture.value()->is_loaded())
+        continue;
+      uint64_t key = texture.value()->get_cache_key();
+      if (!payloads.insert(key).second)
+        continue;
+      if (auto data = TextureCache::read(key))
+        entries.push_back({ProjectPack::cache_entry(key), std::move(data.value())});
     }
+  }
 
-    std::ostringstream buf;
-    buf << imgui_file.rdbuf();
-    std::string str = buf.str();
+  if (std::filesystem::exists(root / "sr_imgui.ini"))
+    add_file("sr_imgui.ini", root / "sr_imgui.ini");
 
-    ImGui::ClearIniSettings();
-    ImGui::LoadIniSettingsFromMemory(str.c_str(), str.size());
-  }
+  std::ostringstream project_file;
+  project_file << tbl;
+  std::string str = project_file.str();
+  entries.push_back({"srproject.toml", std::vector<unsigned char>(str.begin(), str.end())});
 
-  startup();
+  if (!ProjectPack::write(pack_path, entries)) {
+    spdlog::error("Failed to write pack {}", pack_path.string());
+    return;
+  }
+  spdlog::info("Project packed into {}", pack_path.string());
+}
+void App::unpack_pack() {
+  auto res = pfd::open_file("Select a project pack", "", {"ShaderRinth Pack", "*.srpack"}).result();
+  if (res.empty() || res[0].empty())
+    return;
+  ProjectPack pack(res[0]);
+  if (!pack) {
+    spdlog::error("Invalid project pack {}", res[0]);
+    return;
+  }
 
-  spdlog::info("Project loaded {}", project_root.value().string());
+  auto dir = pfd::select_folder("Select a directory to unpack into").result();
+  if (dir.empty())
+    return;
+  if (!pack.extract(dir)) {
+    spdlog::error("Failed to unpack {}", res[0]);
+    return;
+  }
+  open_project(dir);
 }
@@ -1,11 +1,16 @@
 #include "assets.h"
 
+#include "events.h"
+#include "file_watcher.h"
 #include "geometry.h"
 #include "graph.h"
+#include "jobs.h"
+#include "render_thread.h"
 #include "shader.h"
 #include "texture.h"
 
 void AssetManager::destroy() {
+  auto lock = RenderThread::lock_evaluation();
   for (auto &pair : *mTexture) {
     pair.second->destroy();
   }
@@ -23,6 +28,94 @@ void AssetManager::destroy() {
   mTexture.reset();
   mRenderGraph.reset();
 }
+void AssetManager::preload_all() {
+  for (auto &pair : *mShader)
+    pair.second->ensure_loaded();
+  for (auto &pair : *mTexture)
+    pair.second->ensure_loaded();
+}
+std::vector<std::filesystem::path> AssetManager::get_watched_files() {
+  std::vector<std::filesystem::path> files;
+  if (!project_root.empty() && !pack) { // Unsaved shaders have no file yet
+    for (auto &pair : *mShader)
+      files.push_back(project_root / pair.second->get_path());
+  }
+  for (auto &pair : *mTexture) {
+    if (!pair.second->is_packed())
+      files.push_back(pair.second->get_path());
+  }
+  return files;
+}
+void AssetManager::on_file_changed(const std::filesystem::path &path) {
+  std::vector<AssetId<Asset>> changed;
+  auto lock = RenderThread::lock_evaluation(); // Sources are replaced in place
+  if (!project_root.empty() && !pack) {
+    for (auto &pair : *mShader) {
+      if (FileWatcher::normalize(project_root / pair.second->get_path()) != path)
+        continue;
+      if (pair.second->reload(project_root))
+        changed.push_back(pair.first);
+    }
+  }
+  for (auto &pair : *mTexture) {
+    if (pair.second->is_packed() || FileWatcher::normalize(pair.second->get_path()) != path)
+      continue;
+    if (!pair.second->is_load_attempted()) // Read on first use anyway
+      continue;
+    // Decoded by a job, the old image stays in use until the new one is ready
+    AssetId<Asset> asset_id = pair.first;
+    auto staging = pair.second->make_staging_copy();
+    Jobs::submit([asset_id, staging] {
+      staging->prepare();
+      EventQueue::push(AssetLoaded(asset_id, staging));
+    });
+  }
+
+  for (auto id : changed)
+    on_asset_changed(id);
+}
+void AssetManager::on_asset_loaded(AssetId<Asset> asset_id, std::shared_ptr<Asset> asset) {
+  if (auto staging = std::dynamic_pointer_cast<Texture>(asset)) {
+    auto it = mTexture->find(asset_id);
+    if (it == mTexture->end()) // Deleted in the meantime
+      return;
+    if (staging->get_generation() != it->second->get_generation()) // Reloaded again since
+      return;
+    if (!staging->finish_load()) {
+      spdlog::error("Failed to reload texture \"{}\" in {}", staging->get_name(),
+                    staging->get_path().string());
+      return;
+    }
+    // Updated in place, nodes hold on to the texture itself
+    // Edits made while loading are kept, e.g. a rename
+    auto lock = RenderThread::lock_evaluation();
+    it->second->adopt_image(*staging);
+    spdlog::info("Reloaded texture \"{}\"", it->second->get_name());
+  }
+
+  on_asset_changed(asset_id);
+}
+void AssetManager::on_asset_changed(AssetId<Asset> asset_id) {
+  // Only graphs containing dependent nodes are invalidated
+  for (auto &pair : *mRenderGraph)
+    pair.second->on_asset_changed(asset_id);
+}
+std::vector<FileWrite> AssetManager::save_files(std::filesystem::path project_root) {
+  std::vector<FileWrite> writes;
+  for (auto &pair : *mShader) {
+    if (auto write = pair.second->save_source(project_root))
+      writes.push_back(std::move(write.value()));
+  }
+  for (auto &pair : *mTexture) {
+    if (auto write = pair.second->save_source(project_root))
+      writes.push_back(std::move(write.value()));
+  }
+  return writes;
+}
+void AssetManager::mark_unsaved() {
+  for (auto &pair : *mShader)
+    pair.second->mark_unsaved();
+}
 toml::table AssetManager::save(std::filesystem::path project_root) {
   this->project_root = project_root;
 
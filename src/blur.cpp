@@ -0,0 +1,405 @@
+#include "blur.h"
+
+#include "events.h"
+#include "frame_pacer.h"
+#include "geometry.h"
+#include "graph.h"
+#include "render_target.h"
+#include "render_thread.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Every program samples u_input at the texel centers of the target
+// Halving the size this way averages 2x2 texels with a single fetch
+constexpr char COPY_SRC[] = R"(
+out vec4 fragColor;
+uniform sampler2D u_input;
+uniform vec2 u_resolution;
+
+void main() { fragColor = texture(u_input, gl_FragCoord.xy / u_resolution); }
+)";
+constexpr char GAUSSIAN_SRC[] = R"(
+out vec4 fragColor;
+uniform sampler2D u_input;
+uniform vec2 u_resolution;
+uniform vec2 u_direction; // One texel along the axis
+uniform int u_taps;
+uniform float u_offsets[MAX_TAPS];
+uniform float u_weights[MAX_TAPS];
+
+void main() {
+  vec2 uv = gl_FragCoord.xy / u_resolution;
+  vec4 sum = texture(u_input, uv) * u_weights[0];
+  for (int i = 1; i < u_taps; i++) {
+    vec2 offset = u_direction * u_offsets[i];
+    sum += (texture(u_input, uv + offset) + texture(u_input, uv - offset)) * u_weights[i];
+  }
+  fragColor = sum;
+}
+)";
+constexpr char KAWASE_DOWN_SRC[] = R"(
+out vec4 fragColor;
+uniform sampler2D u_input;
+uniform vec2 u_resolution;
+uniform vec2 u_offset;
+
+void main() {
+  vec2 uv = gl_FragCoord.xy / u_resolution;
+  vec2 o = u_offset;
+  vec4 sum = texture(u_input, uv) * 4.0;
+  sum += texture(u_input, uv + vec2(-o.x, -o.y));
+  sum += texture(u_input, uv + vec2(o.x, -o.y));
+  sum += texture(u_input, uv + vec2(-o.x, o.y));
+  sum += texture(u_input, uv + vec2(o.x, o.y));
+  fragColor = sum / 8.0;
+}
+)";
+constexpr char KAWASE_UP_SRC[] = R"(
+out vec4 fragColor;
+uniform sampler2D u_input;
+uniform vec2 u_resolution;
+uniform vec2 u_offset;
+
+void main() {
+  vec2 uv = gl_FragCoord.xy / u_resolution;
+  vec2 o = u_offset;
+  vec4 sum = texture(u_input, uv + vec2(-o.x * 2.0, 0.0));
+  sum += texture(u_input, uv + vec2(o.x * 2.0, 0.0));
+  sum += texture(u_input, uv + vec2(0.0, -o.y * 2.0));
+  sum += texture(u_input, uv + vec2(0.0, o.y * 2.0));
+  sum += texture(u_input, uv + vec2(-o.x, -o.y)) * 2.0;
+  sum += texture(u_input, uv + vec2(o.x, -o.y)) * 2.0;
+  sum += texture(u_input, uv + vec2(-o.x, o.y)) * 2.0;
+  sum += texture(u_input, uv + vec2(o.x, o.y)) * 2.0;
+  fragColor = sum / 12.0;
+}
+)";
+// One fetch per texel as blur shaders are usually written, only used by the benchmark
+constexpr char REFERENCE_SRC[] = R"(
+out vec4 fragColor;
+uniform sampler2D u_input;
+uniform vec2 u_resolution;
+uniform vec2 u_direction;
+uniform int u_radius;
+uniform float u_sigma;
+
+void main() {
+  vec2 uv = gl_FragCoord.xy / u_resolution;
+  vec4 sum = vec4(0.0);
+  float total = 0.0;
+  for (int i = -u_radius; i <= u_radius; i++) {
+    float weight = exp(-float(i * i) / (2.0 * u_sigma * u_sigma));
+    sum += texture(u_input, uv + u_direction * float(i)) * weight;
+    total += weight;
+  }
+  fragColor = sum / total;
+}
+)";
+
+enum Program { COPY, GAUSSIAN, KAWASE_DOWN, KAWASE_UP, REFERENCE, PROGRAM_COUNT };
+constexpr const char *SOURCES[] = {COPY_SRC, GAUSSIAN_SRC, KAWASE_DOWN_SRC, KAWASE_UP_SRC,
+                                   REFERENCE_SRC};
+constexpr const char *NAMES[] = {"Copy", "Gaussian", "KawaseDown", "KawaseUp", "Reference"};
+
+// Taps of a Gaussian pass, the center and a merged pair per two texels
+constexpr int MAX_TAPS = Blur::MAX_RADIUS / 2 + 1;
+
+std::shared_ptr<Shader> programs[PROGRAM_COUNT];
+GLuint sampler = 0; // Clamps to the edge whatever the input is set up with
+
+// Compiled on first use, nullptr if it failed to compile
+Shader *get_program(Program program, const std::shared_ptr<Geometry> &geometry) {
+  auto &shader = programs[program];
+  if (!shader) {
+    auto source = fmt::format("#version 330 core\n#define MAX_TAPS {}\n{}", MAX_TAPS,
+                              SOURCES[program]);
+    shader = std::make_shared<Shader>(NAMES[program], source);
+    if (!shader->compile(geometry))
+      spdlog::error("Failed to compile the {} blur program:\n{}", NAMES[program],
+                    shader->get_log());
+  }
+  if (sampler == 0) {
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  return shader->is_compiled() ? shader.get() : nullptr;
+}
+// Renders the program from the input into the target, uniforms besides the
+// input and the resolution are set by the callback
+bool pass(Shader &shader, Geometry &geometry, GLuint input, RenderTarget &target,
+          const std::function<void(Shader &)> &uniforms = {}) {
+  if (!target.begin())
+    return false;
+  shader.use();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, input);
+  glBindSampler(0, sampler);
+  glUniform1i(shader.get_uniform_loc("u_input"), 0);
+  glUniform2f(shader.get_uniform_loc("u_resolution"), float(target.get_width()),
+              float(target.get_height()));
+  if (uniforms)
+    uniforms(shader);
+  geometry.draw_geometry();
+  glBindSampler(0, 0);
+  target.end();
+  return true;
+}
+// Two passes taking one fetch per texel of the radius
+RenderTarget *reference(const Blur::Targets &targets, const std::shared_ptr<Geometry> &geometry,
+                        GLuint input, int width, int height, float radius) {
+  auto shader = get_program(REFERENCE, geometry);
+  if (!shader)
+    return nullptr;
+  auto uniforms = [&](float x, float y) {
+    return [=](Shader &program) {
+      glUniform2f(program.get_uniform_loc("u_direction"), x, y);
+      glUniform1i(program.get_uniform_loc("u_radius"), int(std::ceil(radius)));
+      glUniform1f(program.get_uniform_loc("u_sigma"), std::max(radius / 3.0f, 0.01f));
+    };
+  };
+  auto &horizontal = targets(1, width, height);
+  auto &result = targets(0, width, height);
+  if (!pass(*shader, *geometry, input, horizontal, uniforms(1.0f / width, 0.0f)) ||
+      !pass(*shader, *geometry, horizontal.get_texture(), result, uniforms(0.0f, 1.0f / height)))
+    return nullptr;
+  return &result;
+}
+
+using Blurring = RenderTarget *(*)(const Blur::Targets &, const std::shared_ptr<Geometry> &,
+                                   GLuint, int, int, float);
+constexpr float BENCHMARK_RADII[] = {4.0f, 16.0f, 64.0f, 256.0f};
+constexpr int BENCHMARK_RUNS = 3 * std::size(BENCHMARK_RADII); // Every blur at every radius
+
+// State of a running benchmark, see Blur::start_benchmark()
+struct Benchmark {
+  std::weak_ptr<RenderGraph> graph;
+  int width = 0, height = 0;
+  int frames = 0; // Per run
+  int done = 0;   // Frames of all runs so far, runs of a radius come in turn
+  double seconds[BENCHMARK_RUNS] = {};
+  std::unique_ptr<RenderTarget> input;
+  std::vector<std::unique_ptr<RenderTarget>> pool;
+
+  ~Benchmark() {
+    for (auto &target : pool)
+      RenderTargetPool::release(std::move(target));
+    RenderTargetPool::release(std::move(input));
+  }
+};
+std::unique_ptr<Benchmark> benchmark;
+
+} // namespace
+
+RenderTarget *Blur::copy(const Targets &targets, const std::shared_ptr<Geometry> &geometry,
+                         GLuint input, int width, int height) {
+  auto shader = get_program(COPY, geometry);
+  auto &result = targets(0, width, height);
+  if (!shader || !pass(*shader, *geometry, input, result))
+    return nullptr;
+  return &result;
+}
+RenderTarget *Blur::gaussian(const Targets &targets, const std::shared_ptr<Geometry> &geometry,
+                             GLuint input, int width, int height, float radius) {
+  auto downsample = get_program(COPY, geometry), blur = get_program(GAUSSIAN, geometry);
+  if (!downsample || !blur)
+    return nullptr;
+
+  // Halved until the radius fits, each level averages 2x2 texels of the last
+  radius = std::max(radius, 0.0f);
+  int levels = 0;
+  while (radius / float(1 << levels) > MAX_RADIUS && levels < MAX_LEVELS)
+    levels++;
+  size_t index = 1;
+  GLuint source = input;
+  int w = width, h = height;
+  for (int level = 0; level < levels; level++) {
+    w = std::max(w / 2, 1);
+    h = std::max(h / 2, 1);
+    auto &target = targets(index++, w, h);
+    if (!pass(*downsample, *geometry, source, target))
+      return nullptr;
+    source = target.get_texture();
+  }
+
+  // Texels i and i + 1 are read by one fetch in between, weighted by their sum
+  float level_radius = radius / float(1 << levels);
+  int texels = std::min(int(std::ceil(level_radius)), MAX_RADIUS);
+  float sigma = std::max(level_radius / 3.0f, 0.01f);
+  std::vector<float> g(texels + 2, 0.0f);
+  float total = 0.0f;
+  for (int i = 0; i <= texels; i++) {
+    g[i] = std::exp(-float(i * i) / (2.0f * sigma * sigma));
+    total += i == 0 ? g[i] : 2.0f * g[i];
+  }
+  std::vector<float> offsets = {0.0f}, weights = {g[0] / total};
+  for (int i = 1; i <= texels; i += 2) {
+    float weight = g[i] + g[i + 1];
+    offsets.push_back((float(i) * g[i] + float(i + 1) * g[i + 1]) / weight);
+    weights.push_back(weight / total);
+  }
+  auto uniforms = [&](float x, float y) {
+    return [=, &offsets, &weights](Shader &shader) {
+      glUniform2f(shader.get_uniform_loc("u_direction"), x, y);
+      glUniform1i(shader.get_uniform_loc("u_taps"), int(offsets.size()));
+      glUniform1fv(shader.get_uniform_loc("u_offsets"), GLsizei(offsets.size()), offsets.data());
+      glUniform1fv(shader.get_uniform_loc("u_weights"), GLsizei(weights.size()), weights.data());
+    };
+  };
+
+  auto &horizontal = targets(index++, w, h);
+  auto &vertical = levels == 0 ? targets(0, width, height) : targets(index++, w, h);
+  if (!pass(*blur, *geometry, source, horizontal, uniforms(1.0f / w, 0.0f)) ||
+      !pass(*blur, *geometry, horizontal.get_texture(), vertical, uniforms(0.0f, 1.0f / h)))
+    return nullptr;
+  if (levels == 0)
+    return &vertical;
+
+  // Bilinear upscaling is smooth enough after blurring by more than a texel
+  auto &result = targets(0, width, height);
+  if (!pass(*downsample, *geometry, vertical.get_texture(), result))
+    return nullptr;
+  return &result;
+}
+RenderTarget *Blur::kawase(const Targets &targets, const std::shared_ptr<Geometry> &geometry,
+                           GLuint input, int width, int height, float radius) {
+  auto down = get_program(KAWASE_DOWN, geometry), up = get_program(KAWASE_UP, geometry);
+  if (!down || !up)
+    return nullptr;
+
+  // Each level doubles the radius, the offset spreads the taps for the remainder
+  int levels = std::clamp(int(std::log2(std::max(radius, 2.0f))), 1, MAX_LEVELS);
+  float offset = std::max(radius / float(1 << levels), 0.5f);
+  std::vector<std::pair<int, int>> sizes = {{width, height}};
+  for (int level = 1; level <= levels; level++) {
+    auto [w, h] = sizes.back();
+    sizes.emplace_back(std::max(w / 2, 1), std::max(h / 2, 1));
+  }
+  auto uniforms = [](float x, float y) {
+    return [=](Shader &shader) { glUniform2f(shader.get_uniform_loc("u_offset"), x, y); };
+  };
+
+  GLuint source = input;
+  for (int level = 1; level <= levels; level++) {
+    auto [w, h] = sizes[level];
+    auto [above_w, above_h] = sizes[level - 1];
+    auto &target = targets(level, w, h);
+    if (!pass(*down, *geometry, source, target, uniforms(offset / above_w, offset / above_h)))
+      return nullptr;
+    source = target.get_texture();
+  }
+  RenderTarget *result = nullptr;
+  for (int level = levels - 1; level >= 0; level--) {
+    auto [w, h] = sizes[level];
+    auto [below_w, below_h] = sizes[level + 1];
+    auto &target = targets(level == 0 ? 0 : 2 * levels - level, w, h);
+    float x = 0.5f * offset / below_w, y = 0.5f * offset / below_h;
+    if (!pass(*up, *geometry, source, target, uniforms(x, y)))
+      return nullptr;
+    source = target.get_texture();
+    result = &target;
+  }
+  return result;
+}
+void Blur::clear() {
+  for (auto &shader : programs) {
+    if (shader && shader->is_compiled())
+      shader->destroy();
+    shader.reset();
+  }
+  if (sampler != 0)
+    glDeleteSamplers(1, &sampler);
+  sampler = 0;
+  benchmark.reset();
+}
+void Blur::start_benchmark(std::shared_ptr<RenderGraph> graph, ImVec2 resolution, int frames) {
+  if (benchmark)
+    return;
+  benchmark = std::make_unique<Benchmark>();
+  benchmark->graph = graph;
+  benchmark->width = int(resolution.x), benchmark->height = int(resolution.y);
+  benchmark->frames = std::max(frames, 1);
+  benchmark->input = RenderTargetPool::acquire(benchmark->width, benchmark->height);
+  if (benchmark->input->begin()) // Contents don't matter for the fetch count
+    benchmark->input->end();
+  FramePacer::request_redraw();
+  spdlog::info("Blur benchmark started at {}x{}", benchmark->width, benchmark->height);
+}
+void Blur::update_benchmark(std::chrono::milliseconds budget) {
+  if (!benchmark)
+    return;
+  auto lock = RenderThread::lock_evaluation(); // The programs are shared with the render thread
+  auto graph = benchmark->graph.lock();
+  if (!graph) { // Closed in the meantime
+    benchmark.reset();
+    return;
+  }
+
+  auto &pool = benchmark->pool;
+  Targets targets = [&](size_t index, int w, int h) -> RenderTarget & {
+    if (pool.size() <= index)
+      pool.resize(index + 1);
+    auto &target = pool[index];
+    if (target && (target->get_width() != w || target->get_height() != h))
+      RenderTargetPool::release(std::move(target));
+    if (!target)
+      target = RenderTargetPool::acquire(w, h);
+    return *target;
+  };
+  constexpr Blurring BLURS[] = {reference, Blur::gaussian, Blur::kawase};
+
+  // Every frame is timed on its own, finishing the GPU makes it cover its GPU time
+  // At least one frame runs, the largest reference radius takes longer than the budget
+  int frames = benchmark->frames, width = benchmark->width, height = benchmark->height;
+  auto start = std::chrono::steady_clock::now();
+  glFinish();
+  while (benchmark->done < BENCHMARK_RUNS * frames) {
+    int run = benchmark->done / frames;
+    float radius = BENCHMARK_RADII[run / 3];
+    auto frame_start = std::chrono::steady_clock::now();
+    BLURS[run % 3](targets, graph->graph_geometry, benchmark->input->get_texture(), width,
+                   height, radius);
+    glFinish();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - frame_start;
+    benchmark->seconds[run] += elapsed.count();
+    benchmark->done++;
+    if (std::chrono::steady_clock::now() - start >= budget)
+      break;
+  }
+  if (benchmark->done < BENCHMARK_RUNS * frames) {
+    FramePacer::request_redraw();
+    return;
+  }
+
+  std::string summary;
+  for (size_t i = 0; i < std::size(BENCHMARK_RADII); i++) {
+    double *ms = benchmark->seconds + 3 * i;
+    for (int blur = 0; blur < 3; blur++)
+      ms[blur] *= 1000.0 / frames;
+    float radius = BENCHMARK_RADII[i];
+    spdlog::info("Blur benchmark at {}x{} with radius {}: one fetch per texel {:.3f} ms, "
+                 "Gaussian {:.3f} ms, dual-Kawase {:.3f} ms per frame",
+                 width, height, radius, ms[0], ms[1], ms[2]);
+    summary += fmt::format(" r{}: {:.2f}/{:.2f}/{:.2f}", radius, ms[0], ms[1], ms[2]);
+  }
+  benchmark.reset();
+
+  EventQueue::push(
+      StatusMessage(fmt::format("Blur ms per frame (per texel/Gaussian/Kawase):{}", summary)));
+}
+std::optional<float> Blur::get_benchmark_progress() {
+  if (!benchmark)
+    return {};
+  return float(benchmark->done) / float(BENCHMARK_RUNS * benchmark->frames);
+}
@@ -0,0 +1,300 @@
+#include "compute.h"
+
+#include "data.h"
+#include "render_target.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <memory>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+// Combines the pixels of u_input, or the u_count values of the previous dispatch
+constexpr char REDUCE_SRC[] = R"(
+layout(local_size_x = 256) in;
+
+uniform sampler2D u_input;
+uniform ivec2 u_size;
+uniform int u_count; // Values in the input buffer, 0 while reading the texture
+
+layout(std430, binding = 0) readonly buffer Input { vec4 values[]; } src;
+layout(std430, binding = 1) writeonly buffer Output { vec4 values[]; } dst;
+
+shared vec4 partial[256];
+
+vec4 load(uint i) {
+  if (u_count == 0) {
+    if (i >= uint(u_size.x * u_size.y))
+      return IDENTITY;
+    return texelFetch(u_input, ivec2(int(i) % u_size.x, int(i) / u_size.x), 0);
+  }
+  return i < uint(u_count) ? src.values[i] : IDENTITY;
+}
+
+void main() {
+  uint index = gl_LocalInvocationID.x;
+  uint i = gl_WorkGroupID.x * 512u + index;
+  partial[index] = COMBINE(load(i), load(i + 256u));
+  memoryBarrierShared();
+  barrier();
+  for (uint stride = 128u; stride > 0u; stride >>= 1) {
+    if (index < stride)
+      partial[index] = COMBINE(partial[index], partial[index + stride]);
+    memoryBarrierShared();
+    barrier();
+  }
+  if (index == 0u)
+    dst.values[gl_WorkGroupID.x] = partial[0];
+}
+)";
+// Stores the last value, scaled to turn sums into averages
+constexpr char RESOLVE_SRC[] = R"(
+layout(local_size_x = 1) in;
+
+layout(std430, binding = 0) readonly buffer Input { vec4 values[]; } src;
+layout(rgba32f, binding = 0) uniform writeonly image2D u_output;
+uniform float u_scale;
+
+void main() {
+  imageStore(u_output, ivec2(0), src.values[0] * u_scale);
+}
+)";
+// Counts into shared memory first, so the buffer sees one atomic per bin and group
+constexpr char HISTOGRAM_SRC[] = R"(
+layout(local_size_x = 16, local_size_y = 16) in;
+
+uniform sampler2D u_input;
+uniform ivec2 u_size;
+
+layout(std430, binding = 0) buffer Bins { uint bins[]; };
+
+shared uint counts[BINS];
+
+void main() {
+  uint index = gl_LocalInvocationIndex; // One bin per invocation
+  counts[index] = 0u;
+  memoryBarrierShared();
+  barrier();
+  ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+  if (all(lessThan(pixel, u_size))) {
+    vec3 color = texelFetch(u_input, pixel, 0).rgb;
+    float luminance = clamp(dot(color, vec3(0.2126, 0.7152, 0.0722)), 0.0, 1.0);
+    atomicAdd(counts[uint(luminance * float(BINS - 1) + 0.5)], 1u);
+  }
+  memoryBarrierShared();
+  barrier();
+  if (counts[index] > 0u)
+    atomicAdd(bins[index], counts[index]);
+}
+)";
+constexpr char HISTOGRAM_RESOLVE_SRC[] = R"(
+layout(local_size_x = BINS) in;
+
+layout(std430, binding = 0) readonly buffer Bins { uint bins[]; };
+layout(r32f, binding = 0) uniform writeonly image2D u_output;
+uniform float u_scale;
+
+void main() {
+  uint index = gl_LocalInvocationIndex;
+  imageStore(u_output, ivec2(index, 0), vec4(float(bins[index]) * u_scale));
+}
+)";
+
+enum Program { SUM, MINIMUM, MAXIMUM, RESOLVE, HISTOGRAM, HISTOGRAM_RESOLVE, PROGRAM_COUNT };
+constexpr const char *SOURCES[] = {REDUCE_SRC, REDUCE_SRC,    REDUCE_SRC,
+                                   RESOLVE_SRC, HISTOGRAM_SRC, HISTOGRAM_RESOLVE_SRC};
+constexpr const char *DEFINES[] = {
+    "#define COMBINE(a, b) (a + b)\n#define IDENTITY vec4(0.0)\n",
+    "#define COMBINE(a, b) min(a, b)\n#define IDENTITY vec4(3.402823e38)\n",
+    "#define COMBINE(a, b) max(a, b)\n#define IDENTITY vec4(-3.402823e38)\n",
+    "",
+    "",
+    "",
+};
+constexpr const char *NAMES[] = {"Sum",     "Minimum",   "Maximum",
+                                 "Resolve", "Histogram", "HistogramResolve"};
+
+// Values combined by a work group of the tree
+constexpr size_t VALUES_PER_GROUP = 512;
+static_assert(Compute::BINS == 16 * 16, "A histogram group clears one bin per invocation");
+
+std::shared_ptr<Shader> programs[PROGRAM_COUNT];
+
+// Storage buffers grown on demand, the scratch buffer of the nodes and two for the tree
+struct Buffer {
+  GLuint buffer = 0;
+  size_t size = 0;
+};
+Buffer scratch, buffers[2];
+
+// Compiled on first use, nullptr if it failed to compile
+Shader *get_program(Program program) {
+  auto &shader = programs[program];
+  if (!shader) {
+    auto source = fmt::format("#version 430 core\n#define BINS {}\n{}{}", Compute::BINS,
+                              DEFINES[program], SOURCES[program]);
+    shader = std::make_shared<Shader>(NAMES[program], source);
+    if (!shader->compile_compute())
+      spdlog::error("Failed to compile the {} compute program:\n{}", NAMES[program],
+                    shader->get_log());
+  }
+  return shader->is_compiled() ? shader.get() : nullptr;
+}
+// Grows the buffer to hold at least the size in bytes, the contents are undefined after
+GLuint reserve(Buffer &buffer, size_t size) {
+  if (buffer.buffer == 0)
+    glGenBuffers(1, &buffer.buffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer.buffer);
+  if (buffer.size < size) {
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+    buffer.size = size;
+  }
+  return buffer.buffer;
+}
+// Expects the buffer to be bound by reserve()
+void clear_buffer() {
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT,
+                    nullptr);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+void set_input(Shader &shader, GLuint input, int width, int height) {
+  shader.use();
+  shader.set_uniform("u_input", Data(DataType::Texture2D, (Data::Texture2D)input));
+  shader.clear_textures();
+  glUniform2i(shader.get_uniform_loc("u_size"), width, height);
+}
+GLuint groups(size_t count, size_t size) { return GLuint((count + size - 1) / size); }
+
+RenderTarget *reduce_tree(const Compute::Targets &targets, GLuint input, int width, int height,
+                          Compute::Reduction reduction) {
+  Program program = reduction == Compute::Reduction::Minimum   ? MINIMUM
+                    : reduction == Compute::Reduction::Maximum ? MAXIMUM
+                                                               : SUM;
+  Shader *shader = get_program(program);
+  Shader *resolve = get_program(RESOLVE);
+  if (!shader || !resolve)
+    return nullptr;
+
+  size_t pixels = size_t(width) * size_t(height);
+  size_t size = groups(pixels, VALUES_PER_GROUP) * 4 * sizeof(float);
+  reserve(buffers[0], size);
+  reserve(buffers[1], size);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  set_input(*shader, input, width, height);
+  // The first dispatch reads the texture, the following ones the partials of the previous
+  size_t values = pixels;
+  int dst = 1;
+  for (bool first = true; first || values > 1; first = false) {
+    glUniform1i(shader->get_uniform_loc("u_count"), first ? 0 : int(values));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[1 - dst].buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[dst].buffer);
+    glDispatchCompute(groups(values, VALUES_PER_GROUP), 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    values = groups(values, VALUES_PER_GROUP);
+    dst = 1 - dst;
+  }
+
+  auto &target = targets(0, 1, 1, GL_RGBA32F);
+  resolve->use();
+  float scale = reduction == Compute::Reduction::Average ? 1.0f / float(pixels) : 1.0f;
+  glUniform1f(resolve->get_uniform_loc("u_scale"), scale);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[1 - dst].buffer);
+  glBindImageTexture(0, target.get_texture(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+  glDispatchCompute(1, 1, 1);
+  return &target;
+}
+RenderTarget *reduce_histogram(const Compute::Targets &targets, GLuint input, int width,
+                               int height) {
+  Shader *shader = get_program(HISTOGRAM);
+  Shader *resolve = get_program(HISTOGRAM_RESOLVE);
+  if (!shader || !resolve)
+    return nullptr;
+
+  reserve(buffers[0], Compute::BINS * sizeof(GLuint));
+  clear_buffer();
+  set_input(*shader, input, width, height);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[0].buffer);
+  glDispatchCompute(groups(width, 16), groups(height, 16), 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  auto &target = targets(0, Compute::BINS, 1, GL_R32F);
+  resolve->use();
+  glUniform1f(resolve->get_uniform_loc("u_scale"), 1.0f / float(size_t(width) * height));
+  glBindImageTexture(0, target.get_texture(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+  glDispatchCompute(1, 1, 1);
+  return &target;
+}
+
+} // namespace
+
+bool Compute::is_supported() { return GLAD_GL_VERSION_4_3; }
+const std::string &Compute::get_fallback_message() {
+  static const std::string message = [] {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return fmt::format("Compute shaders need OpenGL 4.3, this context is {}.{}", major, minor);
+  }();
+  return message;
+}
+const char *Compute::reduction_name(Reduction reduction) {
+  switch (reduction) {
+  case Reduction::Average:
+    return "Average";
+  case Reduction::Minimum:
+    return "Minimum";
+  case Reduction::Maximum:
+    return "Maximum";
+  case Reduction::Sum:
+    return "Sum";
+  case Reduction::Histogram:
+    return "Histogram";
+  }
+  return "";
+}
+bool Compute::get_size(GLuint texture, int &width, int &height) {
+  width = height = 0;
+  if (texture == 0)
+    return false;
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return width > 0 && height > 0;
+}
+RenderTarget *Compute::reduce(const Targets &targets, GLuint input, Reduction reduction) {
+  if (!is_supported())
+    return nullptr;
+  int width, height;
+  if (!get_size(input, width, height))
+    return nullptr;
+
+  RenderTarget *target = reduction == Reduction::Histogram
+                             ? reduce_histogram(targets, input, width, height)
+                             : reduce_tree(targets, input, width, height, reduction);
+  // Downstream passes sample the result
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+  glUseProgram(0);
+  return target;
+}
+GLuint Compute::get_scratch_buffer(size_t size) {
+  GLuint buffer = reserve(scratch, std::max<size_t>((size + 3) / 4 * 4, 4));
+  clear_buffer();
+  return buffer;
+}
+void Compute::clear() {
+  for (auto &shader : programs) {
+    if (shader && shader->is_compiled())
+      shader->destroy();
+    shader.reset();
+  }
+  for (auto *buffer : {&scratch, &buffers[0], &buffers[1]}) {
+    if (buffer->buffer != 0)
+      glDeleteBuffers(1, &buffer->buffer);
+    *buffer = Buffer();
+  }
+}
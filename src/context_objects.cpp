@@ -0,0 +1,86 @@
+#include "context_objects.h"
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Containers {
+  std::map<const void *, GLuint> framebuffers = {}; // By owner
+  std::map<const void *, GLuint> vertex_arrays = {};
+  // Released while another context was current
+  std::vector<GLuint> released_framebuffers = {};
+  std::vector<GLuint> released_vertex_arrays = {};
+};
+
+std::mutex mutex;
+std::map<GLFWwindow *, Containers> contexts;
+
+// Must be called with the context of the containers current
+void delete_released(Containers &containers) {
+  auto &framebuffers = containers.released_framebuffers;
+  if (!framebuffers.empty())
+    glDeleteFramebuffers(GLsizei(framebuffers.size()), framebuffers.data());
+  framebuffers.clear();
+  auto &vertex_arrays = containers.released_vertex_arrays;
+  if (!vertex_arrays.empty())
+    glDeleteVertexArrays(GLsizei(vertex_arrays.size()), vertex_arrays.data());
+  vertex_arrays.clear();
+}
+
+} // namespace
+
+GLuint ContextObjects::get_framebuffer(const void *owner, bool &created) {
+  std::lock_guard lock(mutex);
+  GLuint &fbo = contexts[glfwGetCurrentContext()].framebuffers[owner];
+  created = fbo == 0;
+  if (created)
+    glGenFramebuffers(1, &fbo);
+  return fbo;
+}
+GLuint ContextObjects::get_vertex_array(const void *owner, bool &created) {
+  std::lock_guard lock(mutex);
+  GLuint &vao = contexts[glfwGetCurrentContext()].vertex_arrays[owner];
+  created = vao == 0;
+  if (created)
+    glGenVertexArrays(1, &vao);
+  return vao;
+}
+void ContextObjects::release(const void *owner) {
+  std::lock_guard lock(mutex);
+  GLFWwindow *current = glfwGetCurrentContext();
+  for (auto &[context, containers] : contexts) {
+    if (auto it = containers.framebuffers.find(owner); it != containers.framebuffers.end()) {
+      containers.released_framebuffers.push_back(it->second);
+      containers.framebuffers.erase(it);
+    }
+    if (auto it = containers.vertex_arrays.find(owner); it != containers.vertex_arrays.end()) {
+      containers.released_vertex_arrays.push_back(it->second);
+      containers.vertex_arrays.erase(it);
+    }
+    if (context == current)
+      delete_released(containers);
+  }
+}
+void ContextObjects::collect() {
+  std::lock_guard lock(mutex);
+  if (auto it = contexts.find(glfwGetCurrentContext()); it != contexts.end())
+    delete_released(it->second);
+}
+void ContextObjects::clear() {
+  std::lock_guard lock(mutex);
+  auto it = contexts.find(glfwGetCurrentContext());
+  if (it == contexts.end())
+    return;
+  auto &containers = it->second;
+  for (auto &pair : containers.framebuffers)
+    containers.released_framebuffers.push_back(pair.second);
+  for (auto &pair : containers.vertex_arrays)
+    containers.released_vertex_arrays.push_back(pair.second);
+  delete_released(containers);
+  contexts.erase(it);
+}
@@ -0,0 +1,81 @@
+#include "eval_context.h"
+
+#include "graph.h"
+
+//! ResultCache
+
+std::shared_ptr<NodeResult> ResultCache::find(uint64_t signature) {
+  std::lock_guard lock(mutex);
+  auto it = results.find(signature);
+  if (it == results.end())
+    return nullptr;
+  return it->second.lock();
+}
+void ResultCache::insert(std::shared_ptr<NodeResult> result) {
+  std::lock_guard lock(mutex);
+  std::erase_if(results, [](auto &pair) { return pair.second.expired(); });
+  results[result->signature] = result;
+}
+
+//! EvalContext
+
+Data EvalContext::get_pin_data(int pinid) {
+  if (tape) {
+    if (auto it = tape->pins.find(pinid); it != tape->pins.end())
+      return tape_state.registers[it->second].to_data(tape->types[it->second]);
+  }
+  if (auto it = pin_values.find(pinid); it != pin_values.end())
+    return it->second;
+  return graph->get_pin_data(pinid); // Empty, only carries the type
+}
+void EvalContext::set_pin_data(int pinid, std::any value) {
+  if (current)
+    current->outputs.emplace_back(pinid, Data(graph->get_pin_data(pinid).type, value));
+  for (auto &pair : graph->get_edges()) {
+    if (pair.second.from == pinid)
+      pin_values[pair.second.to] = Data(graph->get_pin_data(pair.second.to).type, value);
+  }
+}
+RenderTarget &EvalContext::get_target(int width, int height, GLenum format, size_t index) {
+  if (index > 0 && current->attachments.size() < index)
+    current->attachments.resize(index);
+  auto &target = index == 0 ? current->target : current->attachments[index - 1];
+  if (target && (target->get_width() != width || target->get_height() != height ||
+                 target->get_format() != format))
+    RenderTargetPool::release(std::move(target));
+  if (!target)
+    target = RenderTargetPool::acquire(width, height, format);
+  return *target;
+}
+void EvalContext::set_output(const std::string &name, GLuint image) {
+  images[name] = image;
+  if (current)
+    current->image = {name, image};
+}
+void EvalContext::run_deferred(int nodeid) {
+  if (!deferred.erase(nodeid))
+    return;
+  auto running = current; // Called while the consumer runs
+  graph->run_node(*this, nodeid, false);
+  current = running;
+}
+FeedbackBuffers &EvalContext::get_feedback(int nodeid) {
+  auto &buffers = feedback[nodeid];
+  if (!buffers)
+    buffers = std::make_shared<FeedbackBuffers>();
+  return *buffers;
+}
+void EvalContext::release() {
+  results.clear();
+  pending.clear();
+  signatures.clear();
+  pending_key.reset();
+  fusion.clear();
+  deferred.clear();
+  pin_values.clear();
+  tape = nullptr;
+  tape_state = TapeState();
+  images.clear();
+  feedback.clear();
+  last_key.reset();
+}
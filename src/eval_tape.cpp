@@ -0,0 +1,200 @@
+#include "eval_tape.h"
+
+#include "eval_context.h"
+#include "graph.h"
+
+#include <algorithm>
+
+namespace {
+
+template <typename T, typename V> void store(std::array<T, 4> &dst, const V &value) {
+  std::copy_n(value.begin(), std::min(value.size(), dst.size()), dst.begin());
+}
+template <typename V, typename T> V load(const std::array<T, 4> &src) {
+  V value = {};
+  std::copy_n(src.begin(), std::min(value.size(), src.size()), value.begin());
+  return value;
+}
+
+} // namespace
+
+//! Register
+
+Register Register::from_data(Data data) {
+  Register reg;
+  switch (data.type) {
+  case DataType::Int:
+    reg.i[0] = data.get<Data::Int>();
+    break;
+  case DataType::IVec2:
+    store(reg.i, data.get<Data::IVec2>());
+    break;
+  case DataType::IVec3:
+    store(reg.i, data.get<Data::IVec3>());
+    break;
+  case DataType::IVec4:
+    store(reg.i, data.get<Data::IVec4>());
+    break;
+  case DataType::Float:
+    reg.f[0] = data.get<Data::Float>();
+    break;
+  case DataType::Vec2:
+    store(reg.f, data.get<Data::Vec2>());
+    break;
+  case DataType::Vec3:
+    store(reg.f, data.get<Data::Vec3>());
+    break;
+  case DataType::Vec4:
+    store(reg.f, data.get<Data::Vec4>());
+    break;
+  default: // Textures are produced by passes only
+    break;
+  }
+  return reg;
+}
+Data Register::to_data(DataType type) const {
+  switch (type) {
+  case DataType::Int:
+    return Data(type, i[0]);
+  case DataType::IVec2:
+    return Data(type, load<Data::IVec2>(i));
+  case DataType::IVec3:
+    return Data(type, load<Data::IVec3>(i));
+  case DataType::IVec4:
+    return Data(type, load<Data::IVec4>(i));
+  case DataType::Float:
+    return Data(type, f[0]);
+  case DataType::Vec2:
+    return Data(type, load<Data::Vec2>(f));
+  case DataType::Vec3:
+    return Data(type, load<Data::Vec3>(f));
+  case DataType::Vec4:
+    return Data(type, load<Data::Vec4>(f));
+  default:
+    return Data(type);
+  }
+}
+
+Expression::Lanes Register::to_lanes(DataType type) const {
+  switch (type) {
+  case DataType::Int:
+  case DataType::IVec2:
+  case DataType::IVec3:
+  case DataType::IVec4:
+    return {float(i[0]), float(i[1]), float(i[2]), float(i[3])};
+  default:
+    return f;
+  }
+}
+
+//! Tape
+
+void Tape::run(const EvalContext &context, TapeState &state) const {
+  TapeState *states[] = {&state};
+  const EvalContext *contexts[] = {&context};
+  run_batch(contexts, states, 1, state);
+}
+void Tape::run_batch(const EvalContext *const *contexts, TapeState *const *states,
+                     size_t count, TapeState &batch) const {
+  for (size_t n = 0; n < count; n++)
+    states[n]->registers.assign(constants.begin(), constants.end()); // Keeps the capacity
+  for (auto &instruction : code) {
+    if (instruction.op == TapeOp::Expression) {
+      // Inputs are variable-major, the results follow them
+      auto &program = *programs[instruction.index];
+      size_t variables = program.get_variables().size();
+      if (batch.inputs.size() < (variables + 1) * count)
+        batch.inputs.resize((variables + 1) * count);
+      Expression::Lanes *inputs = batch.inputs.data(), *results = inputs + variables * count;
+      for (size_t k = 0; k < variables; k++) {
+        int arg = args[instruction.args + k];
+        for (size_t n = 0; n < count; n++)
+          inputs[k * count + n] =
+              arg < 0 ? Expression::Lanes{} : states[n]->registers[arg].to_lanes(types[arg]);
+      }
+      program.run_batch(inputs, count, results, batch.scratch);
+      for (size_t n = 0; n < count; n++)
+        states[n]->registers[instruction.dst].f = results[n];
+      continue;
+    }
+    for (size_t n = 0; n < count; n++) {
+      auto &context = *contexts[n];
+      auto &dst = states[n]->registers[instruction.dst];
+      switch (instruction.op) {
+      case TapeOp::Time:
+        dst.f[0] = float(context.time);
+        break;
+      case TapeOp::Resolution:
+        dst.f[0] = context.resolution.x;
+        dst.f[1] = context.resolution.y;
+        break;
+      case TapeOp::Parameter:
+        if (auto it = context.overrides.find(parameters[instruction.index]);
+            it != context.overrides.end())
+          dst = Register::from_data(it->second);
+        break;
+      default:
+        break;
+      }
+    }
+  }
+}
+
+//! TapeBuilder
+
+int TapeBuilder::allocate(DataType type) {
+  tape.constants.emplace_back();
+  tape.types.push_back(type);
+  return int(tape.constants.size() - 1);
+}
+int TapeBuilder::output(int pinid) {
+  DataType type = graph.get_pin_data(pinid).type;
+  int reg = allocate(type);
+  for (auto &pair : graph.get_edges()) {
+    if (pair.second.from == pinid)
+      tape.pins[pair.second.to] = reg;
+  }
+  if (!parameters.contains(pinid))
+    return reg;
+
+  tape.code.push_back(TapeInstruction{TapeOp::Parameter, reg, int(tape.parameters.size())});
+  tape.parameters.push_back(pinid);
+  written.insert(reg);
+  return allocate(type);
+}
+void TapeBuilder::constant(int pinid, Data value) {
+  tape.constants[output(pinid)] = Register::from_data(value);
+}
+std::optional<int> TapeBuilder::input(int pinid) {
+  if (auto it = tape.pins.find(pinid); it != tape.pins.end())
+    return it->second;
+  for (auto &pair : graph.get_edges()) {
+    if (pair.second.to == pinid)
+      return {};
+  }
+  return -1;
+}
+void TapeBuilder::emit(TapeOp op, int dst) {
+  tape.code.push_back(TapeInstruction{op, dst});
+  written.insert(dst);
+}
+void TapeBuilder::emit(std::shared_ptr<const Expression> expression, const std::vector<int> &args,
+                       int dst) {
+  bool folded =
+      std::none_of(args.begin(), args.end(), [&](int arg) { return written.contains(arg); });
+  if (folded) {
+    std::vector<Expression::Lanes> inputs, scratch;
+    for (int arg : args) {
+      Register value = arg < 0 ? Register() : tape.constants[arg];
+      inputs.push_back(value.to_lanes(arg < 0 ? DataType::Float : tape.types[arg]));
+    }
+    tape.constants[dst].f = expression->run(inputs.data(), scratch);
+    return;
+  }
+  TapeInstruction instruction{TapeOp::Expression, dst, int(tape.programs.size()),
+                              int(tape.args.size())};
+  tape.programs.push_back(expression);
+  tape.args.insert(tape.args.end(), args.begin(), args.end());
+  tape.code.push_back(instruction);
+  written.insert(dst);
+}
@@ -0,0 +1,65 @@
+#include "events.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+bool EventQueue::stress_test(int producers, size_t values) {
+  // A queue of its own, so the events of the app are left alone
+  auto queue = std::make_unique<MpscQueue<uint64_t, CAPACITY>>();
+  std::atomic<bool> start = false;
+  std::atomic<size_t> retries = 0; // Pushes that found the queue full
+
+  // Values carry their producer in the upper and their sequence in the lower bits
+  std::vector<std::thread> threads;
+  for (int producer = 0; producer < producers; producer++) {
+    threads.emplace_back([&, producer] {
+      while (!start.load(std::memory_order_acquire))
+        std::this_thread::yield();
+      for (uint64_t i = 0; i < values; i++) {
+        while (!queue->push((uint64_t(producer) << 32) | i)) {
+          retries.fetch_add(1, std::memory_order_relaxed);
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  auto begin = std::chrono::steady_clock::now();
+  start.store(true, std::memory_order_release);
+  std::vector<uint64_t> next(producers, 0);
+  size_t received = 0, errors = 0;
+  size_t total = size_t(producers) * values;
+  while (received < total) {
+    auto value = queue->pop();
+    if (!value) {
+      std::this_thread::yield();
+      continue;
+    }
+    received++;
+    uint64_t producer = value.value() >> 32, sequence = value.value() & 0xFFFFFFFF;
+    if (producer >= uint64_t(producers) || sequence != next[producer]) {
+      if (errors++ == 0)
+        spdlog::error("Event queue stress test: got value {} of producer {}, expected {}",
+                      sequence, producer, producer < next.size() ? next[producer] : 0);
+      continue;
+    }
+    next[producer]++;
+  }
+  for (auto &thread : threads)
+    thread.join();
+  errors += queue->pop().has_value(); // Nothing may be left over
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+
+  bool passed = errors == 0;
+  auto message = fmt::format("Event queue stress test {}: {} producers pushed {} values in "
+                             "{:.1f} ms, {} pushes found the queue full",
+                             passed ? "passed" : "FAILED", producers, total, elapsed.count(),
+                             retries.load());
+  if (passed)
+    spdlog::info(message);
+  else
+    spdlog::error(message);
+  push(StatusMessage(message));
+  return passed;
+}
@@ -0,0 +1,636 @@
+#include "expression.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <numbers>
+#include <optional>
+#include <set>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+enum class Expression::Op : uint8_t {
+  // Shuffles
+  Splat,   // All lanes set to a[0]
+  Swizzle, // Lane i is lane (c >> 2i) & 3 of a
+  Concat,  // The first c lanes of a followed by b
+  // Componentwise
+  Neg,
+  Abs,
+  Sign,
+  Floor,
+  Ceil,
+  Fract,
+  Sqrt,
+  Exp,
+  Log,
+  Sin,
+  Cos,
+  Tan,
+  Asin,
+  Acos,
+  Atan,
+  Add,
+  Sub,
+  Mul,
+  Div,
+  Pow,
+  Mod,
+  Min,
+  Max,
+  Step,
+  Atan2,
+  Clamp,
+  Mix,
+  Smoothstep,
+  // Over the lanes of the operands
+  Dot,       // Writes one lane
+  Length,    // Writes one lane
+  Normalize, // Writes all lanes
+};
+
+namespace {
+
+struct Token {
+  enum Kind { Number, Identifier, Symbol, End } kind;
+  std::string text;
+  size_t pos;
+};
+
+std::vector<Token> tokenize(const std::string &src) {
+  std::vector<Token> tokens;
+  size_t i = 0;
+  while (i < src.size()) {
+    char c = src[i];
+    if (std::isspace((unsigned char)c)) {
+      i++;
+    } else if (std::isdigit((unsigned char)c) ||
+               (c == '.' && i + 1 < src.size() && std::isdigit((unsigned char)src[i + 1]))) {
+      size_t start = i;
+      while (i < src.size() && (std::isdigit((unsigned char)src[i]) || src[i] == '.'))
+        i++;
+      if (i < src.size() && (src[i] == 'e' || src[i] == 'E')) {
+        size_t exp = i + 1;
+        if (exp < src.size() && (src[exp] == '+' || src[exp] == '-'))
+          exp++;
+        if (exp < src.size() && std::isdigit((unsigned char)src[exp])) {
+          i = exp;
+          while (i < src.size() && std::isdigit((unsigned char)src[i]))
+            i++;
+        }
+      }
+      tokens.push_back(Token{Token::Number, src.substr(start, i - start), start});
+    } else if (std::isalpha((unsigned char)c) || c == '_') {
+      size_t start = i;
+      while (i < src.size() && (std::isalnum((unsigned char)src[i]) || src[i] == '_'))
+        i++;
+      tokens.push_back(Token{Token::Identifier, src.substr(start, i - start), start});
+    } else if (std::string_view("+-*/^(),.").find(c) != std::string_view::npos) {
+      tokens.push_back(Token{Token::Symbol, std::string(1, c), i});
+      i++;
+    } else {
+      throw std::runtime_error(fmt::format("Unexpected '{}' at {}", c, i + 1));
+    }
+  }
+  tokens.push_back(Token{Token::End, "", src.size()});
+  return tokens;
+}
+
+int type_width(DataType type) {
+  switch (type) {
+  case DataType::Int:
+  case DataType::Float:
+    return 1;
+  case DataType::IVec2:
+  case DataType::Vec2:
+    return 2;
+  case DataType::IVec3:
+  case DataType::Vec3:
+    return 3;
+  case DataType::IVec4:
+  case DataType::Vec4:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+const std::map<std::string, float> CONSTANTS = {
+    {"pi", std::numbers::pi_v<float>},
+    {"tau", 2.0f * std::numbers::pi_v<float>},
+};
+
+} // namespace
+
+//! Compiler
+
+// Recursive descent parser emitting the instructions while parsing
+struct Expression::Compiler {
+  // Value of a subexpression
+  struct Operand {
+    uint16_t reg;
+    int width;
+  };
+  enum class Kind {
+    Componentwise, // Scalar arguments are splatted to the widest one
+    Reduction,     // Arguments of equal width, writes a scalar
+  };
+  struct Function {
+    Op op;
+    int arity;
+    Kind kind = Kind::Componentwise;
+  };
+
+  static constexpr size_t MAX_REGISTERS = 1024;
+
+  Expression &expr;
+  std::vector<Token> tokens;
+  size_t next = 0;
+  std::vector<std::optional<Lanes>> values = {}; // Values of constant registers
+
+  static const std::map<std::string, Function> &functions() {
+    static const std::map<std::string, Function> table = {
+        {"abs", {Op::Abs, 1}},
+        {"sign", {Op::Sign, 1}},
+        {"floor", {Op::Floor, 1}},
+        {"ceil", {Op::Ceil, 1}},
+        {"fract", {Op::Fract, 1}},
+        {"sqrt", {Op::Sqrt, 1}},
+        {"exp", {Op::Exp, 1}},
+        {"log", {Op::Log, 1}},
+        {"sin", {Op::Sin, 1}},
+        {"cos", {Op::Cos, 1}},
+        {"tan", {Op::Tan, 1}},
+        {"asin", {Op::Asin, 1}},
+        {"acos", {Op::Acos, 1}},
+        {"atan", {Op::Atan, 1}}, // atan(y, x) is Atan2
+        {"pow", {Op::Pow, 2}},
+        {"mod", {Op::Mod, 2}},
+        {"min", {Op::Min, 2}},
+        {"max", {Op::Max, 2}},
+        {"step", {Op::Step, 2}},
+        {"clamp", {Op::Clamp, 3}},
+        {"mix", {Op::Mix, 3}},
+        {"smoothstep", {Op::Smoothstep, 3}},
+        {"dot", {Op::Dot, 2, Kind::Reduction}},
+        {"length", {Op::Length, 1, Kind::Reduction}},
+        {"normalize", {Op::Normalize, 1}},
+    };
+    return table;
+  }
+  static bool is_constructor(const std::string &name) {
+    return name == "float" || name == "vec2" || name == "vec3" || name == "vec4";
+  }
+
+  [[noreturn]] void fail(const std::string &message, const Token &token) {
+    throw std::runtime_error(fmt::format("{} at {}", message, token.pos + 1));
+  }
+  const Token &peek() { return tokens[next]; }
+  bool accept(const char *symbol) {
+    if (peek().kind != Token::Symbol || peek().text != symbol)
+      return false;
+    next++;
+    return true;
+  }
+  void expect(const char *symbol) {
+    if (!accept(symbol))
+      fail(fmt::format("Expected '{}'", symbol), peek());
+  }
+
+  uint16_t allocate(std::optional<Lanes> value = {}) {
+    if (values.size() >= MAX_REGISTERS)
+      throw std::runtime_error("Expression is too long");
+    values.push_back(value);
+    return uint16_t(values.size() - 1);
+  }
+  Operand constant(Lanes value, int width) { return Operand{allocate(value), width}; }
+  // Emits an instruction, folded if it only reads constants
+  Operand emit(Op op, int width, std::initializer_list<uint16_t> operands, uint16_t c = 0,
+               int result_width = -1) {
+    Instruction instruction{op, uint8_t(width), 0, 0, 0, c};
+    auto it = operands.begin();
+    instruction.a = it != operands.end() ? *it++ : 0;
+    instruction.b = it != operands.end() ? *it++ : 0;
+    if (it != operands.end())
+      instruction.c = *it;
+    result_width = result_width < 0 ? width : result_width;
+
+    bool folded = std::all_of(operands.begin(), operands.end(),
+                              [&](uint16_t reg) { return values[reg].has_value(); });
+    if (folded) {
+      std::vector<Lanes> regs(values.size() + 1);
+      for (size_t i = 0; i < values.size(); i++)
+        regs[i] = values[i].value_or(Lanes{});
+      instruction.dst = uint16_t(values.size());
+      execute(instruction, regs.data(), 1);
+      return constant(regs.back(), result_width);
+    }
+    instruction.dst = allocate();
+    expr.code.push_back(instruction);
+    return Operand{instruction.dst, result_width};
+  }
+  Operand splat(Operand operand, int width) {
+    if (operand.width == width)
+      return operand;
+    if (operand.width != 1)
+      throw std::runtime_error(
+          fmt::format("Can't convert a value of {} components to {}", operand.width, width));
+    return emit(Op::Splat, width, {operand.reg});
+  }
+  // Applies a componentwise op, scalars are splatted to the widest operand
+  Operand componentwise(Op op, std::vector<Operand> operands, const Token &at) {
+    int width = 1;
+    for (auto &operand : operands)
+      width = std::max(width, operand.width);
+    try {
+      for (auto &operand : operands)
+        operand = splat(operand, width);
+    } catch (std::runtime_error &error) {
+      fail(error.what(), at);
+    }
+    if (operands.size() == 1)
+      return emit(op, width, {operands[0].reg});
+    if (operands.size() == 2)
+      return emit(op, width, {operands[0].reg, operands[1].reg});
+    return emit(op, width, {operands[0].reg, operands[1].reg, operands[2].reg});
+  }
+
+  //! Grammar
+
+  // expression := term (('+' | '-') term)*
+  Operand expression() {
+    Operand lhs = term();
+    while (true) {
+      const Token &at = peek();
+      if (accept("+"))
+        lhs = componentwise(Op::Add, {lhs, term()}, at);
+      else if (accept("-"))
+        lhs = componentwise(Op::Sub, {lhs, term()}, at);
+      else
+        return lhs;
+    }
+  }
+  // term := unary (('*' | '/') unary)*
+  Operand term() {
+    Operand lhs = unary();
+    while (true) {
+      const Token &at = peek();
+      if (accept("*"))
+        lhs = componentwise(Op::Mul, {lhs, unary()}, at);
+      else if (accept("/"))
+        lhs = componentwise(Op::Div, {lhs, unary()}, at);
+      else
+        return lhs;
+    }
+  }
+  // unary := ('-' | '+') unary | power
+  Operand unary() {
+    const Token &at = peek();
+    if (accept("-"))
+      return componentwise(Op::Neg, {unary()}, at);
+    if (accept("+"))
+      return unary();
+    return power();
+  }
+  // power := postfix ('^' unary)?, right associative
+  Operand power() {
+    Operand base = postfix();
+    const Token &at = peek();
+    if (accept("^"))
+      return componentwise(Op::Pow, {base, unary()}, at);
+    return base;
+  }
+  // postfix := primary ('.' swizzle)*
+  Operand postfix() {
+    Operand operand = primary();
+    while (accept(".")) {
+      const Token &token = peek();
+      if (token.kind != Token::Identifier || token.text.size() > 4)
+        fail("Expected a swizzle", token);
+      next++;
+      uint16_t pattern = 0;
+      for (size_t i = 0; i < token.text.size(); i++) {
+        size_t lane = std::string_view("xyzw").find(token.text[i]);
+        if (lane == std::string_view::npos)
+          lane = std::string_view("rgba").find(token.text[i]);
+        if (lane == std::string_view::npos || int(lane) >= operand.width)
+          fail(fmt::format("Invalid swizzle '{}'", token.text), token);
+        pattern |= uint16_t(lane << (2 * i));
+      }
+      operand = emit(Op::Swizzle, int(token.text.size()), {operand.reg}, pattern);
+    }
+    return operand;
+  }
+  // primary := number | constant | variable | call | '(' expression ')'
+  Operand primary() {
+    const Token &token = peek();
+    if (token.kind == Token::Number) {
+      next++;
+      char *end = nullptr;
+      float value = std::strtof(token.text.c_str(), &end);
+      if (end != token.text.c_str() + token.text.size())
+        fail(fmt::format("Invalid number '{}'", token.text), token);
+      return constant({value, value, value, value}, 1);
+    }
+    if (accept("(")) {
+      Operand operand = expression();
+      expect(")");
+      return operand;
+    }
+    if (token.kind != Token::Identifier)
+      fail(token.kind == Token::End ? "Unexpected end" : fmt::format("Unexpected '{}'", token.text),
+           token);
+    next++;
+
+    if (accept("("))
+      return call(token);
+    if (auto it = CONSTANTS.find(token.text); it != CONSTANTS.end())
+      return constant({it->second, it->second, it->second, it->second}, 1);
+    for (size_t i = 0; i < expr.variables.size(); i++) {
+      if (expr.variables[i].name == token.text)
+        return Operand{uint16_t(i), type_width(expr.variables[i].type)};
+    }
+    fail(fmt::format("Unknown identifier '{}'", token.text), token);
+  }
+  // call := name '(' (expression (',' expression)*)? ')'
+  Operand call(const Token &name) {
+    std::vector<Operand> args;
+    if (!accept(")")) {
+      do {
+        args.push_back(expression());
+      } while (accept(","));
+      expect(")");
+    }
+
+    if (is_constructor(name.text)) {
+      int width = name.text == "float" ? 1 : name.text.back() - '0';
+      if (args.size() == 1 && args[0].width == 1)
+        return splat(args[0], width);
+      if (args.size() == 1 && args[0].width > width) // Truncates like GLSL
+        return emit(Op::Swizzle, width, {args[0].reg}, uint16_t(0b11100100));
+      Operand result = args.empty() ? Operand{0, 0} : args[0];
+      for (size_t i = 1; i < args.size(); i++) {
+        int combined = result.width + args[i].width;
+        if (combined > 4)
+          break;
+        result = emit(Op::Concat, combined, {result.reg, args[i].reg}, uint16_t(result.width));
+      }
+      if (result.width != width)
+        fail(fmt::format("Wrong number of components for {}", name.text), name);
+      return result;
+    }
+
+    auto it = functions().find(name.text);
+    if (it == functions().end())
+      fail(fmt::format("Unknown function '{}'", name.text), name);
+    Function function = it->second;
+    if (function.op == Op::Atan && args.size() == 2)
+      function = Function{Op::Atan2, 2};
+    if (int(args.size()) != function.arity)
+      fail(fmt::format("{} takes {} arguments", name.text, function.arity), name);
+
+    if (function.kind == Kind::Reduction) {
+      if (args.size() == 2 && args[0].width != args[1].width)
+        fail(fmt::format("Arguments of {} differ in size", name.text), name);
+      if (args.size() == 1)
+        return emit(function.op, args[0].width, {args[0].reg}, 0, 1);
+      return emit(function.op, args[0].width, {args[0].reg, args[1].reg}, 0, 1);
+    }
+    return componentwise(function.op, args, name);
+  }
+
+  // Collects the free variables, so they take the first registers
+  void declare_variables(const std::map<std::string, DataType> &types) {
+    std::set<std::string> seen;
+    for (size_t i = 0; i < tokens.size(); i++) {
+      auto &token = tokens[i];
+      bool is_call = tokens[i + 1 < tokens.size() ? i + 1 : i].text == "(";
+      bool is_swizzle = i > 0 && tokens[i - 1].text == ".";
+      if (token.kind != Token::Identifier || is_call || is_swizzle ||
+          CONSTANTS.contains(token.text) || !seen.insert(token.text).second)
+        continue;
+      auto type = types.find(token.text);
+      Variable variable{token.text, type != types.end() ? type->second : DataType::Float};
+      if (type_width(variable.type) == 0)
+        fail(fmt::format("'{}' must be a scalar or a vector", token.text), token);
+      expr.variables.push_back(variable);
+      allocate();
+    }
+  }
+  void compile(const std::map<std::string, DataType> &types) {
+    declare_variables(types);
+    Operand result = expression();
+    if (peek().kind != Token::End)
+      fail(fmt::format("Unexpected '{}'", peek().text), peek());
+
+    // Only the constants the code reads are loaded before running
+    std::set<uint16_t> read = {result.reg};
+    for (auto &instruction : expr.code) {
+      read.insert({instruction.a, instruction.b});
+      if (instruction.op == Op::Clamp || instruction.op == Op::Mix ||
+          instruction.op == Op::Smoothstep)
+        read.insert(instruction.c);
+    }
+    for (uint16_t reg : read) {
+      if (values[reg])
+        expr.constants.emplace_back(reg, *values[reg]);
+    }
+    expr.registers = uint16_t(values.size());
+    expr.result = result.reg;
+    expr.width = result.width;
+  }
+};
+
+//! Expression
+
+bool Expression::compile(const std::string &source, const std::map<std::string, DataType> &types) {
+  *this = Expression();
+  try {
+    Compiler compiler{*this, tokenize(source)};
+    compiler.compile(types);
+    return true;
+  } catch (std::runtime_error &e) {
+    *this = Expression();
+    error = e.what();
+    return false;
+  }
+}
+DataType Expression::get_type() const {
+  constexpr DataType TYPES[] = {DataType::Float, DataType::Vec2, DataType::Vec3, DataType::Vec4};
+  return TYPES[width - 1];
+}
+Expression::Lanes Expression::run(const Lanes *inputs, std::vector<Lanes> &scratch) const {
+  Lanes result;
+  run_batch(inputs, 1, &result, scratch);
+  return result;
+}
+void Expression::run_batch(const Lanes *inputs, size_t count, Lanes *results,
+                           std::vector<Lanes> &scratch) const {
+  if (scratch.size() < size_t(registers) * count)
+    scratch.resize(size_t(registers) * count);
+  Lanes *regs = scratch.data();
+  std::copy_n(inputs, variables.size() * count, regs);
+  for (auto &[reg, value] : constants)
+    std::fill_n(regs + size_t(reg) * count, count, value);
+  for (auto &instruction : code)
+    execute(instruction, regs, count);
+  std::copy_n(regs + size_t(result) * count, count, results);
+}
+void Expression::execute(const Instruction &instruction, Lanes *regs, size_t count) {
+  Lanes *d = regs + size_t(instruction.dst) * count;
+  const Lanes *a = regs + size_t(instruction.a) * count;
+  const Lanes *b = regs + size_t(instruction.b) * count;
+  const Lanes *c = regs + size_t(instruction.c) * count;
+  const int width = instruction.width;
+
+  // The inner loops run over all sets of inputs, so batches vectorize
+  auto map1 = [&](auto f) {
+    for (size_t n = 0; n < count; n++)
+      for (int i = 0; i < width; i++)
+        d[n][i] = f(a[n][i]);
+  };
+  auto map2 = [&](auto f) {
+    for (size_t n = 0; n < count; n++)
+      for (int i = 0; i < width; i++)
+        d[n][i] = f(a[n][i], b[n][i]);
+  };
+  auto map3 = [&](auto f) {
+    for (size_t n = 0; n < count; n++)
+      for (int i = 0; i < width; i++)
+        d[n][i] = f(a[n][i], b[n][i], c[n][i]);
+  };
+
+  switch (instruction.op) {
+  case Op::Splat:
+    for (size_t n = 0; n < count; n++)
+      d[n] = {a[n][0], a[n][0], a[n][0], a[n][0]};
+    break;
+  case Op::Swizzle:
+    for (size_t n = 0; n < count; n++)
+      for (int i = 0; i < width; i++)
+        d[n][i] = a[n][(instruction.c >> (2 * i)) & 3];
+    break;
+  case Op::Concat:
+    for (size_t n = 0; n < count; n++) {
+      for (int i = 0; i < instruction.c; i++)
+        d[n][i] = a[n][i];
+      for (int i = instruction.c; i < width; i++)
+        d[n][i] = b[n][i - instruction.c];
+    }
+    break;
+  case Op::Neg:
+    map1([](float x) { return -x; });
+    break;
+  case Op::Abs:
+    map1([](float x) { return std::abs(x); });
+    break;
+  case Op::Sign:
+    map1([](float x) { return float((x > 0.0f) - (x < 0.0f)); });
+    break;
+  case Op::Floor:
+    map1([](float x) { return std::floor(x); });
+    break;
+  case Op::Ceil:
+    map1([](float x) { return std::ceil(x); });
+    break;
+  case Op::Fract:
+    map1([](float x) { return x - std::floor(x); });
+    break;
+  case Op::Sqrt:
+    map1([](float x) { return std::sqrt(x); });
+    break;
+  case Op::Exp:
+    map1([](float x) { return std::exp(x); });
+    break;
+  case Op::Log:
+    map1([](float x) { return std::log(x); });
+    break;
+  case Op::Sin:
+    map1([](float x) { return std::sin(x); });
+    break;
+  case Op::Cos:
+    map1([](float x) { return std::cos(x); });
+    break;
+  case Op::Tan:
+    map1([](float x) { return std::tan(x); });
+    break;
+  case Op::Asin:
+    map1([](float x) { return std::asin(x); });
+    break;
+  case Op::Acos:
+    map1([](float x) { return std::acos(x); });
+    break;
+  case Op::Atan:
+    map1([](float x) { return std::atan(x); });
+    break;
+  case Op::Add:
+    map2([](float x, float y) { return x + y; });
+    break;
+  case Op::Sub:
+    map2([](float x, float y) { return x - y; });
+    break;
+  case Op::Mul:
+    map2([](float x, float y) { return x * y; });
+    break;
+  case Op::Div:
+    map2([](float x, float y) { return x / y; });
+    break;
+  case Op::Pow:
+    map2([](float x, float y) { return std::pow(x, y); });
+    break;
+  case Op::Mod: // As in GLSL, takes the sign of y
+    map2([](float x, float y) { return x - y * std::floor(x / y); });
+    break;
+  case Op::Min:
+    map2([](float x, float y) { return std::min(x, y); });
+    break;
+  case Op::Max:
+    map2([](float x, float y) { return std::max(x, y); });
+    break;
+  case Op::Step:
+    map2([](float edge, float x) { return x < edge ? 0.0f : 1.0f; });
+    break;
+  case Op::Atan2:
+    map2([](float y, float x) { return std::atan2(y, x); });
+    break;
+  case Op::Clamp:
+    map3([](float x, float lo, float hi) { return std::min(std::max(x, lo), hi); });
+    break;
+  case Op::Mix:
+    map3([](float x, float y, float t) { return x + (y - x) * t; });
+    break;
+  case Op::Smoothstep:
+    map3([](float e0, float e1, float x) {
+      float t = std::clamp((x - e0) / (e1 - e0), 0.0f, 1.0f);
+      return t * t * (3.0f - 2.0f * t);
+    });
+    break;
+  case Op::Dot:
+    for (size_t n = 0; n < count; n++) {
+      float sum = 0.0f;
+      for (int i = 0; i < width; i++)
+        sum += a[n][i] * b[n][i];
+      d[n][0] = sum;
+    }
+    break;
+  case Op::Length:
+    for (size_t n = 0; n < count; n++) {
+      float sum = 0.0f;
+      for (int i = 0; i < width; i++)
+        sum += a[n][i] * a[n][i];
+      d[n][0] = std::sqrt(sum);
+    }
+    break;
+  case Op::Normalize:
+    for (size_t n = 0; n < count; n++) {
+      float sum = 0.0f;
+      for (int i = 0; i < width; i++)
+        sum += a[n][i] * a[n][i];
+      float scale = 1.0f / std::sqrt(sum);
+      for (int i = 0; i < width; i++)
+        d[n][i] = a[n][i] * scale;
+    }
+    break;
+  }
+}
@@ -0,0 +1,111 @@
+#include "file_io.h"
+
+#include <fstream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//! MappedFile
+
+struct MappedFile::Mapping {
+  const unsigned char *data = nullptr;
+  size_t size = 0;
+#if defined(_WIN32)
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE handle = NULL;
+#endif
+
+  ~Mapping() {
+#if defined(_WIN32)
+    if (data)
+      UnmapViewOfFile(data);
+    if (handle)
+      CloseHandle(handle);
+    if (file != INVALID_HANDLE_VALUE)
+      CloseHandle(file);
+#else
+    if (data)
+      munmap(const_cast<unsigned char *>(data), size);
+#endif
+  }
+};
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+  auto m = std::make_shared<Mapping>();
+#if defined(_WIN32)
+  m->file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (m->file == INVALID_HANDLE_VALUE)
+    return;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m->file, &size) || size.QuadPart == 0)
+    return;
+  m->handle = CreateFileMappingW(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!m->handle)
+    return;
+  m->data = static_cast<const unsigned char *>(MapViewOfFile(m->handle, FILE_MAP_READ, 0, 0, 0));
+  if (!m->data)
+    return;
+  m->size = size.QuadPart;
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return;
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // The mapping keeps its own reference to the file
+  if (data == MAP_FAILED)
+    return;
+  m->data = static_cast<const unsigned char *>(data);
+  m->size = st.st_size;
+  // Files are usually read front to back once (hashing, decoding, uploading)
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+#endif
+  mapping = m;
+}
+const unsigned char *MappedFile::get_data() const { return mapping ? mapping->data : nullptr; }
+size_t MappedFile::get_size() const { return mapping ? mapping->size : 0; }
+
+//! Helpers
+
+std::optional<std::vector<unsigned char>> read_file(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return {};
+  std::error_code ec;
+  auto size = std::filesystem::file_size(path, ec);
+  if (ec)
+    return {};
+  std::vector<unsigned char> data(size);
+  if (!file.read(reinterpret_cast<char *>(data.data()), data.size()))
+    return {};
+  return data;
+}
+bool write_file_atomic(const std::filesystem::path &path, std::span<const unsigned char> data) {
+  auto tmp_path = path;
+  tmp_path += ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file)
+      return false;
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    if (!file)
+      return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (!ec)
+    return true;
+  std::filesystem::remove(tmp_path, ec);
+  return false;
+}
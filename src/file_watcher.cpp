@@ -0,0 +1,128 @@
+#include "file_watcher.h"
+
+#include "events.h"
+
+#include <spdlog/spdlog.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+//! FileWatcher
+
+std::filesystem::path FileWatcher::normalize(const std::filesystem::path &path) {
+  std::error_code ec;
+  auto abs = std::filesystem::absolute(path, ec);
+  return (ec ? path : abs).lexically_normal();
+}
+
+#if defined(__linux__)
+
+FileWatcher::FileWatcher() {
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    spdlog::warn("Failed to initialize inotify, external file changes won't be detected");
+}
+FileWatcher::~FileWatcher() {
+  if (fd >= 0)
+    close(fd);
+}
+void FileWatcher::watch(const std::filesystem::path &path) {
+  auto file = normalize(path);
+  if (!files.insert(file).second || fd < 0)
+    return;
+
+  auto dir = file.parent_path();
+  for (auto &pair : directories) {
+    if (pair.second == dir)
+      return;
+  }
+  // Editors often replace files instead of writing to them, so the
+  // directory is watched rather than the file itself
+  int wd = inotify_add_watch(fd, dir.c_str(),
+                             IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_ATTRIB);
+  if (wd < 0) {
+    spdlog::warn("Failed to watch directory {}", dir.string());
+    return;
+  }
+  directories[wd] = dir;
+}
+void FileWatcher::clear() {
+  for (auto &pair : directories)
+    inotify_rm_watch(fd, pair.first);
+  directories.clear();
+  files.clear();
+  pending.clear();
+}
+void FileWatcher::read_changes() {
+  if (fd < 0)
+    return;
+
+  alignas(inotify_event) char buffer[4096];
+  while (true) {
+    ssize_t len = read(fd, buffer, sizeof(buffer));
+    if (len <= 0)
+      break; // EAGAIN, nothing left to read
+
+    for (char *ptr = buffer; ptr < buffer + len;) {
+      auto *event = reinterpret_cast<inotify_event *>(ptr);
+      ptr += sizeof(inotify_event) + event->len;
+
+      auto it = directories.find(event->wd);
+      if (it == directories.end() || event->len == 0)
+        continue;
+      auto file = it->second / event->name;
+      if (files.contains(file))
+        pending[file] = Clock::now();
+    }
+  }
+}
+
+#else
+
+FileWatcher::FileWatcher() {}
+FileWatcher::~FileWatcher() {}
+void FileWatcher::watch(const std::filesystem::path &path) {
+  auto file = normalize(path);
+  if (!files.insert(file).second)
+    return;
+  std::error_code ec;
+  mtimes[file] = std::filesystem::last_write_time(file, ec);
+}
+void FileWatcher::clear() {
+  files.clear();
+  pending.clear();
+  mtimes.clear();
+}
+void FileWatcher::read_changes() {
+  auto now = Clock::now();
+  if (now - last_scan < POLL_INTERVAL)
+    return;
+  last_scan = now;
+
+  for (auto &pair : mtimes) {
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(pair.first, ec);
+    if (ec || mtime == pair.second)
+      continue;
+    pair.second = mtime;
+    pending[pair.first] = now;
+  }
+}
+
+#endif
+
+void FileWatcher::poll() {
+  read_changes();
+
+  auto now = Clock::now();
+  for (auto it = pending.begin(); it != pending.end();) {
+    if (now - it->second < QUIET_PERIOD) {
+      it++;
+      continue;
+    }
+    EventQueue::push(FileChanged(it->first));
+    it = pending.erase(it);
+  }
+}
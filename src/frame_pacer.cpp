@@ -0,0 +1,223 @@
+#include "frame_pacer.h"
+
+#include <glad/gl.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+#include "events.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <spdlog/spdlog.h>
+#include <thread>
+
+namespace {
+
+// Usage accumulated since a point in time
+struct Sample {
+  double wall_start = 0.0;
+  double cpu_start = 0.0;
+  int frames = 0;
+  double busy = 0.0;
+  double gpu = 0.0;
+};
+
+constexpr double SAMPLE_INTERVAL = 0.5;
+constexpr int QUERY_COUNT = 4;
+
+std::atomic<GLFWwindow *> window = nullptr;
+std::atomic<bool> redraw = true;
+double deadline = INFINITY;
+int settle_frames = FramePacer::SETTLE_FRAMES;
+bool idle_enabled = true;
+float max_fps = 0.0f;
+double last_frame = 0.0; // Target time of the last capped frame
+double frame_start = 0.0;
+
+// GPU time of UI frames, read back a few frames later to not stall
+GLuint queries[QUERY_COUNT] = {};
+bool in_flight[QUERY_COUNT] = {};
+int query_index = 0;
+bool query_active = false;
+
+Sample window_sample;
+FrameStats stats;
+
+int benchmark_phase = 0; // 0: none, 1: continuous, 2: idle
+double benchmark_seconds = 0.0;
+bool benchmark_saved_idle = true;
+Sample phase_sample;
+FrameStats continuous_stats;
+
+double process_cpu_time() {
+#if defined(_WIN32)
+  FILETIME creation, exit, kernel, user;
+  GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+  auto to_seconds = [](FILETIME t) {
+    return (double(t.dwHighDateTime) * 4294967296.0 + double(t.dwLowDateTime)) * 1e-7;
+  };
+  return to_seconds(kernel) + to_seconds(user);
+#else
+  return double(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+void reset(Sample &sample, double now) {
+  sample = Sample{now, process_cpu_time()};
+}
+FrameStats to_stats(const Sample &sample, double now) {
+  double wall = std::max(1e-6, now - sample.wall_start);
+  return FrameStats{
+      float(sample.frames / wall),
+      float(sample.busy / wall),
+      float((process_cpu_time() - sample.cpu_start) / wall),
+      float(sample.gpu / wall),
+  };
+}
+// OS sleeps overshoot by a millisecond or two, the rest of the time is yielded
+void sleep_until(double target) {
+  constexpr double SPIN_TIME = 0.002;
+  double remaining = target - glfwGetTime();
+  if (remaining > SPIN_TIME)
+    std::this_thread::sleep_for(std::chrono::duration<double>(remaining - SPIN_TIME));
+  while (glfwGetTime() < target)
+    std::this_thread::yield();
+}
+void collect_queries() {
+  for (int i = 0; i < QUERY_COUNT; i++) {
+    if (!in_flight[i])
+      continue;
+    GLint available = 0;
+    glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      continue;
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+    window_sample.gpu += elapsed * 1e-9;
+    phase_sample.gpu += elapsed * 1e-9;
+    in_flight[i] = false;
+  }
+}
+void update_benchmark(double now) {
+  if (benchmark_phase == 0 || now - phase_sample.wall_start < benchmark_seconds)
+    return;
+
+  FrameStats result = to_stats(phase_sample, now);
+  if (benchmark_phase == 1) {
+    continuous_stats = result;
+    benchmark_phase = 2;
+    idle_enabled = true;
+    reset(phase_sample, now);
+    return;
+  }
+
+  benchmark_phase = 0;
+  idle_enabled = benchmark_saved_idle;
+  auto &c = continuous_stats;
+  spdlog::info("Idle benchmark, continuous: {:.1f} fps, main thread {:.1f}%, CPU {:.1f}%, GPU "
+               "{:.1f}%",
+               c.fps, c.busy * 100, c.cpu * 100, c.gpu * 100);
+  spdlog::info("Idle benchmark, idle: {:.1f} fps, main thread {:.1f}%, CPU {:.1f}%, GPU {:.1f}%",
+               result.fps, result.busy * 100, result.cpu * 100, result.gpu * 100);
+  auto reduction = [](float before, float after) {
+    return before > 0.0f ? (1.0f - after / before) * 100.0f : 0.0f;
+  };
+  EventQueue::push(StatusMessage(fmt::format("Idling reduces CPU usage by {:.0f}%, GPU by {:.0f}%",
+                                             reduction(c.cpu, result.cpu),
+                                             reduction(c.gpu, result.gpu))));
+}
+
+} // namespace
+
+void FramePacer::init(GLFWwindow *main_window) {
+  window = main_window;
+  glGenQueries(QUERY_COUNT, queries);
+  double now = glfwGetTime();
+  reset(window_sample, now);
+  last_frame = now;
+}
+void FramePacer::shutdown() {
+  glDeleteQueries(QUERY_COUNT, queries);
+  window = nullptr;
+}
+void FramePacer::wait_events() {
+  if (max_fps > 0.0f) {
+    double target = last_frame + 1.0 / max_fps;
+    sleep_until(target);
+    last_frame = std::max(target, glfwGetTime() - 1.0 / max_fps); // Don't catch up on stalls
+  }
+
+  double now = glfwGetTime();
+  bool due = redraw.exchange(false) || settle_frames > 0 || now >= deadline || !idle_enabled;
+  if (due) {
+    glfwPollEvents();
+    settle_frames = std::max(0, settle_frames - 1);
+  } else {
+    double timeout = std::min(deadline - now, IDLE_TIMEOUT);
+    glfwWaitEventsTimeout(timeout);
+    // Woken up early by input rather than by the timeout
+    if (glfwGetTime() < now + timeout)
+      settle_frames = SETTLE_FRAMES;
+  }
+  deadline = INFINITY;
+}
+void FramePacer::begin_frame() {
+  frame_start = glfwGetTime();
+  collect_queries();
+  if (!in_flight[query_index]) {
+    glBeginQuery(GL_TIME_ELAPSED, queries[query_index]);
+    query_active = true;
+  }
+}
+void FramePacer::end_frame() {
+  if (query_active) {
+    glEndQuery(GL_TIME_ELAPSED);
+    in_flight[query_index] = true;
+    query_index = (query_index + 1) % QUERY_COUNT;
+    query_active = false;
+  }
+
+  double now = glfwGetTime();
+  for (Sample *sample : {&window_sample, &phase_sample}) {
+    sample->frames++;
+    sample->busy += now - frame_start;
+  }
+  if (now - window_sample.wall_start > SAMPLE_INTERVAL) {
+    stats = to_stats(window_sample, now);
+    reset(window_sample, now);
+  }
+  update_benchmark(now);
+}
+void FramePacer::request_redraw() {
+  if (!redraw.exchange(true) && window)
+    glfwPostEmptyEvent();
+}
+void FramePacer::request_frame_at(double time) { deadline = std::min(deadline, time); }
+void FramePacer::set_idle_enabled(bool enabled) { idle_enabled = enabled; }
+bool FramePacer::is_idle_enabled() { return idle_enabled; }
+void FramePacer::set_max_fps(float fps) { max_fps = std::max(0.0f, fps); }
+float FramePacer::get_max_fps() { return max_fps; }
+FrameStats FramePacer::get_stats() { return stats; }
+void FramePacer::start_benchmark(double seconds) {
+  if (benchmark_phase != 0)
+    return;
+  benchmark_seconds = seconds;
+  benchmark_saved_idle = idle_enabled;
+  benchmark_phase = 1;
+  idle_enabled = false;
+  reset(phase_sample, glfwGetTime());
+  spdlog::info("Idle benchmark started, leave the window alone for {:.0f}s", seconds * 2);
+}
+std::optional<float> FramePacer::get_benchmark_progress() {
+  if (benchmark_phase == 0)
+    return {};
+  double elapsed = glfwGetTime() - phase_sample.wall_start;
+  float phase = std::clamp(float(elapsed / benchmark_seconds), 0.0f, 1.0f);
+  return (benchmark_phase - 1 + phase) * 0.5f;
+}
@@ -1,5 +1,7 @@
 #include "geometry.h"
 
+#include "context_objects.h"
+
 #include <glad/gl.h>
 
 //! Geometry
@@ -18,20 +20,17 @@ std::shared_ptr<Geometry> Geometry::load(toml::table &table, std::shared_ptr<Ass
 
 //! ScreenQuadGeometry
 
-ScreenQuadGeometry::ScreenQuadGeometry(std::string name) {
-  this->name = name;
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
-
+ScreenQuadGeometry::ScreenQuadGeometry(std::string name) { this->name = name; }
+ScreenQuadGeometry::~ScreenQuadGeometry() { ContextObjects::release(this); }
+void ScreenQuadGeometry::create_buffers() {
   glGenBuffers(1, &vbo);
   glBindBuffer(GL_ARRAY_BUFFER, vbo);
   glBufferData(GL_ARRAY_BUFFER, sizeof(VERTICES), VERTICES, GL_STATIC_DRAW);
   glGenBuffers(1, &ebo);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(INDICES), INDICES, GL_STATIC_DRAW);
-
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-  glEnableVertexAttribArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 void ScreenQuadGeometry::compile_vertex_shader(GLuint &vert_shader) {
   vert_shader = glCreateShader(GL_VERTEX_SHADER);
@@ -40,12 +39,28 @@ void ScreenQuadGeometry::compile_vertex_shader(GLuint &vert_shader) {
   glCompileShader(vert_shader);
 }
 void ScreenQuadGeometry::draw_geometry() {
-  glBindVertexArray(vao);
+  if (vbo == 0)
+    create_buffers();
+
+  bool created;
+  glBindVertexArray(ContextObjects::get_vertex_array(this, created));
+  if (created) { // The vertex array keeps the buffers and the layout
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
   glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
   glBindVertexArray(0);
 }
 void ScreenQuadGeometry::destroy() {
+  if (vbo == 0)
+    return;
+  ContextObjects::release(this); // They refer to the buffers
   glDeleteBuffers(1, &vbo);
   glDeleteBuffers(1, &ebo);
-  glDeleteVertexArrays(1, &vao);
+  vbo = ebo = 0;
 }
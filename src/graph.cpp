@@ -1,8 +1,15 @@
 #include "graph.h"
 
 #include "events.h"
+#include "hash.h"
 #include "imnodes.h"
 #include "nodes.h"
+#include "render_thread.h"
+#include "shader_fusion.h"
+
+#include <algorithm>
+#include <set>
+#include <typeinfo>
 
 //! RenderGraph
 
@@ -27,6 +34,7 @@ int RenderGraph::insert_node(std::shared_ptr<Node> node) {
   node->id = nodeid;
   node->onEnter(*this);
   nodes.insert(std::make_pair(node->id, node));
+  invalidate();
   return nodeid;
 };
 int RenderGraph::insert_edge(int frompin, int topin) {
@@ -50,11 +58,13 @@ int RenderGraph::insert_edge(int frompin, int topin) {
   edge.from = frompin;
   edge.to = topin;
   edges.insert(std::make_pair(edge.id, edge));
+  invalidate();
   return edge.id;
 };
 void RenderGraph::delete_node(int nodeid) {
   nodes.at(nodeid)->onExit(*this);
   nodes.erase(nodes.find(nodeid));
+  invalidate();
 };
 void RenderGraph::delete_pin(int pinid) {
   std::vector<int> marked;
@@ -71,45 +81,291 @@ void RenderGraph::register_pin(int nodeid, DataType type, int *pinid) {
   *pinid = pin.id;
   pins.insert(std::make_pair(pin.id, pin));
 };
-Data RenderGraph::get_pin_data(int pinid) { return pins.at(pinid).data; };
-void RenderGraph::set_pin_data(int pinid, std::any ptr) {
-  std::vector<int> connected_pins;
-  for (auto &pair : edges) {
-    if (pair.second.from == pinid)
-      connected_pins.push_back(pair.second.to);
+Data RenderGraph::get_pin_data(int pinid) { return Data(pins.at(pinid).data.type); };
+std::shared_ptr<RenderGraph> RenderGraph::snapshot(std::shared_ptr<RenderGraph> graph,
+                                                   const RenderGraph *previous) {
+  auto copy = std::make_shared<RenderGraph>(*graph);
+  for (auto &pair : copy->nodes) {
+    pair.second->prepare(*graph);
+    pair.second = pair.second->clone();
   }
-  for (auto &cpin : connected_pins) {
-    this->pins.at(cpin).data.set(ptr);
+  copy->origin = graph;
+  copy->frozen = true;
+  if (previous && previous->get_origin() == graph) { // Tapes check the revision themselves
+    copy->tapes = previous->tapes;
+    copy->status = previous->status;
   }
+  return copy;
+}
+void RenderGraph::evaluate(EvalContext &context) {
+  auto lock = RenderThread::lock_evaluation();
+  for (int nodeid : begin_evaluation(context)) {
+    run_node(context, nodeid);
+    if (context.stopped)
+      break;
+  }
+  end_evaluation(context);
 };
-void RenderGraph::evaluate() {
-  topological_order();
-  should_stop = false;
-  bool is_empty = run_order.empty();
 
-  while (!run_order.empty()) {
-    int nodeid = run_order.back();
-    nodes.at(nodeid)->run(*this);
-    run_order.pop_back();
+namespace {
 
-    if (should_stop) {
-      break;
+uint64_t hash_overrides(const EvalContext &context) {
+  Hash hash;
+  for (auto &[pin, value] : context.overrides)
+    hash.add_value(pin).add_value(Register::from_data(value));
+  return hash.get();
+}
+
+// Buffers of the batches of run_tapes(), they only grow
+TapeState batch_state;
+
+} // namespace
+
+std::vector<int> RenderGraph::begin_evaluation(EvalContext &context, bool run_tape) {
+  context.pending_key = {revision, context.resolution, context.time, context.outputs,
+                         hash_overrides(context)};
+
+  // Several outputs are evaluated at once, nodes they share only run once
+  std::vector<int> roots;
+  if (context.outputs.empty()) {
+    if (auto root = get_root_node()) {
+      roots.push_back(root_node);
+      if (auto output = dynamic_cast<OutputNode *>(root.value()))
+        context.primary = output->get_name();
+    }
+  } else {
+    for (auto &name : context.outputs) {
+      if (auto id = find_output(name))
+        roots.push_back(id.value());
+    }
+    context.primary = context.outputs.front();
+  }
+
+  context.graph = this;
+  context.pin_values.clear();
+  context.images.clear();
+  context.pending.clear();
+  context.signatures.clear();
+  std::erase_if(context.feedback, [&](auto &pair) { return !nodes.contains(pair.first); });
+
+  // Values of the CPU-evaluable nodes are known before any pass runs
+  context.tape = compile(context, roots);
+  if (run_tape)
+    context.tape->run(context, context.tape_state);
+  for (auto &[nodeid, signature] : context.tape->folded)
+    context.signatures[nodeid] = signature;
+  for (int nodeid : context.tape->lowered)
+    context.signatures[nodeid] = sign_node(context, nodeid);
+
+  const std::vector<int> &passes = context.tape->passes;
+  context.fusion = fuse_shaders ? ShaderFusion::plan(*this, passes) : std::map<int, int>();
+  context.deferred.clear();
+  context.stopped = false;
+  return passes;
+}
+void RenderGraph::run_tapes(const std::vector<EvalContext *> &contexts) {
+  std::map<const Tape *, std::vector<EvalContext *>> batches;
+  for (auto context : contexts)
+    batches[context->tape.get()].push_back(context);
+
+  std::vector<const EvalContext *> batch;
+  std::vector<TapeState *> states;
+  for (auto &[tape, members] : batches) {
+    batch.assign(members.begin(), members.end());
+    states.clear();
+    for (auto context : members)
+      states.push_back(&context->tape_state);
+    tape->run_batch(batch.data(), states.data(), batch.size(), batch_state);
+  }
+}
+std::shared_ptr<const Tape> RenderGraph::compile(EvalContext &context,
+                                                 const std::vector<int> &roots) {
+  std::set<int> parameters;
+  for (auto &pair : context.overrides)
+    parameters.insert(pair.first);
+  auto key = std::make_pair(roots, parameters);
+
+  auto &cached = tapes[key];
+  if (cached && cached->revision == revision) {
+    Hash folded;
+    for (auto &pair : cached->folded)
+      folded.add_value(nodes.at(pair.first)->hash_context(context));
+    if (folded.get() == cached->folded_hash)
+      return cached;
+  }
+  std::erase_if(tapes,
+                [&](auto &pair) { return !pair.second || pair.second->revision != revision; });
+
+  auto tape = std::make_shared<Tape>();
+  tape->revision = revision;
+  TapeBuilder builder(*this, *tape, parameters);
+
+  // Nodes feeding several others are visited more than once, only their first run counts
+  std::vector<int> order = topological_order(roots);
+  std::set<int> seen;
+  Hash folded;
+  for (auto it = order.rbegin(); it != order.rend(); it++) {
+    int nodeid = *it;
+    if (!seen.insert(nodeid).second)
+      continue;
+    auto &node = nodes.at(nodeid);
+    size_t emitted = tape->code.size();
+    if (!node->lower(builder)) {
+      tape->passes.push_back(nodeid);
+    } else if (tape->code.size() == emitted) { // Nothing left to run per frame
+      // Only depends on the revision and the folded values, which key the tape
+      context.signatures[nodeid] = sign_node(context, nodeid);
+      tape->folded.emplace_back(nodeid, context.signatures[nodeid]);
+      folded.add_value(node->hash_context(context));
+    } else {
+      tape->lowered.push_back(nodeid);
     }
   }
+  tape->folded_hash = folded.get();
+  return tapes[key] = tape;
+}
+uint64_t RenderGraph::sign_node(EvalContext &context, int nodeid) {
+  auto &node = nodes.at(nodeid);
 
-  if (should_stop)
-    EventQueue::push(StatusMessage("Graph status: FAILED"));
-  else if (is_empty)
-    EventQueue::push(StatusMessage("Graph status: NO OUTPUT"));
+  // Pure nodes are identified by their type, so identical ones share a signature
+  Hash hash;
+  if (node->is_pure())
+    hash.add(typeid(*node).name());
   else
-    EventQueue::push(StatusMessage("Graph status: OK"));
-};
-void RenderGraph::clear_graph_data() {
-  run_order.clear();
-  for (auto &pin : pins) {
-    pin.second.data.reset();
+    hash.add_value(nodeid);
+  hash.add_value(revision).add_value(node->hash_context(context));
+  std::vector<int> layout = node->layout();
+  for (int pin : layout) { // Overridden outputs replace what the node computes
+    if (auto it = context.overrides.find(pin); it != context.overrides.end())
+      hash.add_value(Register::from_data(it->second));
   }
-};
+  // Inputs by position, pin ids differ between otherwise identical nodes
+  std::map<int, int> sources; // Input pin -> output pin connected to it
+  for (auto &pair : edges) {
+    if (pins.at(pair.second.to).node_id == nodeid)
+      sources[pair.second.to] = pair.second.from;
+  }
+  for (int pin : layout) {
+    auto it = sources.find(pin);
+    if (it == sources.end()) {
+      hash.add_value(uint64_t(0));
+      continue;
+    }
+    int source = pins.at(it->second).node_id;
+    auto source_layout = nodes.at(source)->layout();
+    auto index = std::find(source_layout.begin(), source_layout.end(), it->second);
+    hash.add_value(context.signatures[source]).add_value(index - source_layout.begin());
+  }
+  return hash.get();
+}
+NodeRun RenderGraph::run_node(EvalContext &context, int nodeid, bool allow_defer) {
+  auto &node = nodes.at(nodeid);
+  std::vector<int> layout = node->layout();
+  uint64_t signature = sign_node(context, nodeid);
+  context.signatures[nodeid] = signature;
+
+  NodeRun run = NodeRun::Ran;
+  auto result = this->results->find(signature);
+  if (result) { // Another context, the last evaluation or an identical node produced it
+    run = result->node_id == nodeid ? NodeRun::Reused : NodeRun::Deduplicated;
+    std::vector<int> source_layout =
+        run == NodeRun::Deduplicated ? nodes.at(result->node_id)->layout() : layout;
+    for (auto &[pin, value] : result->outputs) {
+      // Outputs of the identical node map to the same position in this one
+      auto index = std::find(source_layout.begin(), source_layout.end(), pin);
+      context.set_pin_data(layout.at(index - source_layout.begin()), value.data);
+    }
+    if (result->image)
+      context.images[result->image->first] = result->image->second;
+  } else if (allow_defer && context.fusion.contains(nodeid)) {
+    context.deferred.insert(nodeid);
+    return NodeRun::Deferred;
+  } else {
+    result = std::make_shared<NodeResult>();
+    result->signature = signature;
+    result->node_id = nodeid;
+    // Render targets are recycled unless another context still shows them
+    if (auto prev = context.results.find(nodeid);
+        prev != context.results.end() && prev->second.use_count() == 1) {
+      result->target = std::move(prev->second->target);
+      result->attachments = std::move(prev->second->attachments);
+    }
+
+    context.current = result;
+    node->run(context);
+    context.current = nullptr;
+    if (context.stopped)
+      return run;
+    this->results->insert(result);
+  }
+  context.pending[nodeid] = result;
+  return run;
+}
+void RenderGraph::end_evaluation(EvalContext &context) {
+  bool is_empty = context.pending.empty() && !context.stopped;
+  context.results = std::move(context.pending);
+  context.pending.clear();
+  context.signatures.clear();
+  context.fusion.clear();
+  context.deferred.clear();
+  context.graph = nullptr;
+  // Failed evaluations are kept as well, they would only fail again
+  context.last_key = std::move(context.pending_key);
+  context.pending_key.reset();
+  time = context.time;
+
+  // Sweeps evaluate hundreds of contexts in a row, which would flood the queue
+  std::string status = context.stopped ? "Graph status: FAILED"
+                       : is_empty      ? "Graph status: NO OUTPUT"
+                                       : "Graph status: OK";
+  if (status != this->status) {
+    this->status = status;
+    EventQueue::push(StatusMessage(status));
+  }
+}
+bool RenderGraph::on_asset_changed(AssetId<Asset> asset_id) {
+  bool depends = false;
+  for (auto &pair : nodes) {
+    if (!pair.second->uses_asset(asset_id))
+      continue;
+    pair.second->onAssetChanged(*this);
+    depends = true;
+  }
+  if (depends)
+    invalidate();
+  return depends;
+}
+bool RenderGraph::is_animated() const {
+  for (auto &pair : nodes) {
+    if (pair.second->is_animated())
+      return true;
+  }
+  return false;
+}
+bool RenderGraph::is_evaluated(const EvalContext &context) const {
+  if (!context.last_key)
+    return false;
+  auto &key = *context.last_key;
+  return key.revision == revision && key.resolution.x == context.resolution.x &&
+         key.resolution.y == context.resolution.y && key.outputs == context.outputs &&
+         key.overrides == hash_overrides(context) && (key.time == context.time || !is_animated());
+}
+std::optional<int> RenderGraph::find_output(const std::string &name) {
+  for (auto &pair : nodes) {
+    auto output = dynamic_cast<OutputNode *>(pair.second.get());
+    if (output && output->get_name() == name)
+      return pair.first;
+  }
+  return {};
+}
+std::vector<std::string> RenderGraph::get_output_names() {
+  std::vector<std::string> names;
+  for (auto &pair : nodes) {
+    if (auto output = dynamic_cast<OutputNode *>(pair.second.get()))
+      names.push_back(output->get_name());
+  }
+  return names;
+}
 void RenderGraph::set_node_positions(ImNodesEditorContext *context) {
   if (!context)
     return;
@@ -201,6 +457,7 @@ toml::table RenderGraph::save(std::filesystem::path) {
       {"next_node_id", next_node_id}, //
       {"next_edge_id", next_edge_id}, //
       {"next_pin_id", next_pin_id},   //
+      {"fuse_shaders", fuse_shaders}, //
   };
 }
 std::shared_ptr<RenderGraph> RenderGraph::load(toml::table &tbl,
@@ -211,6 +468,7 @@ std::shared_ptr<RenderGraph> RenderGraph::load(toml::table &tbl,
   graph.next_pin_id = tbl["next_pin_id"].value<int>().value();
   graph.next_edge_id = tbl["next_edge_id"].value<int>().value();
   graph.next_node_id = tbl["next_node_id"].value<int>().value();
+  graph.fuse_shaders = tbl["fuse_shaders"].value_or(false);
 
   // if-guards
   if (!tbl["pins"].is_array_of_tables())
@@ -0,0 +1,198 @@
+#include "graph_scheduler.h"
+
+#include "graph.h"
+#include "nodes.h"
+#include "render_target.h"
+#include "render_thread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Job {
+  std::shared_ptr<RenderGraph> graph;
+  EvalContext *context;
+  std::vector<int> order = {}; // Nodes to run, inputs first
+  std::map<int, int> depths = {};
+  GraphCost cost = {};
+};
+// A node of a job, ordered within its wave by key
+struct Pass {
+  size_t job;
+  size_t index; // Position in the run order of the job
+  int nodeid;
+  uint64_t key;
+};
+struct CostEntry {
+  std::weak_ptr<RenderGraph> graph;
+  GraphCost cost;
+  int age = 0; // Batches since the graph was evaluated last
+};
+
+// Weight of the latest batch in the averaged CPU time
+constexpr float COST_SMOOTHING = 0.2f;
+// Costs of graphs not evaluated for this many batches are dropped
+constexpr int COST_MAX_AGE = 120;
+
+// Each thread flushes the contexts it submitted
+thread_local std::vector<Job> jobs;
+std::mutex stats_mutex; // Guards costs and stats, which the UI reads while evaluating
+std::map<const RenderGraph *, CostEntry> costs;
+BatchStats stats;
+
+// Longest path from a node to the leaves, nodes only depend on lower depths
+std::map<int, int> node_depths(RenderGraph &graph, const std::vector<int> &order) {
+  std::map<int, int> depths;
+  for (int nodeid : order) {
+    int depth = 0;
+    std::vector<int> children;
+    graph.get_children(nodeid, children);
+    for (int child : children) {
+      if (auto it = depths.find(child); it != depths.end())
+        depth = std::max(depth, it->second + 1);
+    }
+    depths[nodeid] = depth;
+  }
+  return depths;
+}
+int count_binds(const std::vector<Pass> &passes) {
+  int binds = 0;
+  uint64_t bound = 0;
+  for (auto &pass : passes) {
+    if (pass.key != 0 && pass.key != bound) {
+      binds++;
+      bound = pass.key;
+    }
+  }
+  return binds;
+}
+void update_costs(std::vector<Job> &batch) {
+  for (auto &pair : costs)
+    pair.second.age++;
+
+  // Contexts of the same graph add up, snapshots count towards the graph they were taken of
+  std::map<const RenderGraph *, CostEntry> latest;
+  for (auto &job : batch) {
+    auto graph = job.graph->is_snapshot() ? job.graph->get_origin() : job.graph;
+    if (!graph)
+      continue;
+    auto &entry = latest[graph.get()];
+    entry.graph = graph;
+    entry.cost.contexts++;
+    entry.cost.runs += job.cost.runs;
+    entry.cost.reused += job.cost.reused;
+    entry.cost.deduped += job.cost.deduped;
+    entry.cost.cpu += job.cost.cpu;
+  }
+  for (auto &[ptr, entry] : latest) {
+    // The address may belong to a graph deleted in the meantime
+    if (auto it = costs.find(ptr); it != costs.end() && !it->second.graph.expired()) {
+      float previous = it->second.cost.cpu;
+      entry.cost.cpu = previous + (entry.cost.cpu - previous) * COST_SMOOTHING;
+    }
+    costs[ptr] = entry;
+  }
+  std::erase_if(costs, [](auto &pair) {
+    return pair.second.age > COST_MAX_AGE || pair.second.graph.expired();
+  });
+}
+
+} // namespace
+
+void GraphScheduler::submit(std::shared_ptr<RenderGraph> graph, EvalContext &context) {
+  if (graph->is_evaluated(context))
+    return;
+  for (auto &job : jobs) {
+    if (job.context == &context) {
+      job.graph = graph;
+      return;
+    }
+  }
+  jobs.push_back(Job{graph, &context});
+}
+void GraphScheduler::flush() {
+  if (jobs.empty())
+    return;
+  std::vector<Job> batch = std::move(jobs);
+  jobs.clear();
+  auto lock = RenderThread::lock_evaluation();
+
+  int max_depth = -1;
+  std::vector<EvalContext *> contexts;
+  for (auto &job : batch) {
+    job.order = job.graph->begin_evaluation(*job.context, false);
+    job.depths = node_depths(*job.graph, job.order);
+    for (auto &pair : job.depths)
+      max_depth = std::max(max_depth, pair.second);
+    contexts.push_back(job.context);
+  }
+  // Values of the lowered nodes are known before any pass runs
+  RenderGraph::run_tapes(contexts);
+
+  std::vector<Pass> ran;
+  for (int depth = 0; depth <= max_depth; depth++) {
+    std::vector<Pass> wave;
+    for (size_t j = 0; j < batch.size(); j++) {
+      auto &job = batch[j];
+      for (size_t i = 0; i < job.order.size(); i++) {
+        int nodeid = job.order[i];
+        if (job.depths[nodeid] == depth)
+          wave.push_back(Pass{j, i, nodeid, job.graph->get_node(nodeid)->pass_key()});
+      }
+    }
+    // Stable, so passes of one graph keep their relative order
+    std::stable_sort(wave.begin(), wave.end(),
+                     [](const Pass &a, const Pass &b) { return a.key < b.key; });
+
+    for (auto &pass : wave) {
+      auto &job = batch[pass.job];
+      if (job.context->is_failed())
+        continue;
+      auto start = std::chrono::steady_clock::now();
+      NodeRun run = job.graph->run_node(*job.context, pass.nodeid);
+      std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+      job.cost.cpu += elapsed.count();
+      if (run == NodeRun::Ran) {
+        job.cost.runs++;
+        ran.push_back(pass);
+      } else if (run == NodeRun::Reused) {
+        job.cost.reused++;
+      } else if (run == NodeRun::Deduplicated) {
+        job.cost.deduped++;
+      }
+    }
+  }
+  for (auto &job : batch)
+    job.graph->end_evaluation(*job.context);
+
+  std::lock_guard stats_lock(stats_mutex);
+  stats.passes = int(ran.size());
+  stats.deduped = 0;
+  for (auto &job : batch)
+    stats.deduped += job.cost.deduped;
+  stats.binds = count_binds(ran);
+  std::sort(ran.begin(), ran.end(), [](const Pass &a, const Pass &b) {
+    return a.job != b.job ? a.job < b.job : a.index < b.index;
+  });
+  stats.unbatched_binds = count_binds(ran);
+
+  update_costs(batch);
+  stats.graphs = 0;
+  for (auto &pair : costs)
+    stats.graphs += pair.second.age == 0;
+  stats.idle_targets = RenderTargetPool::get_idle_count();
+}
+std::optional<GraphCost> GraphScheduler::get_cost(const RenderGraph *graph) {
+  std::lock_guard lock(stats_mutex);
+  if (auto it = costs.find(graph); it != costs.end())
+    return it->second.cost;
+  return {};
+}
+BatchStats GraphScheduler::get_stats() {
+  std::lock_guard lock(stats_mutex);
+  return stats;
+}
@@ -0,0 +1,309 @@
+#include "jobs.h"
+#include "events.h"
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <thread>
+
+struct JobState {
+  std::function<void()> fn;
+  bool main_thread = false;
+  // Unfinished dependencies, plus one until the job is fully submitted
+  std::atomic<size_t> pending = 1;
+  std::atomic<bool> done = false;
+
+  std::mutex mutex; // Guards continuations against finishing concurrently
+  std::vector<std::shared_ptr<JobState>> continuations = {};
+};
+
+namespace {
+
+struct Worker {
+  std::mutex mutex;
+  std::deque<std::shared_ptr<JobState>> jobs;
+};
+
+struct Scheduler {
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  std::thread::id main_id;
+
+  std::mutex main_mutex;
+  std::deque<std::shared_ptr<JobState>> main_jobs;
+
+  // Idle threads sleep until jobs are queued or finished
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  std::atomic<size_t> queued = 0;
+  std::atomic<size_t> next_worker = 0;
+  std::atomic<bool> stopping = false;
+};
+
+Scheduler scheduler;
+thread_local int worker_index = -1;
+
+void notify() {
+  { std::lock_guard lock(scheduler.sleep_mutex); }
+  scheduler.wake.notify_all();
+}
+
+void run(std::shared_ptr<JobState> job);
+
+void enqueue(std::shared_ptr<JobState> job) {
+  if (job->main_thread) {
+    std::lock_guard lock(scheduler.main_mutex);
+    scheduler.main_jobs.push_back(job);
+    FramePacer::request_redraw();
+    return;
+  }
+  if (scheduler.workers.empty()) { // Not initialized, run synchronously
+    run(job);
+    return;
+  }
+
+  // Workers keep their own jobs, other threads spread them round robin
+  size_t index = worker_index >= 0 ? worker_index
+                                   : scheduler.next_worker++ % scheduler.workers.size();
+  {
+    auto &worker = *scheduler.workers[index];
+    std::lock_guard lock(worker.mutex);
+    worker.jobs.push_back(job);
+  }
+  scheduler.queued++;
+  notify();
+}
+// Pops the newest job of the own deque or steals the oldest job of another
+std::shared_ptr<JobState> pop(int self) {
+  size_t count = scheduler.workers.size();
+  if (self >= 0) {
+    auto &worker = *scheduler.workers[self];
+    std::lock_guard lock(worker.mutex);
+    if (!worker.jobs.empty()) {
+      auto job = worker.jobs.back();
+      worker.jobs.pop_back();
+      scheduler.queued--;
+      return job;
+    }
+  }
+  for (size_t i = 0; i < count; i++) {
+    size_t victim = (self + 1 + i) % count;
+    if (int(victim) == self)
+      continue;
+    auto &worker = *scheduler.workers[victim];
+    std::lock_guard lock(worker.mutex);
+    if (!worker.jobs.empty()) {
+      auto job = worker.jobs.front();
+      worker.jobs.pop_front();
+      scheduler.queued--;
+      return job;
+    }
+  }
+  return nullptr;
+}
+std::shared_ptr<JobState> pop_main() {
+  std::lock_guard lock(scheduler.main_mutex);
+  if (scheduler.main_jobs.empty())
+    return nullptr;
+  auto job = scheduler.main_jobs.front();
+  scheduler.main_jobs.pop_front();
+  return job;
+}
+void run(std::shared_ptr<JobState> job) {
+  try {
+    job->fn();
+  } catch (const std::exception &e) {
+    spdlog::error("Uncaught exception in job: {}", e.what());
+  }
+  job->fn = nullptr; // Release captures early
+
+  std::vector<std::shared_ptr<JobState>> continuations;
+  {
+    std::lock_guard lock(job->mutex);
+    job->done = true;
+    continuations.swap(job->continuations);
+  }
+  for (auto &next : continuations) {
+    if (--next->pending == 0)
+      enqueue(next);
+  }
+  notify(); // Wakes threads waiting on the job
+}
+void worker_loop(int index) {
+  worker_index = index;
+  while (true) {
+    if (auto job = pop(index)) {
+      run(job);
+      continue;
+    }
+    std::unique_lock lock(scheduler.sleep_mutex);
+    scheduler.wake.wait(lock, [] { return scheduler.queued > 0 || scheduler.stopping; });
+    if (scheduler.stopping && scheduler.queued == 0)
+      return;
+  }
+}
+
+} // namespace
+
+//! Job
+
+bool Job::is_done() const { return !state || state->done; }
+void Job::wait() const {
+  while (!is_done()) {
+    // Help out instead of blocking, the job may depend on queued work
+    if (Jobs::is_main_thread()) {
+      if (auto job = pop_main()) {
+        run(job);
+        continue;
+      }
+    }
+    if (auto job = pop(worker_index)) {
+      run(job);
+      continue;
+    }
+    std::unique_lock lock(scheduler.sleep_mutex);
+    scheduler.wake.wait_for(lock, std::chrono::milliseconds(1),
+                            [&] { return is_done() || scheduler.queued > 0; });
+  }
+}
+
+//! Jobs
+
+void Jobs::init(unsigned int threads) {
+  scheduler.main_id = std::this_thread::get_id();
+  if (threads == 0) {
+    unsigned int cores = std::thread::hardware_concurrency();
+    threads = cores > 1 ? cores - 1 : 1;
+  }
+
+  for (unsigned int i = 0; i < threads; i++)
+    scheduler.workers.push_back(std::make_unique<Worker>());
+  for (unsigned int i = 0; i < threads; i++)
+    scheduler.threads.emplace_back(worker_loop, int(i));
+  spdlog::info("Started {} worker threads", threads);
+}
+void Jobs::shutdown() {
+  scheduler.stopping = true;
+  notify();
+  for (auto &thread : scheduler.threads)
+    thread.join();
+  scheduler.threads.clear();
+  scheduler.workers.clear();
+  run_main();
+}
+unsigned int Jobs::get_thread_count() { return scheduler.workers.size(); }
+bool Jobs::is_main_thread() { return std::this_thread::get_id() == scheduler.main_id; }
+Job Jobs::schedule(std::function<void()> fn, std::vector<Job> deps, bool main_thread) {
+  auto job = std::make_shared<JobState>();
+  job->fn = std::move(fn);
+  job->main_thread = main_thread;
+  job->pending = deps.size() + 1;
+
+  for (auto &dep : deps) {
+    bool done = true;
+    if (dep.state) {
+      std::lock_guard lock(dep.state->mutex);
+      if (!(done = dep.state->done))
+        dep.state->continuations.push_back(job);
+    }
+    if (done)
+      job->pending--;
+  }
+  if (--job->pending == 0)
+    enqueue(job);
+  return Job(job);
+}
+Job Jobs::submit(std::function<void()> fn, std::vector<Job> deps) {
+  return schedule(std::move(fn), std::move(deps), false);
+}
+Job Jobs::submit_main(std::function<void()> fn, std::vector<Job> deps) {
+  return schedule(std::move(fn), std::move(deps), true);
+}
+Job Jobs::parallel_for(size_t count, std::function<void(size_t)> fn, std::vector<Job> deps,
+                       unsigned int workers) {
+  // A few chunks per thread balance uneven iterations without much overhead
+  size_t chunks = workers > 0 ? workers : std::max<size_t>(1, get_thread_count() * 4);
+  size_t chunk_size = std::max<size_t>(1, (count + chunks - 1) / chunks);
+
+  auto shared_fn = std::make_shared<std::function<void(size_t)>>(std::move(fn));
+  std::vector<Job> jobs;
+  for (size_t begin = 0; begin < count; begin += chunk_size) {
+    size_t end = std::min(count, begin + chunk_size);
+    jobs.push_back(submit(
+        [shared_fn, begin, end] {
+          for (size_t i = begin; i < end; i++)
+            (*shared_fn)(i);
+        },
+        deps));
+  }
+  if (jobs.empty())
+    return when_all(std::move(deps));
+  return when_all(std::move(jobs));
+}
+void Jobs::run_main() {
+  // Jobs queued by main thread jobs run next frame
+  size_t count;
+  {
+    std::lock_guard lock(scheduler.main_mutex);
+    count = scheduler.main_jobs.size();
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (auto job = pop_main())
+      run(job);
+  }
+}
+void Jobs::benchmark(size_t iterations) {
+  static std::atomic<bool> running = false;
+  if (running.exchange(true)) {
+    EventQueue::push(StatusMessage("The job scaling benchmark is already running"));
+    return;
+  }
+
+  // Runs as a job itself, waiting on parallel_for() helps the workers instead of blocking
+  submit([iterations] {
+    // Independent iterations of pure arithmetic, only the results are shared
+    std::vector<uint64_t> results(iterations);
+    auto work = [&](size_t i) {
+      uint64_t x = i + 1;
+      for (int step = 0; step < 20000; step++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+      }
+      results[i] = x;
+    };
+    // Best of a few runs, the first one also warms up the workers
+    auto time = [&](unsigned int workers) {
+      EventQueue::push(StatusMessage(
+          fmt::format("Benchmarking job scaling with {} workers...", workers)));
+      double best = 0.0;
+      for (int run = 0; run < 3; run++) {
+        auto start = std::chrono::steady_clock::now();
+        parallel_for(iterations, work, {}, workers).wait();
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        if (run == 0 || elapsed.count() < best)
+          best = elapsed.count();
+      }
+      return best;
+    };
+
+    unsigned int threads = std::max(get_thread_count(), 1u);
+    double single = time(1);
+    std::string summary;
+    for (unsigned int workers = 1; workers <= threads; workers++) {
+      double ms = workers == 1 ? single : time(workers);
+      double speedup = single / ms;
+      spdlog::info("Job scaling with {} workers: {:.2f} ms, {:.2f}x speedup ({:.0f}% efficiency)",
+                   workers, ms, speedup, 100.0 * speedup / workers);
+      summary += fmt::format(" {}:{:.2f}x", workers, speedup);
+    }
+    EventQueue::push(StatusMessage(fmt::format("Job scaling speedup by workers:{}", summary)));
+    running = false;
+  });
+}
@@ -19,6 +19,7 @@ static HINSTANCE WindowsHInstance;
 #include "IconsFontAwesome6.h"
 #include "app.h"
 #include "editor.h"
+#include "frame_pacer.h"
 #include "theme.h"
 
 static void glfw_error_callback(int error, const char *description) {
@@ -116,12 +117,15 @@ int AppMain() {
   }
 
   Global::instance().init();
+  Jobs::init();
+  FramePacer::init(window);
   App app = App();
 
   // Main loop
   bool first_frame = true;
   while (!glfwWindowShouldClose(window)) {
-    glfwPollEvents();
+    // Blocks while nothing needs to be redrawn
+    FramePacer::wait_events();
 
     // Sleep if minimized
     if (glfwGetWindowAttrib(window, GLFW_ICONIFIED) != 0) {
@@ -129,6 +133,8 @@ int AppMain() {
       continue;
     }
 
+    FramePacer::begin_frame();
+
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -162,11 +168,15 @@ int AppMain() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
+    FramePacer::end_frame();
     glfwSwapBuffers(window);
   }
 
+  RenderThread::stop();
   app.shutdown();
+  Jobs::shutdown(); // Lets pending saves finish while spdlog is still alive
   Global::instance().shutdown();
+  FramePacer::shutdown();
 
   ImNodes::DestroyContext();
   zep_destroy();
@@ -0,0 +1,143 @@
+#include "nodes/blur_nodes.h"
+
+#include "graph.h"
+#include "imnodes.h"
+#include "render_target.h"
+
+namespace {
+
+// Intermediate targets of the running node, recycled by its next run
+Blur::Targets node_targets(EvalContext &context) {
+  return [&context](size_t index, int width, int height) -> RenderTarget & {
+    return context.get_target(width, height, GL_RGB8, index);
+  };
+}
+
+} // namespace
+
+//! BlurNode
+
+void BlurNode::render_node(const char *title) {
+  ImNodes::BeginNode(id);
+
+  ImNodes::BeginNodeTitleBar();
+  ImGui::TextUnformatted(title);
+  ImNodes::EndNodeTitleBar();
+
+  {
+    BEGIN_OUTPUT_PIN(output_pin, DataType::Texture2D);
+    ImGui::Indent(node_width - ImGui::CalcTextSize("Image").x);
+    ImGui::Text("Image");
+    END_OUTPUT_PIN();
+  }
+  {
+    BEGIN_INPUT_PIN(input_pin, DataType::Texture2D);
+    ImGui::Text("Image");
+    END_INPUT_PIN();
+  }
+  ImGui::SetNextItemWidth(node_width);
+  ImGui::DragFloat("##radius", &radius, 0.5f, 0.0f, 1024.0f, "Radius %.1f",
+                   ImGuiSliderFlags_AlwaysClamp);
+
+  ImNodes::EndNode();
+}
+void BlurNode::run_blur(EvalContext &context, Blurring blur) {
+  auto input = context.get_pin_data(input_pin).try_get<Data::Texture2D>();
+  if (!input || *input == 0) // Nothing is connected
+    return;
+  auto &graph = context.get_graph();
+  auto result = blur(node_targets(context), graph.graph_geometry, *input, context.resolution.x,
+                     context.resolution.y, radius);
+  if (!result)
+    return context.stop();
+  context.set_pin_data(output_pin, (Data::Texture2D)result->get_texture());
+}
+toml::table BlurNode::save_node(const char *type) {
+  return toml::table{
+      {"type", type},                //
+      {"node_id", id},               //
+      {"position", Node::save(pos)}, //
+      {"input_pin", input_pin},      //
+      {"output_pin", output_pin},    //
+      {"radius", radius},            //
+  };
+}
+void BlurNode::load_node(toml::table &tbl) {
+  id = tbl["node_id"].value<int>().value();
+  pos = Node::load_pos(*tbl["position"].as_table());
+  input_pin = tbl["input_pin"].value<int>().value();
+  output_pin = tbl["output_pin"].value<int>().value();
+  radius = tbl["radius"].value_or(8.0f);
+}
+void BlurNode::onEnter(RenderGraph &graph) {
+  graph.register_pin(id, DataType::Texture2D, &input_pin);
+  graph.register_pin(id, DataType::Texture2D, &output_pin);
+}
+void BlurNode::onExit(RenderGraph &graph) {
+  graph.delete_pin(input_pin);
+  graph.delete_pin(output_pin);
+}
+uint64_t BlurNode::hash_context(const EvalContext &context) const {
+  return Hash()
+      .add_value(radius)
+      .add_value(context.resolution.x)
+      .add_value(context.resolution.y)
+      .get();
+}
+
+//! MipChainNode
+
+void MipChainNode::render(RenderGraph &) {
+  ImNodes::BeginNode(id);
+
+  ImNodes::BeginNodeTitleBar();
+  ImGui::TextUnformatted("Mip Chain");
+  ImNodes::EndNodeTitleBar();
+
+  {
+    BEGIN_OUTPUT_PIN(output_pin, DataType::Texture2D);
+    ImGui::Indent(node_width - ImGui::CalcTextSize("Image").x);
+    ImGui::Text("Image");
+    END_OUTPUT_PIN();
+  }
+  {
+    BEGIN_OUTPUT_PIN(levels_pin, DataType::Int);
+    ImGui::Indent(node_width - ImGui::CalcTextSize("Levels").x);
+    ImGui::Text("Levels");
+    END_OUTPUT_PIN();
+  }
+  {
+    BEGIN_INPUT_PIN(input_pin, DataType::Texture2D);
+    ImGui::Text("Image");
+    END_INPUT_PIN();
+  }
+
+  ImNodes::EndNode();
+}
+void MipChainNode::onEnter(RenderGraph &graph) {
+  graph.register_pin(id, DataType::Texture2D, &input_pin);
+  graph.register_pin(id, DataType::Texture2D, &output_pin);
+  graph.register_pin(id, DataType::Int, &levels_pin);
+}
+void MipChainNode::onExit(RenderGraph &graph) {
+  graph.delete_pin(input_pin);
+  graph.delete_pin(output_pin);
+  graph.delete_pin(levels_pin);
+}
+void MipChainNode::run(EvalContext &context) {
+  auto input = context.get_pin_data(input_pin).try_get<Data::Texture2D>();
+  if (!input || *input == 0) // Nothing is connected
+    return;
+  // The input belongs to another node, so the levels are generated on a copy
+  auto &graph = context.get_graph();
+  auto target = Blur::copy(node_targets(context), graph.graph_geometry, *input,
+                           context.resolution.x, context.resolution.y);
+  if (!target)
+    return context.stop();
+  target->generate_mipmaps();
+  context.set_pin_data(output_pin, (Data::Texture2D)target->get_texture());
+  context.set_pin_data(levels_pin, (Data::Int)target->get_levels());
+}
+uint64_t MipChainNode::hash_context(const EvalContext &context) const {
+  return Hash().add_value(context.resolution.x).add_value(context.resolution.y).get();
+}
@@ -0,0 +1,320 @@
+#include "nodes/compute_nodes.h"
+
+#include "events.h"
+#include "graph.h"
+#include "imnodes.h"
+#include "render_target.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <glad/gl.h>
+#include <imgui_stdlib.h>
+
+#include "IconsFontAwesome6.h"
+
+namespace {
+
+// Logs once and outputs nothing, so the graph keeps rendering without the node
+bool check_support(EvalContext &context, int output_pin) {
+  if (Compute::is_supported())
+    return true;
+  static bool should_warn = true;
+  if (should_warn)
+    spdlog::warn(Compute::get_fallback_message());
+  should_warn = false;
+  context.set_pin_data(output_pin, (Data::Texture2D)0);
+  return false;
+}
+void render_fallback(float width) {
+  if (Compute::is_supported())
+    return;
+  ImGui::PushTextWrapPos(ImGui::GetCursorPosX() + width);
+  ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s",
+                     Compute::get_fallback_message().c_str());
+  ImGui::PopTextWrapPos();
+}
+
+} // namespace
+
+//! ComputeShaderNode
+
+int ComputeShaderNode::add_uniform_pin(RenderGraph &graph, DataType type, std::string name) {
+  int pinid;
+  graph.register_pin(id, type, &pinid);
+  uniform_pins.push_back(UniformPin{
+      .pinid = pinid,
+      .type = type,
+      .identifier = name,
+  });
+  return pinid;
+}
+void ComputeShaderNode::render(RenderGraph &graph) {
+  ImNodes::BeginNode(id);
+
+  ImNodes::BeginNodeTitleBar();
+  ImGui::TextUnformatted("ComputeShader");
+  ImGui::SameLine();
+  ImGui::Indent(node_width - ImGui::CalcTextSize(" + ").x);
+  if (ImGui::Button(" + "))
+    ImGui::OpenPopup("add_uniform_popup");
+  ImNodes::EndNodeTitleBar();
+
+  render_fallback(node_width);
+
+  ImGui::Text("Source");
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(node_width - ImGui::CalcTextSize("Source").x);
+
+  auto shader = this->shader.lock();
+  if (ImGui::BeginCombo("##hidelabel", bool(shader) ? shader->get_name().c_str() : "")) {
+    auto shaders = this->shaders.lock();
+
+    assert(shaders && "Shader assets not initialized!");
+
+    for (auto const &pair : *shaders) {
+      ImGui::PushID(pair.first);
+      bool is_selected = (shader) && (shader_id == pair.first);
+      if (ImGui::Selectable(pair.second->get_name().c_str(), is_selected)) {
+        this->shader_id = pair.first;
+        this->shader = pair.second;
+      }
+      if (is_selected)
+        ImGui::SetItemDefaultFocus();
+      ImGui::PopID();
+    }
+    ImGui::EndCombo();
+  }
+
+  ImGui::Text("Size");
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(node_width - ImGui::CalcTextSize("Size").x - 80.0f);
+  if (ImGui::BeginCombo("##size", size_from.empty() ? "Viewport" : size_from.c_str())) {
+    if (ImGui::Selectable("Viewport", size_from.empty()))
+      size_from.clear();
+    for (auto &pin : uniform_pins) {
+      if (pin.type != DataType::Texture2D)
+        continue;
+      ImGui::PushID(pin.pinid);
+      if (ImGui::Selectable(pin.identifier.c_str(), size_from == pin.identifier))
+        size_from = pin.identifier;
+      ImGui::PopID();
+    }
+    ImGui::EndCombo();
+  }
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(80.0f);
+  ImGui::DragFloat("##scale", &scale, 0.01f, 1.0f / 16.0f, 4.0f, "x%.3g",
+                   ImGuiSliderFlags_AlwaysClamp);
+  if (ImGui::IsItemHovered())
+    ImGui::SetTooltip("Scales the size of the output, one invocation runs per pixel");
+  ImGui::SetNextItemWidth(node_width);
+  ImGui::DragInt("##buffer_size", &buffer_size, 16.0f, 1, MAX_BUFFER_SIZE, "Buffer %d floats",
+                 ImGuiSliderFlags_AlwaysClamp);
+  if (ImGui::IsItemHovered())
+    ImGui::SetTooltip("Storage buffer at binding 0, cleared to zero every run");
+
+  {
+    BEGIN_OUTPUT_PIN(output_pin, DataType::Texture2D);
+    ImGui::Indent(node_width - ImGui::CalcTextSize("Image").x);
+    ImGui::Text("Image");
+    END_OUTPUT_PIN();
+  }
+
+  if (ImGui::BeginPopup("add_uniform_popup")) { // Creation logic
+    ImGui::SeparatorText("Uniforms");
+    for (auto &type : Data::ALL) {
+      if (ImGui::MenuItem(Data::type_name(type))) {
+        add_uniform_pin(graph, type, fmt::format("u_{}", Data::type_name(type)));
+      }
+    }
+    ImGui::EndPopup();
+  }
+
+  { // Render uniforms + delete logic
+    std::vector<int> marked;
+    int idx = 0;
+    for (auto &pin : uniform_pins) {
+      BEGIN_INPUT_PIN(pin.pinid, pin.type)
+
+      ImGui::Text("%s", Data::type_name(pin.type));
+      ImGui::SameLine();
+
+      ImGui::SetNextItemWidth(node_width - 6 - ImGui::CalcTextSize(ICON_FA_MINUS).x -
+                              ImGui::CalcTextSize(Data::type_name(pin.type)).x);
+      ImGui::InputText("##hidelabel", &pin.identifier);
+
+      ImGui::SameLine();
+      ImGui::Indent(node_width - ImGui::CalcTextSize(ICON_FA_MINUS).x);
+      if (ImGui::Button(ICON_FA_MINUS)) {
+        marked.push_back(idx);
+      }
+
+      END_INPUT_PIN();
+      idx++;
+    }
+    for (auto &i : marked) {
+      graph.delete_pin(uniform_pins[i].pinid);
+      uniform_pins.erase(uniform_pins.begin() + i);
+    }
+  }
+
+  ImNodes::EndNode();
+}
+void ComputeShaderNode::onEnter(RenderGraph &graph) {
+  graph.register_pin(id, DataType::Texture2D, &output_pin);
+  // If preconfigured using clone()
+  for (auto &pin : uniform_pins)
+    graph.register_pin(id, pin.type, &pin.pinid);
+}
+void ComputeShaderNode::onExit(RenderGraph &graph) {
+  graph.delete_pin(output_pin);
+  for (auto &pin : uniform_pins)
+    graph.delete_pin(pin.pinid);
+}
+std::shared_ptr<Shader> ComputeShaderNode::get_compiled_shader(RenderGraph &graph) {
+  auto shader = this->shader.lock();
+  if (!shader || (shader->is_compiled() && shader->is_compute()))
+    return shader;
+  if (graph.is_snapshot()) // Failed to compile in prepare() already
+    return nullptr;
+
+  static bool should_error = true;
+  if (!shader->compile_compute()) {
+    if (should_error) {
+      spdlog::error(shader->get_log());
+      EventQueue::push(CompileFinished(shader_id, false, shader->get_log()));
+    }
+    should_error = false; // Don't error next time
+    return nullptr;
+  }
+  should_error = true;
+  EventQueue::push(CompileFinished(shader_id, true));
+  return shader;
+}
+void ComputeShaderNode::get_dispatch_size(EvalContext &context, int &width, int &height) {
+  width = context.resolution.x, height = context.resolution.y;
+  if (!size_from.empty()) {
+    auto pin = std::find_if(uniform_pins.begin(), uniform_pins.end(),
+                            [&](auto &pin) { return pin.identifier == size_from; });
+    auto texture = pin != uniform_pins.end()
+                       ? context.get_pin_data(pin->pinid).try_get<Data::Texture2D>()
+                       : std::nullopt;
+    if (!texture || !Compute::get_size(*texture, width, height)) {
+      width = height = 0;
+      return;
+    }
+  }
+  width = std::max(int(width * scale), 1);
+  height = std::max(int(height * scale), 1);
+}
+void ComputeShaderNode::run(EvalContext &context) {
+  if (!check_support(context, output_pin))
+    return;
+  auto shader = get_compiled_shader(context.get_graph());
+  if (!shader)
+    return context.stop();
+
+  int width, height;
+  get_dispatch_size(context, width, height);
+  if (width == 0) // The input isn't connected
+    return;
+  auto &target = context.get_target(width, height, OUTPUT_FORMAT);
+  if (!target.begin()) // Pixels the shader skips stay black
+    return context.stop();
+  target.end();
+
+  shader->use();
+  for (auto &pin : uniform_pins) {
+    Data data = context.get_pin_data(pin.pinid);
+    auto texture = data.try_get<Data::Texture2D>();
+    if (!data || (data.type == DataType::Texture2D && (!texture || *texture == 0)))
+      continue; // Nothing is connected
+    shader->set_uniform(pin.identifier.c_str(), data);
+  }
+  glBindImageTexture(0, target.get_texture(), 0, GL_FALSE, 0, GL_READ_WRITE, OUTPUT_FORMAT);
+  auto buffer = Compute::get_scratch_buffer(size_t(buffer_size) * sizeof(float));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+
+  auto local = shader->get_work_group_size();
+  glDispatchCompute((width + local[0] - 1) / local[0], (height + local[1] - 1) / local[1], 1);
+  // Downstream passes sample the image, or read the buffer if it's bound again
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                  GL_SHADER_STORAGE_BARRIER_BIT);
+  shader->clear_textures();
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+  glUseProgram(0);
+
+  context.set_pin_data(output_pin, (Data::Texture2D)target.get_texture());
+}
+uint64_t ComputeShaderNode::hash_context(const EvalContext &context) const {
+  Hash hash;
+  hash.add_value(shader_id).add_value(context.resolution.x).add_value(context.resolution.y);
+  for (auto &pin : uniform_pins)
+    hash.add(pin.identifier);
+  hash.add(size_from).add_value(scale).add_value(buffer_size);
+  if (auto shader = this->shader.lock())
+    hash.add_value(shader->get_revision());
+  return hash.get();
+}
+
+//! ReductionNode
+
+void ReductionNode::render(RenderGraph &) {
+  ImNodes::BeginNode(id);
+
+  ImNodes::BeginNodeTitleBar();
+  ImGui::TextUnformatted("Reduction");
+  ImNodes::EndNodeTitleBar();
+
+  render_fallback(node_width);
+
+  {
+    BEGIN_OUTPUT_PIN(output_pin, DataType::Texture2D);
+    ImGui::Indent(node_width - ImGui::CalcTextSize("Result").x);
+    ImGui::Text("Result");
+    END_OUTPUT_PIN();
+  }
+  if (ImGui::IsItemHovered()) {
+    if (reduction == Compute::Reduction::Histogram)
+      ImGui::SetTooltip("%d x 1 texture of the luminance, sums up to 1", Compute::BINS);
+    else
+      ImGui::SetTooltip("1 x 1 texture, read with texelFetch(u_result, ivec2(0), 0)");
+  }
+  {
+    BEGIN_INPUT_PIN(input_pin, DataType::Texture2D);
+    ImGui::Text("Image");
+    END_INPUT_PIN();
+  }
+  ImGui::SetNextItemWidth(node_width);
+  if (ImGui::BeginCombo("##reduction", Compute::reduction_name(reduction))) {
+    for (auto r : Compute::ALL_REDUCTIONS) {
+      if (ImGui::Selectable(Compute::reduction_name(r), r == reduction))
+        reduction = r;
+    }
+    ImGui::EndCombo();
+  }
+
+  ImNodes::EndNode();
+}
+void ReductionNode::onEnter(RenderGraph &graph) {
+  graph.register_pin(id, DataType::Texture2D, &input_pin);
+  graph.register_pin(id, DataType::Texture2D, &output_pin);
+}
+void ReductionNode::onExit(RenderGraph &graph) {
+  graph.delete_pin(input_pin);
+  graph.delete_pin(output_pin);
+}
+void ReductionNode::run(EvalContext &context) {
+  if (!check_support(context, output_pin))
+    return;
+  auto input = context.get_pin_data(input_pin).try_get<Data::Texture2D>();
+  if (!input || *input == 0) // Nothing is connected
+    return;
+  auto targets = [&context](size_t index, int width, int height, GLenum format) -> RenderTarget & {
+    return context.get_target(width, height, format, index);
+  };
+  auto result = Compute::reduce(targets, *input, reduction);
+  if (!result)
+    return context.stop();
+  context.set_pin_data(output_pin, (Data::Texture2D)result->get_texture());
+}
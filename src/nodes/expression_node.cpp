@@ -0,0 +1,183 @@
+#include "nodes/expression_node.h"
+
+#include "eval_tape.h"
+#include "graph.h"
+#include "imnodes.h"
+
+#include <algorithm>
+#include <imgui_stdlib.h>
+
+namespace {
+
+// Types a variable may take
+constexpr DataType VARIABLE_TYPES[] = {
+    DataType::Float, DataType::Vec2,  DataType::Vec3,  DataType::Vec4,
+    DataType::Int,   DataType::IVec2, DataType::IVec3, DataType::IVec4,
+};
+
+} // namespace
+
+void ExpressionNode::compile() {
+  std::map<std::string, DataType> types;
+  for (auto &pin : input_pins)
+    types[pin.name] = pin.type;
+
+  auto compiled = std::make_shared<Expression>();
+  if (compiled->compile(source, types)) {
+    expression = compiled;
+    error.clear();
+  } else {
+    expression = nullptr;
+    error = compiled->get_error();
+  }
+  bound_graph = nullptr; // Variables may have changed
+}
+void ExpressionNode::rebuild(RenderGraph &graph) {
+  compile();
+  if (!expression) // Pins are kept until the source compiles again
+    return;
+
+  // Pins of variables still in use keep their connections
+  std::vector<InputPin> pins;
+  for (auto &variable : expression->get_variables()) {
+    auto it = std::find_if(input_pins.begin(), input_pins.end(),
+                           [&](auto &pin) { return pin.name == variable.name; });
+    if (it != input_pins.end()) {
+      pins.push_back(*it);
+      input_pins.erase(it);
+      continue;
+    }
+    InputPin pin{-1, variable.type, variable.name};
+    graph.register_pin(id, pin.type, &pin.pinid);
+    pins.push_back(pin);
+  }
+  for (auto &pin : input_pins)
+    graph.delete_pin(pin.pinid);
+  input_pins = pins;
+
+  if (expression->get_type() != output_type) {
+    graph.delete_pin(output_pin);
+    output_type = expression->get_type();
+    graph.register_pin(id, output_type, &output_pin);
+  }
+  graph.invalidate();
+}
+void ExpressionNode::render(RenderGraph &graph) {
+  ImNodes::BeginNode(id);
+
+  ImNodes::BeginNodeTitleBar();
+  ImGui::TextUnformatted("Expression");
+  ImNodes::EndNodeTitleBar();
+
+  ImGui::SetNextItemWidth(node_width);
+  ImGui::InputText("##source", &edited);
+  if (ImGui::IsItemDeactivatedAfterEdit() && edited != source) {
+    source = edited;
+    rebuild(graph);
+  }
+  if (!error.empty()) {
+    ImGui::PushTextWrapPos(ImGui::GetCursorPosX() + node_width);
+    ImGui::TextColored(ImVec4(0.92f, 0.18f, 0.29f, 1.00f), "%s", error.c_str());
+    ImGui::PopTextWrapPos();
+  }
+
+  {
+    BEGIN_OUTPUT_PIN(output_pin, output_type);
+    ImGui::Indent(node_width - ImGui::CalcTextSize(Data::type_name(output_type)).x);
+    ImGui::TextUnformatted(Data::type_name(output_type));
+    END_OUTPUT_PIN();
+  }
+
+  std::optional<std::pair<size_t, DataType>> retyped;
+  for (size_t i = 0; i < input_pins.size(); i++) {
+    auto &pin = input_pins[i];
+    BEGIN_INPUT_PIN(pin.pinid, pin.type);
+    ImGui::TextUnformatted(pin.name.c_str());
+    ImGui::SameLine();
+    ImGui::Indent(node_width - 80.0f);
+    ImGui::SetNextItemWidth(80.0f);
+    ImGui::PushID(pin.pinid);
+    if (ImGui::BeginCombo("##type", Data::type_name(pin.type))) {
+      for (auto type : VARIABLE_TYPES) {
+        if (ImGui::Selectable(Data::type_name(type), type == pin.type) && type != pin.type)
+          retyped = {i, type};
+      }
+      ImGui::EndCombo();
+    }
+    ImGui::PopID();
+    ImGui::Unindent(node_width - 80.0f);
+    END_INPUT_PIN();
+  }
+  if (retyped) { // Connections of the old type are dropped
+    auto &pin = input_pins[retyped->first];
+    graph.delete_pin(pin.pinid);
+    pin.type = retyped->second;
+    graph.register_pin(id, pin.type, &pin.pinid);
+    rebuild(graph);
+  }
+
+  ImNodes::EndNode();
+}
+void ExpressionNode::onEnter(RenderGraph &graph) {
+  graph.register_pin(id, output_type, &output_pin);
+  // If preconfigured using clone()
+  for (auto &pin : input_pins)
+    graph.register_pin(id, pin.type, &pin.pinid);
+  rebuild(graph);
+}
+void ExpressionNode::onExit(RenderGraph &graph) {
+  graph.delete_pin(output_pin);
+  for (auto &pin : input_pins)
+    graph.delete_pin(pin.pinid);
+}
+void ExpressionNode::bind(RenderGraph &graph) {
+  auto &edges = graph.get_edges();
+  auto &variables = expression->get_variables();
+  variable_pins.resize(variables.size());
+  inputs.resize(variables.size());
+  for (size_t i = 0; i < variables.size(); i++) {
+    auto pin = std::find_if(input_pins.begin(), input_pins.end(),
+                            [&](auto &pin) { return pin.name == variables[i].name; });
+    bool connected = pin != input_pins.end() &&
+                     std::any_of(edges.begin(), edges.end(),
+                                 [&](auto &pair) { return pair.second.to == pin->pinid; });
+    variable_pins[i] = connected ? pin->pinid : -1;
+  }
+  bound_graph = &graph;
+  bound_revision = graph.get_revision();
+}
+void ExpressionNode::run(EvalContext &context) {
+  if (!expression)
+    return;
+  // Edges only change along with the revision
+  auto &graph = context.get_graph();
+  if (bound_graph != &graph || bound_revision != graph.get_revision())
+    bind(graph);
+
+  for (size_t i = 0; i < variable_pins.size(); i++) {
+    if (variable_pins[i] < 0) {
+      inputs[i] = {};
+      continue;
+    }
+    Data data = context.get_pin_data(variable_pins[i]);
+    inputs[i] = Register::from_data(data).to_lanes(data.type);
+  }
+  Register result;
+  result.f = expression->run(inputs.data(), scratch);
+  context.set_pin_data(output_pin, result.to_data(output_type).data);
+}
+bool ExpressionNode::lower(TapeBuilder &tape) const {
+  if (!expression)
+    return false;
+  std::vector<int> args;
+  for (auto &variable : expression->get_variables()) {
+    auto pin = std::find_if(input_pins.begin(), input_pins.end(),
+                            [&](auto &pin) { return pin.name == variable.name; });
+    auto reg = pin != input_pins.end() ? tape.input(pin->pinid) : std::optional<int>(-1);
+    if (!reg)
+      return false;
+    args.push_back(*reg);
+  }
+  tape.emit(expression, args, tape.output(output_pin));
+  return true;
+}
@@ -1,15 +1,37 @@
 #include "nodes/shader_node.h"
 
+#include "events.h"
 #include "geometry.h"
 #include "graph.h"
 #include "imnodes.h"
 #include "shader.h"
+#include "shader_fusion.h"
+#include "shader_variants.h"
 
+#include <algorithm>
 #include <glad/gl.h>
 #include <imgui_stdlib.h>
+#include <map>
+#include <regex>
 
 #include "IconsFontAwesome6.h"
 
+namespace {
+
+// Outputs declared as `layout(location = N) out vec4 name;` by location
+std::map<int, std::string> declared_outputs(const std::string &source) {
+  static const std::regex comments(R"(//[^\n]*|/\*[\s\S]*?\*/)");
+  static const std::regex declaration(
+      R"(layout\s*\(\s*location\s*=\s*(\d+)\s*\)\s*out\s+(?:\w+\s+)?\w+\s+(\w+)\s*;)");
+  std::string code = std::regex_replace(source, comments, " ");
+  std::map<int, std::string> outputs;
+  for (std::sregex_iterator it(code.begin(), code.end(), declaration), end; it != end; it++)
+    outputs.emplace(std::stoi((*it)[1].str()), (*it)[2].str());
+  return outputs;
+}
+
+} // namespace
+
 int FragmentShaderNode::add_uniform_pin(RenderGraph &graph, DataType type, std::string name) {
   int pinid;
   graph.register_pin(id, type, &pinid);
@@ -20,7 +42,43 @@ int FragmentShaderNode::add_uniform_pin(RenderGraph &graph, DataType type, std::
   });
   return pinid;
 }
+void FragmentShaderNode::sync_outputs(RenderGraph &graph) {
+  auto shader = this->shader.lock();
+  if (!shader)
+    return;
+  uint64_t hash = Hash().add_value(shader_id).add_value(shader->get_revision()).get();
+  if (hash == outputs_hash)
+    return;
+  outputs_hash = hash;
+
+  std::vector<OutputPin> pins;
+  bool changed = false;
+  for (auto &[location, identifier] : declared_outputs(shader->get_source())) {
+    if (location == 0 || location >= MAX_OUTPUTS)
+      continue;
+    auto it = std::find_if(output_pins.begin(), output_pins.end(),
+                           [&](auto &pin) { return pin.identifier == identifier; });
+    if (it != output_pins.end()) {
+      changed |= it->location != location;
+      pins.push_back(OutputPin{it->pinid, location, identifier});
+      output_pins.erase(it);
+      continue;
+    }
+    OutputPin pin{-1, location, identifier};
+    graph.register_pin(id, DataType::Texture2D, &pin.pinid);
+    pins.push_back(pin);
+    changed = true;
+  }
+  for (auto &pin : output_pins) {
+    graph.delete_pin(pin.pinid);
+    changed = true;
+  }
+  output_pins = pins;
+  if (changed)
+    graph.invalidate();
+}
 void FragmentShaderNode::render(RenderGraph &graph) {
+  sync_outputs(graph);
   ImNodes::BeginNode(id);
 
   ImNodes::BeginNodeTitleBar();
@@ -57,12 +115,50 @@ void FragmentShaderNode::render(RenderGraph &graph) {
     ImGui::EndCombo();
   }
 
+  if (ImGui::Checkbox("Specialize", &specialize))
+    graph.invalidate();
+  if (ImGui::IsItemHovered())
+    ImGui::SetTooltip("Bakes uniforms driven by constant nodes into the shader");
+  ImGui::SameLine();
+  if (ImGui::Checkbox("Feedback", &feedback))
+    graph.invalidate();
+  if (ImGui::IsItemHovered())
+    ImGui::SetTooltip("Samples the previous frame as u_previous, u_frame counts the steps");
+  if (feedback) {
+    ImGui::SetNextItemWidth(80.0f);
+    ImGui::DragInt("Iterations", &iterations, 0.1f, 1, MAX_ITERATIONS, "%d",
+                   ImGuiSliderFlags_AlwaysClamp);
+    // Invalidated, so paused viewports show the result as well
+    ImGui::SameLine();
+    if (ImGui::Button("Reset")) {
+      resets++;
+      graph.invalidate();
+    }
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("Clears the buffers and restarts u_frame at 0");
+    ImGui::SameLine();
+    if (ImGui::Button("Clear")) {
+      clears++;
+      graph.invalidate();
+    }
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("Clears the buffers");
+  }
+
   {
     BEGIN_OUTPUT_PIN(output_pin, DataType::Texture2D);
     ImGui::Indent(node_width - ImGui::CalcTextSize("Image").x);
     ImGui::Text("Image");
     END_OUTPUT_PIN();
   }
+  for (auto &pin : output_pins) {
+    BEGIN_OUTPUT_PIN(pin.pinid, DataType::Texture2D);
+    float indent = node_width - ImGui::CalcTextSize(pin.identifier.c_str()).x;
+    ImGui::Indent(indent);
+    ImGui::TextUnformatted(pin.identifier.c_str());
+    ImGui::Unindent(indent);
+    END_OUTPUT_PIN();
+  }
 
   if (ImGui::BeginPopup("add_uniform_popup")) { // Creation logic
     ImGui::SeparatorText("Uniforms");
@@ -113,77 +209,158 @@ void FragmentShaderNode::onEnter(RenderGraph &graph) {
       graph.register_pin(id, pin.type, &pin.pinid);
     }
   }
-
-  onLoad(graph);
-}
-void FragmentShaderNode::onLoad(RenderGraph &graph) {
-  glGenFramebuffers(1, &image_fbo);
-  glGenTextures(1, &image_colorbuffer);
-
-  glBindTexture(GL_TEXTURE_2D, image_colorbuffer);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, graph.viewport_resolution.x, graph.viewport_resolution.y,
-               0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  for (auto &pin : output_pins)
+    graph.register_pin(id, DataType::Texture2D, &pin.pinid);
 }
 void FragmentShaderNode::onExit(RenderGraph &graph) {
   graph.delete_pin(output_pin);
   for (auto &pin : uniform_pins) {
     graph.delete_pin(pin.pinid);
   }
-  glDeleteFramebuffers(1, &image_fbo);
-  glDeleteTextures(1, &image_colorbuffer);
+  for (auto &pin : output_pins)
+    graph.delete_pin(pin.pinid);
 }
-void FragmentShaderNode::run(RenderGraph &graph) {
+std::shared_ptr<Shader> FragmentShaderNode::get_compiled_shader(RenderGraph &graph) {
   auto shader = this->shader.lock();
+  if (!shader || (shader->is_compiled() && !shader->is_compute()))
+    return shader;
+  if (graph.is_snapshot()) // Failed to compile in prepare() already
+    return nullptr;
 
-  if (!shader) {
-    return graph.stop();
-  }
-
-  if (!shader->is_compiled()) {
-    static bool should_error = true;
-    if (!shader->compile(graph.graph_geometry)) {
-      if (should_error) {
-        spdlog::error(shader->get_log());
-      }
-      should_error = false; // Don't error next time
-      return graph.stop();
-    } else {
-      should_error = true;
-      graph.set_time(0.0f);
+  static bool should_error = true;
+  if (!shader->compile(graph.graph_geometry)) {
+    if (should_error) {
+      spdlog::error(shader->get_log());
+      EventQueue::push(CompileFinished(shader_id, false, shader->get_log()));
     }
+    should_error = false; // Don't error next time
+    return nullptr;
   }
-
-  glBindTexture(GL_TEXTURE_2D, image_colorbuffer);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, graph.viewport_resolution.x, graph.viewport_resolution.y,
-               0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-  glBindTexture(GL_TEXTURE_2D, 0);
-
+  should_error = true;
+  EventQueue::push(CompileFinished(shader_id, true));
+  return shader;
+}
+std::shared_ptr<Shader>
+FragmentShaderNode::get_specialized_shader(EvalContext &context,
+                                           const std::shared_ptr<Shader> &shader) {
+  auto &graph = context.get_graph();
+  std::vector<std::pair<std::string, Data>> constants;
+  for (auto &edge : graph.get_edges()) {
+    auto pin = std::find_if(uniform_pins.begin(), uniform_pins.end(),
+                            [&](auto &pin) { return pin.pinid == edge.second.to; });
+    if (pin == uniform_pins.end())
+      continue;
+    auto node = graph.get_node(graph.get_pin(edge.second.from).node_id);
+    // Compiling a variant per step would stall scrubbing and sweeps
+    if (node->is_editing() || context.overrides.contains(edge.second.from))
+      return nullptr;
+    if (Data data = context.get_pin_data(pin->pinid); data && node->is_constant())
+      constants.emplace_back(pin->identifier, data);
+  }
+  return ShaderVariants::get(shader, constants, graph.graph_geometry);
+}
+void FragmentShaderNode::draw(EvalContext &context, Shader &shader) {
+  shader.use(); // Uniforms are set on the bound program
+  // Baked uniforms no longer exist in a variant, setting them is a no-op
   for (auto &pin : uniform_pins) {
-    Data data = graph.get_pin_data(pin.pinid);
+    Data data = context.get_pin_data(pin.pinid);
     if (data)
-      shader->set_uniform(pin.identifier.c_str(), data);
+      shader.set_uniform(pin.identifier.c_str(), data);
   }
+  context.get_graph().graph_geometry->draw_geometry();
+  shader.clear_textures();
+}
+void FragmentShaderNode::run_feedback(EvalContext &context, Shader &shader) {
+  auto &buffers = context.get_feedback(id);
+  int width = context.resolution.x, height = context.resolution.y;
 
-  glBindFramebuffer(GL_FRAMEBUFFER, image_fbo);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, image_colorbuffer, 0);
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-    graph.stop();
-    spdlog::error("Framebuffer is not complete!");
-    return;
+  // Restarts if resized, on request or if the time went back, e.g. the viewport was reset
+  bool reset = !buffers.current || buffers.current->get_width() != width ||
+               buffers.current->get_height() != height || buffers.resets != resets ||
+               context.time < buffers.time;
+  if (reset) {
+    for (auto *target : {&buffers.previous, &buffers.current}) {
+      if (!*target)
+        *target = RenderTargetPool::acquire(width, height, FEEDBACK_FORMAT);
+      (*target)->resize(width, height, FEEDBACK_FORMAT);
+    }
+    buffers.frame = 0;
+    buffers.resets = resets;
+  }
+  if (reset || buffers.clears != clears) {
+    for (auto *target : {buffers.previous.get(), buffers.current.get()}) {
+      if (!target->begin()) // Clears the target
+        return context.stop();
+      target->end();
+    }
+    buffers.clears = clears;
   }
 
-  glViewport(0, 0, graph.viewport_resolution.x, graph.viewport_resolution.y);
-  glClearColor(0.0f, 0.0f, 0.0f, 1.00f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  // Re-evaluating the same time (e.g. paused while editing) keeps the frame
+  if (reset || context.time != buffers.time) {
+    for (int i = 0; i < iterations; i++) {
+      std::swap(buffers.previous, buffers.current);
+      if (!buffers.current->begin())
+        return context.stop();
+      shader.use(); // Set before draw(), so the pins take the following texture units
+      shader.set_uniform("u_previous", Data(DataType::Texture2D,
+                                            (Data::Texture2D)buffers.previous->get_texture()));
+      shader.set_uniform("u_frame", Data(DataType::Int, buffers.frame));
+      draw(context, shader);
+      buffers.current->end();
+      buffers.frame++;
+    }
+    buffers.time = context.time;
+  }
+  context.set_pin_data(output_pin, (Data::Texture2D)buffers.current->get_texture());
+}
+void FragmentShaderNode::run(EvalContext &context) {
+  if (!feedback && ShaderFusion::run(context, *this))
+    return;
 
-  shader->use();
-  graph.graph_geometry->draw_geometry();
-  shader->clear_textures();
+  auto &graph = context.get_graph();
+  auto shader = get_compiled_shader(graph);
+  if (!shader)
+    return context.stop();
+  if (specialize) {
+    if (auto variant = get_specialized_shader(context, shader))
+      shader = variant;
+  }
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (feedback)
+    return run_feedback(context, *shader);
 
-  graph.set_pin_data(output_pin, (Data::Texture2D)image_colorbuffer);
+  // Further outputs are attached to the same framebuffer, the shader runs once per pixel
+  int width = context.resolution.x, height = context.resolution.y;
+  std::vector<RenderTarget *> attachments;
+  for (auto &pin : output_pins) {
+    if (attachments.size() < size_t(pin.location))
+      attachments.resize(pin.location, nullptr);
+    attachments[pin.location - 1] = &context.get_target(width, height, GL_RGB8, pin.location);
+  }
+  auto &target = context.get_target(width, height);
+  if (!target.begin(attachments))
+    return context.stop();
+  draw(context, *shader);
+  target.end();
+
+  context.set_pin_data(output_pin, (Data::Texture2D)target.get_texture());
+  for (auto &pin : output_pins) {
+    auto texture = attachments[pin.location - 1]->get_texture();
+    context.set_pin_data(pin.pinid, (Data::Texture2D)texture);
+  }
+}
+uint64_t FragmentShaderNode::hash_context(const EvalContext &context) const {
+  Hash hash;
+  hash.add_value(shader_id).add_value(context.resolution.x).add_value(context.resolution.y);
+  for (auto &pin : uniform_pins)
+    hash.add(pin.identifier);
+  if (auto shader = this->shader.lock())
+    hash.add_value(shader->get_revision());
+  // Buffers belong to the context, so the result must never be shared with another one
+  if (feedback) {
+    hash.add_value(&context).add_value(context.time).add_value(iterations);
+    hash.add_value(resets).add_value(clears);
+  }
+  return hash.get();
 }
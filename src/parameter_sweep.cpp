@@ -0,0 +1,147 @@
+#include "parameter_sweep.h"
+
+#include "eval_context.h"
+#include "events.h"
+#include "graph.h"
+#include "graph_scheduler.h"
+#include "nodes.h"
+#include "render_target.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <spdlog/spdlog.h>
+
+std::vector<int> ParameterSweep::get_sweepable_pins(RenderGraph &graph) {
+  std::vector<int> pins;
+  for (auto &[id, pin] : graph.get_pins()) {
+    auto &node = graph.get_nodes().at(pin.node_id);
+    if (node->is_constant() && pin.data.type == DataType::Float)
+      pins.push_back(id);
+  }
+  return pins;
+}
+std::string ParameterSweep::get_axis_name(RenderGraph &graph, int pin) {
+  if (pin < 0)
+    return "Time";
+  return fmt::format("Float {}", graph.get_pin(pin).node_id);
+}
+int ParameterSweep::count_variants(const std::vector<SweepAxis> &axes) {
+  if (axes.empty())
+    return 0;
+  int count = 1;
+  for (auto &axis : axes) {
+    count *= std::max(axis.steps, 1);
+    if (count > MAX_VARIANTS)
+      return count;
+  }
+  return count;
+}
+void ParameterSweep::get_layout(const std::vector<SweepAxis> &axes, int &columns, int &rows) {
+  int count = count_variants(axes);
+  if (axes.size() == 1)
+    columns = std::max(int(std::ceil(std::sqrt(float(count)))), 1);
+  else
+    columns = axes.empty() ? 1 : std::max(axes.front().steps, 1);
+  rows = (count + columns - 1) / columns;
+}
+int ParameterSweep::get_max_size() {
+  GLint size = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &size);
+  return size;
+}
+bool ParameterSweep::fits(const std::vector<SweepAxis> &axes, int width, int height) {
+  int columns, rows;
+  get_layout(axes, columns, rows);
+  int64_t max_size = get_max_size();
+  return int64_t(columns) * width <= max_size && int64_t(rows) * height <= max_size;
+}
+std::unique_ptr<RenderTarget> ParameterSweep::render(std::shared_ptr<RenderGraph> graph,
+                                                     const std::vector<SweepAxis> &axes,
+                                                     int width, int height, double time,
+                                                     const std::string &output) {
+  int count = count_variants(axes);
+  if (count == 0 || count > MAX_VARIANTS || width <= 0 || height <= 0) {
+    spdlog::error("Can't sweep {} variants, at most {} are supported!", count, MAX_VARIANTS);
+    return nullptr;
+  }
+  if (!fits(axes, width, height)) {
+    spdlog::error("The contact sheet is larger than {} px, the limit of the GPU!",
+                  get_max_size());
+    return nullptr;
+  }
+  auto start = std::chrono::steady_clock::now();
+  int columns, rows;
+  get_layout(axes, columns, rows);
+
+  auto sheet = RenderTargetPool::acquire(columns * width, rows * height);
+  if (!sheet->begin()) { // Cells of failed variants stay black
+    RenderTargetPool::release(std::move(sheet));
+    return nullptr;
+  }
+  sheet->end();
+
+  // Targets of the contexts are recycled by the next chunk
+  std::vector<EvalContext> contexts(std::min(count, CHUNK));
+  GLuint read_fbo = 0, draw_fbo = 0;
+  glGenFramebuffers(1, &read_fbo);
+  glGenFramebuffers(1, &draw_fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         sheet->get_texture(), 0);
+
+  int failed = 0;
+  for (int first = 0; first < count; first += CHUNK) {
+    int size = std::min(CHUNK, count - first);
+    for (int i = 0; i < size; i++) {
+      auto &context = contexts[i];
+      context.resolution = ImVec2(float(width), float(height));
+      context.time = time;
+      context.outputs = output.empty() ? std::vector<std::string>() : std::vector{output};
+      context.overrides.clear();
+      // The first axis varies fastest
+      int index = first + i;
+      for (auto &axis : axes) {
+        int steps = std::max(axis.steps, 1);
+        float value = axis.get_value(index % steps);
+        index /= steps;
+        if (axis.pin < 0)
+          context.time = value;
+        else
+          context.overrides[axis.pin] = Data(DataType::Float, value);
+      }
+      GraphScheduler::submit(graph, context);
+    }
+    GraphScheduler::flush();
+
+    for (int i = 0; i < size; i++) {
+      GLuint image = contexts[i].get_output();
+      if (image == 0 || contexts[i].is_failed()) {
+        failed++;
+        continue;
+      }
+      // Images are stored bottom-up, the first row ends up at the top of the sheet
+      int column = (first + i) % columns, row = (first + i) / columns;
+      int x = column * width, y = (rows - 1 - row) * height;
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+      glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, image, 0);
+      glBlitFramebuffer(0, 0, width, height, x, y, x + width, y + height, GL_COLOR_BUFFER_BIT,
+                        GL_NEAREST);
+    }
+    EventQueue::push(ExportProgress(float(first + size) / float(count),
+                                    fmt::format("Rendered {}/{} variants", first + size, count)));
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteFramebuffers(1, &read_fbo);
+  glDeleteFramebuffers(1, &draw_fbo);
+  for (auto &context : contexts)
+    context.release();
+
+  float ms =
+      std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+  int batches = (count + CHUNK - 1) / CHUNK;
+  spdlog::info("Rendered {} variants in {} batches in {:.1f} ms", count, batches, ms);
+  if (failed > 0)
+    spdlog::warn("{} of {} variants failed to render!", failed, count);
+  return sheet;
+}
@@ -0,0 +1,160 @@
+#include "project_loader.h"
+
+#include "file_io.h"
+#include "graph.h"
+#include "nodes.h"
+#include "shader.h"
+#include "srpack.h"
+#include "texture.h"
+
+#include <spdlog/spdlog.h>
+
+//! ProjectLoader
+
+bool ProjectLoader::open(std::filesystem::path path) {
+  if (is_busy())
+    return false;
+  cancelled = false;
+  failed = false;
+  steps_done = 0;
+  steps_total = 0;
+  task = Jobs::submit([this, path]() { result = read(path); });
+  return true;
+}
+void ProjectLoader::cancel() {
+  cancelled = true;
+  loaded.reset();
+}
+float ProjectLoader::get_progress() {
+  size_t total = steps_total;
+  return total == 0 ? 0.0f : std::min(1.0f, float(steps_done) / total);
+}
+std::optional<LoadedProject> ProjectLoader::poll(std::chrono::milliseconds budget) {
+  if (task) {
+    if (!task.is_done())
+      return {};
+    task = Job();
+    loaded = std::move(result);
+    result.reset();
+    next_upload = 0;
+    if (!loaded && !cancelled)
+      failed = true;
+    if (cancelled) // Finished just before noticing
+      loaded.reset();
+  }
+  if (!loaded)
+    return {};
+
+  // Upload at least one texture per frame so loading always advances
+  auto start = std::chrono::steady_clock::now();
+  while (next_upload < loaded->uploads.size()) {
+    auto &texture = loaded->uploads[next_upload++];
+    if (!texture->finish_load())
+      spdlog::warn("Missing texture \"{}\" in {}", texture->get_name(),
+                   texture->get_path().string());
+    steps_done++;
+    if (std::chrono::steady_clock::now() - start >= budget)
+      break;
+  }
+  if (next_upload < loaded->uploads.size())
+    return {};
+
+  auto project = std::move(loaded);
+  loaded.reset();
+  return project;
+}
+std::optional<LoadedProject> ProjectLoader::read(std::filesystem::path path) {
+  LoadedProject project;
+  project.path = path;
+
+  // Project files are read from a pack or a directory
+  std::string project_file;
+  if (path.extension() == ".srpack") {
+    project.pack = std::make_shared<ProjectPack>(path);
+    project.root = path.parent_path();
+    auto data = project.pack->find("srproject.toml");
+    if (!*project.pack || !data) {
+      spdlog::error("Invalid project pack {}", path.string());
+      return {};
+    }
+    project_file = std::string(data->begin(), data->end());
+    if (auto ini = project.pack->find("sr_imgui.ini"))
+      project.imgui_ini = std::string(ini->begin(), ini->end());
+  } else {
+    project.root = path;
+    auto data = read_file(path / "srproject.toml");
+    if (!data) {
+      spdlog::error("Unknown project directory format!");
+      return {};
+    }
+    project_file = std::string(data->begin(), data->end());
+    auto imgui_filepath = path / "sr_imgui.ini";
+    if (std::filesystem::exists(imgui_filepath)) {
+      if (auto ini = read_file(imgui_filepath))
+        project.imgui_ini = std::string(ini->begin(), ini->end());
+      else
+        spdlog::error("Failed to load ImGui layout!");
+    }
+  }
+
+  try {
+    project.project = toml::parse(project_file);
+  } catch (const toml::parse_error &error) {
+    spdlog::error("Failed to parse project file:\n{}", error.what());
+    return {};
+  }
+  if (cancelled)
+    return {};
+
+  // Assets don't create any OpenGL objects while loading
+  try {
+    if (!project.project["Assets"].is_table())
+      throw std::bad_optional_access();
+    project.assets->pack = project.pack;
+    project.assets->load(*project.project["Assets"].as_table(), project.root);
+  } catch (std::bad_optional_access &) {
+    spdlog::error("Invalid project file!");
+    return {};
+  }
+
+  // Only textures sampled by a graph are loaded, others stay lazy
+  auto is_used = [&](AssetId<Asset> id) {
+    for (auto &graph : *project.assets->getRenderGraphCollection()) {
+      for (auto &node : graph.second->get_nodes()) {
+        if (node.second->uses_asset(id))
+          return true;
+      }
+    }
+    return false;
+  };
+  std::vector<std::shared_ptr<Texture>> textures;
+  for (auto &pair : *project.assets->getTextureCollection()) {
+    if (is_used(pair.first))
+      textures.push_back(pair.second);
+  }
+  auto shaders = project.assets->getShaderCollection();
+  // Textures count twice, once prepared and once uploaded
+  steps_total = shaders->size() + textures.size() * 2;
+
+  // Every asset is independent, so they are read in parallel
+  std::vector<std::shared_ptr<Shader>> shader_list;
+  for (auto &pair : *shaders)
+    shader_list.push_back(pair.second);
+  auto read_shaders = Jobs::parallel_for(shader_list.size(), [&](size_t i) {
+    if (cancelled)
+      return;
+    shader_list[i]->ensure_loaded();
+    steps_done++;
+  });
+  auto prepare_textures = Jobs::parallel_for(textures.size(), [&](size_t i) {
+    if (cancelled)
+      return;
+    textures[i]->prepare();
+    steps_done++;
+  });
+  Jobs::when_all({read_shaders, prepare_textures}).wait();
+  if (cancelled)
+    return {};
+  project.uploads = textures;
+  return project;
+}
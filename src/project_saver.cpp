@@ -0,0 +1,66 @@
+#include "project_saver.h"
+
+#include "hash.h"
+
+#include <spdlog/spdlog.h>
+#include <sstream>
+
+//! ProjectSaver
+
+bool ProjectSaver::save(ProjectSnapshot snapshot) {
+  if (is_busy())
+    return false;
+  task = Jobs::submit([this, snapshot = std::move(snapshot)]() mutable {
+    result = write(std::move(snapshot));
+  });
+  return true;
+}
+std::optional<bool> ProjectSaver::poll() {
+  if (!task || !task.is_done())
+    return {};
+  task = Job();
+  return result;
+}
+std::optional<bool> ProjectSaver::wait() {
+  if (!task)
+    return {};
+  task.wait();
+  task = Job();
+  return result;
+}
+bool ProjectSaver::write(ProjectSnapshot snapshot) {
+  std::ostringstream project_file;
+  project_file << snapshot.project;
+  std::string str = project_file.str();
+  snapshot.files.push_back(
+      {snapshot.root / "srproject.toml", std::vector<unsigned char>(str.begin(), str.end())});
+
+  std::error_code ec;
+  std::filesystem::create_directories(snapshot.root, ec);
+
+  bool success = true;
+  for (auto &file : snapshot.files) {
+    Hash hash;
+    hash.add(file.data.data(), file.data.size());
+    {
+      std::lock_guard lock(mutex);
+      auto it = written.find(file.path);
+      // Skip unless the file was changed or removed in the meantime
+      if (it != written.end() && it->second == hash.get() &&
+          std::filesystem::exists(file.path, ec))
+        continue;
+    }
+
+    std::filesystem::create_directories(file.path.parent_path(), ec);
+    if (!write_file_atomic(file.path, file.data)) {
+      spdlog::error("Failed to save {}", file.path.string());
+      std::lock_guard lock(mutex);
+      written.erase(file.path);
+      success = false;
+      continue;
+    }
+    std::lock_guard lock(mutex);
+    written[file.path] = hash.get();
+  }
+  return success;
+}
@@ -0,0 +1,139 @@
+#include "render_target.h"
+
+#include "context_objects.h"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+std::mutex pool_mutex;
+std::deque<std::unique_ptr<RenderTarget>> idle; // Oldest first
+
+} // namespace
+
+//! RenderTarget
+
+RenderTarget::~RenderTarget() {
+  ContextObjects::release(this);
+  if (texture != 0)
+    glDeleteTextures(1, &texture);
+}
+void RenderTarget::resize(int width, int height, GLenum format) {
+  if (texture != 0 && this->width == width && this->height == height && this->format == format)
+    return;
+
+  if (texture == 0) {
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  }
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  this->width = width;
+  this->height = height;
+  this->format = format;
+}
+bool RenderTarget::begin(const std::vector<RenderTarget *> &attachments) {
+  if (mipmapped) { // The levels would go stale
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    mipmapped = false;
+  }
+  bool created;
+  glBindFramebuffer(GL_FRAMEBUFFER, ContextObjects::get_framebuffer(this, created));
+  if (created) // Resizing keeps the texture, so it stays attached
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+  attached = attachments.size();
+  if (!attachments.empty()) {
+    std::vector<GLenum> buffers = {GL_COLOR_ATTACHMENT0};
+    for (size_t i = 0; i < attachments.size(); i++) {
+      if (!attachments[i]) {
+        buffers.push_back(GL_NONE);
+        continue;
+      }
+      GLenum attachment = GL_COLOR_ATTACHMENT1 + GLenum(i);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D,
+                             attachments[i]->get_texture(), 0);
+      buffers.push_back(attachment);
+    }
+    glDrawBuffers(GLsizei(buffers.size()), buffers.data());
+  }
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    end();
+    spdlog::error("Framebuffer is not complete!");
+    return false;
+  }
+
+  glViewport(0, 0, width, height);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.00f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clears every draw buffer
+  return true;
+}
+void RenderTarget::end() {
+  // The framebuffer is kept, it must not keep the other targets alive
+  for (size_t i = 0; i < attached; i++)
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1 + GLenum(i), GL_TEXTURE_2D, 0, 0);
+  if (attached > 0)
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+  attached = 0;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+void RenderTarget::generate_mipmaps() {
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  mipmapped = true;
+}
+int RenderTarget::get_levels() const {
+  int levels = 1;
+  for (int size = std::max(width, height); size > 1; size /= 2)
+    levels++;
+  return levels;
+}
+
+//! RenderTargetPool
+
+std::unique_ptr<RenderTarget> RenderTargetPool::acquire(int width, int height, GLenum format) {
+  {
+    std::lock_guard lock(pool_mutex);
+    // Newest first, they are the most likely to still be resident
+    auto it = std::find_if(idle.rbegin(), idle.rend(), [&](auto &target) {
+      return target->get_width() == width && target->get_height() == height &&
+             target->get_format() == format;
+    });
+    if (it != idle.rend()) {
+      auto target = std::move(*it);
+      idle.erase(std::next(it).base());
+      return target;
+    }
+  }
+  auto target = std::make_unique<RenderTarget>();
+  target->resize(width, height, format);
+  return target;
+}
+void RenderTargetPool::release(std::unique_ptr<RenderTarget> target) {
+  if (!target || target->get_texture() == 0)
+    return;
+  std::unique_ptr<RenderTarget> evicted; // Deleted outside of the lock
+  std::lock_guard lock(pool_mutex);
+  idle.push_back(std::move(target));
+  if (idle.size() > MAX_IDLE) {
+    evicted = std::move(idle.front());
+    idle.pop_front();
+  }
+}
+void RenderTargetPool::clear() {
+  std::lock_guard lock(pool_mutex);
+  idle.clear();
+}
+size_t RenderTargetPool::get_idle_count() {
+  std::lock_guard lock(pool_mutex);
+  return idle.size();
+}
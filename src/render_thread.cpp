@@ -0,0 +1,269 @@
+#include "render_thread.h"
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include "context_objects.h"
+#include "frame_pacer.h"
+#include "graph.h"
+#include "graph_scheduler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <spdlog/spdlog.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::recursive_mutex shared_mutex;
+std::recursive_mutex evaluation_mutex;
+
+std::thread thread;
+GLFWwindow *window = nullptr;
+std::atomic<bool> stopping = false;
+
+std::mutex wake_mutex;
+std::condition_variable wake_cv;
+bool woken = false;
+std::vector<std::weak_ptr<AsyncViewport>> viewports;
+
+// Framebuffers of copy_texture(), kept until the render thread stops
+GLuint copy_fbos[2] = {0, 0};
+
+// Copies a texture into another
+void copy_texture(GLuint from, GLuint to, int width, int height) {
+  if (copy_fbos[0] == 0)
+    glGenFramebuffers(2, copy_fbos);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, copy_fbos[0]);
+  glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, from, 0);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copy_fbos[1]);
+  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, to, 0);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  // Detached, so the framebuffers do not keep deleted slots or outputs alive
+  glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+} // namespace
+
+//! AsyncViewport
+
+AsyncViewport::~AsyncViewport() {
+  // Textures and syncs are shared, so either context may delete them
+  for (auto &slot : slots) {
+    if (slot.texture != 0)
+      glDeleteTextures(1, &slot.texture);
+    if (slot.release)
+      glDeleteSync(slot.release);
+  }
+}
+void AsyncViewport::request_frame(std::shared_ptr<RenderGraph> graph, ImVec2 resolution,
+                                  double time, std::vector<std::string> outputs) {
+  {
+    std::lock_guard lock(mutex);
+    request = Request{graph, resolution, time, std::move(outputs)};
+  }
+  RenderThread::wake();
+}
+GLuint AsyncViewport::acquire() {
+  std::lock_guard lock(mutex);
+  if (fresh) {
+    // The old front may still be sampled by commands of previous frames
+    if (slots[front].release)
+      glDeleteSync(slots[front].release);
+    slots[front].release = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush(); // Other contexts may only wait on flushed fences
+    std::swap(front, ready);
+    fresh = false;
+  }
+  return slots[front].texture;
+}
+bool AsyncViewport::take_request() {
+  GLsync release = nullptr;
+  {
+    std::lock_guard lock(mutex);
+    if (!request)
+      return false;
+    taken = std::move(request);
+    request.reset();
+    // Only the render thread touches the back slot
+    std::swap(release, slots[back].release);
+  }
+  if (release) {
+    glWaitSync(release, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(release);
+  }
+  return true;
+}
+void AsyncViewport::take_snapshot() {
+  if (closed) {
+    taken.reset();
+    return;
+  }
+  auto graph = std::move(taken->graph); // Only the snapshot is used without the lock
+  context.resolution = taken->resolution;
+  context.time = taken->time;
+  context.outputs = taken->outputs;
+  // Frames only differing in the time of a still graph need no new copy
+  if (!snapshot || snapshot->get_origin() != graph || !graph->is_evaluated(context))
+    snapshot = RenderGraph::snapshot(graph, snapshot.get());
+  graph->time = taken->time; // Exports default to the time shown
+}
+void AsyncViewport::submit() {
+  if (taken)
+    GraphScheduler::submit(snapshot, context);
+}
+void AsyncViewport::copy_output() {
+  if (!taken)
+    return;
+  auto req = std::move(taken.value());
+  taken.reset();
+  GLuint output = context.get_output();
+  if (output == 0)
+    return;
+
+  int width = std::max(1, int(req.resolution.x));
+  int height = std::max(1, int(req.resolution.y));
+  Slot *slot = &slots[back];
+  if (slot->texture == 0 || slot->width != width || slot->height != height) {
+    if (slot->texture == 0)
+      glGenTextures(1, &slot->texture);
+    glBindTexture(GL_TEXTURE_2D, slot->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    slot->width = width;
+    slot->height = height;
+  }
+  copy_texture(output, slot->texture, width, height);
+
+  // Flushed before unlocking, so later changes by the UI are ordered after the copy
+  done = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush();
+}
+void AsyncViewport::present() {
+  if (!done)
+    return;
+  // Only this thread waits for the GPU, the UI keeps showing the previous frame
+  while (glClientWaitSync(done, 0, 1000000) == GL_TIMEOUT_EXPIRED) {
+    if (stopping)
+      break;
+  }
+  glDeleteSync(done);
+  done = nullptr;
+
+  std::lock_guard lock(mutex);
+  std::swap(back, ready);
+  fresh = true;
+  FramePacer::request_redraw();
+}
+
+//! RenderThread
+
+bool RenderThread::start(GLFWwindow *main_window) {
+  if (is_running())
+    return true;
+
+  // The hidden window only exists to own a context sharing objects with the UI
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  window = glfwCreateWindow(1, 1, "ShaderRinth Render", nullptr, main_window);
+  glfwDefaultWindowHints();
+  if (!window) {
+    spdlog::error("Failed to create the render thread context!");
+    return false;
+  }
+
+  stopping = false;
+  thread = std::thread(run);
+  spdlog::info("Render thread started");
+  return true;
+}
+void RenderThread::stop() {
+  if (!is_running())
+    return;
+  stopping = true;
+  wake();
+  thread.join();
+  glfwDestroyWindow(window);
+  window = nullptr;
+  spdlog::info("Render thread stopped");
+}
+bool RenderThread::is_running() { return thread.joinable(); }
+void RenderThread::add(std::shared_ptr<AsyncViewport> viewport) {
+  std::lock_guard lock(wake_mutex);
+  viewports.push_back(viewport);
+}
+std::unique_lock<std::recursive_mutex> RenderThread::lock() {
+  return std::unique_lock(shared_mutex);
+}
+std::unique_lock<std::recursive_mutex> RenderThread::lock_evaluation() {
+  return std::unique_lock(evaluation_mutex);
+}
+void RenderThread::wake() {
+  {
+    std::lock_guard lock(wake_mutex);
+    woken = true;
+  }
+  wake_cv.notify_one();
+}
+void RenderThread::run() {
+  glfwMakeContextCurrent(window);
+
+  while (!stopping) {
+    ContextObjects::collect(); // Released by the UI in the meantime
+    std::vector<std::shared_ptr<AsyncViewport>> alive;
+    {
+      std::lock_guard lock(wake_mutex);
+      woken = false;
+      std::erase_if(viewports, [](auto &viewport) { return viewport.expired(); });
+      for (auto &viewport : viewports) {
+        if (auto ptr = viewport.lock())
+          alive.push_back(ptr);
+      }
+    }
+
+    std::vector<std::shared_ptr<AsyncViewport>> taken;
+    for (auto &viewport : alive) {
+      if (viewport->take_request())
+        taken.push_back(viewport);
+    }
+    if (!taken.empty()) {
+      {
+        // The UI only waits for the graphs to be copied, not for their evaluation
+        auto lock = RenderThread::lock();
+        for (auto &viewport : taken)
+          viewport->take_snapshot();
+      }
+      {
+        // Graphs of all viewports are evaluated as one batch
+        auto lock = RenderThread::lock_evaluation();
+        for (auto &viewport : taken)
+          viewport->submit();
+        GraphScheduler::flush();
+        for (auto &viewport : taken)
+          viewport->copy_output();
+      }
+      for (auto &viewport : taken)
+        viewport->present();
+      continue;
+    }
+
+    std::unique_lock lock(wake_mutex);
+    wake_cv.wait(lock, [] { return woken || stopping; });
+  }
+
+  // Containers are not shared, they go away with the context
+  if (copy_fbos[0] != 0)
+    glDeleteFramebuffers(2, copy_fbos);
+  copy_fbos[0] = copy_fbos[1] = 0;
+  ContextObjects::clear();
+  glfwMakeContextCurrent(nullptr);
+}
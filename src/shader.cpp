@@ -1,6 +1,8 @@
 #include "shader.h"
 #include "data.h"
 #include "geometry.h"
+#include "hash.h"
+#include "srpack.h"
 
 #include <fstream>
 #include <glad/gl.h>
@@ -31,20 +33,62 @@ Shader::Shader(std::string name) {
   this->name = name;
 }
 Shader::Shader(std::string name, std::filesystem::path project_root,
-               std::filesystem::path rel_path) {
-  auto abs_path = project_root / rel_path;
+               std::filesystem::path rel_path, std::shared_ptr<ProjectPack> pack)
+    : path(rel_path), source_root(project_root), pack(pack), loaded(false) {
+  this->name = name;
+  if (!pack) // The file on disk is the saved state until loaded
+    saved_path = project_root / rel_path;
+}
+bool Shader::ensure_loaded() {
+  if (loaded)
+    return true;
+  loaded = true;
+
+  if (pack) {
+    auto data = pack->find(path.generic_string());
+    if (!data) {
+      spdlog::error("Failed to load shader \"{}\" from pack!", name);
+      return false;
+    }
+    source = std::string(data->begin(), data->end());
+    return true;
+  }
+
+  auto abs_path = source_root / path;
   std::ifstream file(abs_path);
   if (!file) {
     spdlog::error("Failed to load shader \"{}\" in \"{}\"!", name, abs_path.string());
-    return;
+    return false;
   }
   std::ostringstream buf;
   buf << file.rdbuf();
   source = buf.str();
-  this->name = name;
-  this->path = rel_path;
+  saved_hash = Hash::of(source);
+  return true;
+}
+bool Shader::reload(std::filesystem::path project_root) {
+  if (!loaded) // Read on first use anyway
+    return false;
+
+  auto abs_path = project_root / path;
+  std::ifstream file(abs_path);
+  if (!file) {
+    spdlog::error("Failed to reload shader \"{}\" in \"{}\"!", name, abs_path.string());
+    return false;
+  }
+  std::ostringstream buf;
+  buf << file.rdbuf();
+  if (buf.str() == source) // Most likely our own save
+    return false;
+
+  recompile_with_source(buf.str());
+  saved_path = abs_path;
+  saved_hash = Hash::of(source);
+  spdlog::info("Reloaded shader \"{}\"", name);
+  return true;
 }
 bool Shader::compile(std::shared_ptr<Geometry> geo) {
+  ensure_loaded();
   int success;
   const char *src = source.c_str();
   GLuint frag = glCreateShader(GL_FRAGMENT_SHADER);
@@ -83,8 +127,48 @@ bool Shader::compile(std::shared_ptr<Geometry> geo) {
   }
 
   compiled = true;
+  compute = false;
+  return success;
+}
+bool Shader::compile_compute() {
+  ensure_loaded();
+  int success;
+  const char *src = source.c_str();
+  GLuint comp = glCreateShader(GL_COMPUTE_SHADER);
+  glShaderSource(comp, 1, &src, NULL);
+  glCompileShader(comp);
+  glGetShaderiv(comp, GL_COMPILE_STATUS, &success);
+
+  if (!success) {
+    glGetShaderInfoLog(comp, 512, NULL, log);
+    glDeleteShader(comp);
+    return success;
+  }
+
+  if (program != 0)
+    glDeleteProgram(program);
+  program = glCreateProgram();
+  glAttachShader(program, comp);
+  glLinkProgram(program);
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+  glDeleteShader(comp);
+
+  if (!success) {
+    glGetProgramInfoLog(program, 512, NULL, log);
+    return success;
+  }
+
+  compiled = true;
+  compute = true;
   return success;
 }
+std::array<int, 3> Shader::get_work_group_size() {
+  std::array<int, 3> size = {1, 1, 1};
+  if (compiled)
+    glGetProgramiv(program, GL_COMPUTE_WORK_GROUP_SIZE, size.data());
+  return size;
+}
 void Shader::set_uniform(const char *name, Data data) {
   GLuint loc = get_uniform_loc(name);
 
@@ -102,18 +186,28 @@ void Shader::set_uniform(const char *name, Data data) {
   } else
     SET_UNIFORM[data.type](loc, data);
 }
-toml::table Shader::save(std::filesystem::path project_root) {
-  auto abs_path = project_root / path;
-  // Ensure the parent directory exists
-  std::filesystem::create_directories(abs_path.parent_path());
-
-  if (auto file = std::ofstream(abs_path))
-    file << source;
-  else
-    spdlog::error("Failed to save shader \"{}\" in \"{}\"!", name, abs_path.string());
-
+bool Shader::is_dirty(std::filesystem::path project_root) {
+  if (!loaded) // Unloaded sources can't have changed
+    return saved_path != project_root / path;
+  return saved_path != project_root / path || saved_hash != Hash::of(source);
+}
+std::optional<FileWrite> Shader::save_source(std::filesystem::path project_root) {
+  if (!is_dirty(project_root) || !ensure_loaded())
+    return {};
+  saved_path = project_root / path;
+  saved_hash = Hash::of(source);
+  return FileWrite{saved_path, std::vector<unsigned char>(source.begin(), source.end())};
+}
+toml::table Shader::save(std::filesystem::path) {
   return toml::table{
       {"name", name},
       {"path", path.string()},
   };
 }
+std::shared_ptr<Shader> Shader::load(toml::table &tbl, std::shared_ptr<AssetManager> assets) {
+  std::string name = tbl["name"].value<std::string>().value();
+  std::string path_str = tbl["path"].value<std::string>().value(); // Relative path
+
+  // Shaders are loaded on first use
+  return std::make_shared<Shader>(Shader(name, assets->project_root, path_str, assets->pack));
+}
@@ -0,0 +1,745 @@
+#include "shader_fusion.h"
+
+#include "events.h"
+#include "frame_pacer.h"
+#include "geometry.h"
+#include "graph.h"
+#include "hash.h"
+#include "nodes.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <spdlog/spdlog.h>
+#include <string>
+
+namespace {
+
+//! GLSL
+
+struct Token {
+  enum Kind { Space, Identifier, Number, Symbol, Directive };
+  Kind kind;
+  std::string text;
+};
+
+constexpr size_t NONE = size_t(-1);
+
+// Splits GLSL into tokens, comments are kept as Space tokens
+std::vector<Token> tokenize(const std::string &src) {
+  static const char *OPERATORS[] = {
+      "<<=", ">>=", "==", "!=", "<=", ">=", "+=", "-=", "*=", "/=", "%=",
+      "&=",  "|=",  "^=", "++", "--", "&&", "||", "^^", "<<", ">>",
+  };
+  std::vector<Token> tokens;
+  bool line_start = true;
+  size_t i = 0;
+  auto push = [&](Token::Kind kind, size_t start) {
+    tokens.push_back(Token{kind, src.substr(start, i - start)});
+    if (kind != Token::Space)
+      line_start = false;
+  };
+
+  while (i < src.size()) {
+    size_t start = i;
+    char c = src[i];
+    if (c == '\n') {
+      i++;
+      push(Token::Space, start);
+      line_start = true;
+    } else if (std::isspace((unsigned char)c)) {
+      while (i < src.size() && src[i] != '\n' && std::isspace((unsigned char)src[i]))
+        i++;
+      push(Token::Space, start);
+    } else if (src.compare(i, 2, "//") == 0) {
+      i = std::min(src.find('\n', i), src.size());
+      push(Token::Space, start);
+    } else if (src.compare(i, 2, "/*") == 0) {
+      size_t end = src.find("*/", i + 2);
+      i = end == std::string::npos ? src.size() : end + 2;
+      push(Token::Space, start);
+    } else if (c == '#' && line_start) {
+      while (i < src.size() && (src[i] != '\n' || src[i - 1] == '\\'))
+        i++;
+      push(Token::Directive, start);
+    } else if (std::isalpha((unsigned char)c) || c == '_') {
+      while (i < src.size() && (std::isalnum((unsigned char)src[i]) || src[i] == '_'))
+        i++;
+      push(Token::Identifier, start);
+    } else if (std::isdigit((unsigned char)c) ||
+               (c == '.' && i + 1 < src.size() && std::isdigit((unsigned char)src[i + 1]))) {
+      while (i < src.size() && (std::isalnum((unsigned char)src[i]) || src[i] == '.' ||
+                                ((src[i] == '+' || src[i] == '-') &&
+                                 (src[i - 1] == 'e' || src[i - 1] == 'E'))))
+        i++;
+      push(Token::Number, start);
+    } else {
+      i++;
+      for (auto op : OPERATORS) {
+        if (src.compare(start, std::strlen(op), op) == 0) {
+          i = start + std::strlen(op);
+          break;
+        }
+      }
+      push(Token::Symbol, start);
+    }
+  }
+  return tokens;
+}
+
+// How a shader samples one of its sampler2D uniforms
+struct Sampler {
+  size_t declaration = NONE;
+  bool pointwise = true;
+  std::vector<std::pair<size_t, size_t>> calls = {}; // First and last token of sampling calls
+  std::set<std::string> resolutions = {};            // Uniforms dividing gl_FragCoord.xy
+};
+
+// Structure of a fragment shader, as far as fusion needs it
+struct ShaderInfo {
+  bool fusable = false;
+  std::string version;
+  std::vector<Token> tokens;
+  std::set<std::string> globals;
+  std::string output;
+  // Qualifiers of the output declaration, dropped so it becomes a plain global
+  size_t output_begin = NONE, output_end = NONE;
+  size_t main_type = NONE, main_open = NONE, main_close = NONE;
+  std::map<std::string, Sampler> samplers;
+};
+
+const std::set<std::string> QUALIFIERS = {
+    "uniform",   "out",           "in",    "inout",   "const", "flat",    "smooth",    "centroid",
+    "invariant", "noperspective", "highp", "mediump", "lowp",  "varying", "attribute",
+};
+const std::set<std::string> ASSIGNMENTS = {
+    "=", "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=", "<<=", ">>=", "++", "--",
+};
+
+std::shared_ptr<ShaderInfo> analyze(const std::string &source) {
+  auto info = std::make_shared<ShaderInfo>();
+  info->tokens = tokenize(source);
+  auto &tokens = info->tokens;
+
+  // Macros could hide anything, only the version is allowed
+  std::vector<size_t> code; // Tokens besides whitespace, comments and directives
+  for (size_t i = 0; i < tokens.size(); i++) {
+    if (tokens[i].kind == Token::Directive) {
+      if (tokens[i].text.rfind("#version", 0) != 0 || !info->version.empty())
+        return info;
+      info->version = tokens[i].text;
+    } else if (tokens[i].kind != Token::Space) {
+      code.push_back(i);
+    }
+  }
+  auto at = [&](size_t k) -> const std::string & {
+    static const std::string none;
+    return k < code.size() ? tokens[code[k]].text : none;
+  };
+  auto is_identifier = [&](size_t k) {
+    return k < code.size() && tokens[code[k]].kind == Token::Identifier;
+  };
+  // Index of the parenthesis closing the one at k
+  auto closing = [&](size_t k) {
+    int nesting = 0;
+    for (; k < code.size(); k++) {
+      if (at(k) == "(")
+        nesting++;
+      else if (at(k) == ")" && --nesting == 0)
+        return k;
+    }
+    return NONE;
+  };
+
+  std::set<std::string> vec2_uniforms;
+  bool has_out_params = false;
+
+  // Declarations at the top level, statement in [s, e)
+  auto declare = [&](size_t s, size_t e) {
+    size_t k = s;
+    if (k == e || at(k) == "precision")
+      return true;
+    if (at(k) == "layout") {
+      k = closing(k + 1);
+      if (k == NONE || k >= e)
+        return false;
+      k++;
+    }
+    bool is_uniform = false, is_out = false;
+    size_t out_token = NONE;
+    for (; k < e && QUALIFIERS.contains(at(k)); k++) {
+      if (at(k) == "in" || at(k) == "inout" || at(k) == "varying" || at(k) == "attribute")
+        return false; // Inputs of other stages can't be shared
+      is_uniform |= at(k) == "uniform";
+      if (at(k) == "out") {
+        is_out = true;
+        out_token = code[k];
+      }
+    }
+    if (k >= e || at(k) == "struct" || !is_identifier(k))
+      return false; // Structs and blocks are not supported
+    // Prototypes name a function right before the parenthesis
+    for (size_t p = k; p < e && at(p) != "="; p++) {
+      if (at(p) == "(") {
+        info->globals.insert(at(p - 1));
+        return true;
+      }
+    }
+
+    std::string type = at(k++);
+    if (at(k) == "[") {
+      while (k < e && at(k) != "]")
+        k++;
+      k++;
+    }
+    while (k < e) {
+      if (!is_identifier(k))
+        return false;
+      const std::string &name = at(k);
+      info->globals.insert(name);
+      if (is_out) {
+        if (!info->output.empty() || type != "vec4")
+          return false; // A single color output only
+        info->output = name;
+        info->output_begin = code[s];
+        info->output_end = out_token;
+      }
+      if (is_uniform && type == "sampler2D")
+        info->samplers[name].declaration = code[k];
+      if (is_uniform && type == "vec2")
+        vec2_uniforms.insert(name);
+
+      // Skips to the next declarator
+      int nesting = 0;
+      for (k++; k < e && !(nesting == 0 && at(k) == ","); k++) {
+        if (at(k) == "(" || at(k) == "[")
+          nesting++;
+        else if (at(k) == ")" || at(k) == "]")
+          nesting--;
+      }
+      k++;
+    }
+    return true;
+  };
+
+  size_t main_open_code = NONE, main_close_code = NONE;
+  std::optional<std::string> function;
+  int depth = 0;
+  size_t statement = 0;
+  for (size_t k = 0; k < code.size(); k++) {
+    const std::string &t = at(k);
+    if (depth > 0) {
+      if (t == "{") {
+        depth++;
+      } else if (t == "}" && --depth == 0) {
+        if (function == "main") {
+          info->main_close = code[k];
+          main_close_code = k;
+        }
+        function.reset();
+        statement = k + 1;
+      } else if (t == "out" || t == "inout") {
+        has_out_params = true;
+      }
+      continue;
+    }
+    if (t == "{") {
+      // Only function bodies may open braces at the top level
+      size_t paren = statement;
+      while (paren < k && at(paren) != "(")
+        paren++;
+      if (paren == k || paren == statement || !is_identifier(paren - 1))
+        return info;
+      function = at(paren - 1);
+      info->globals.insert(*function);
+      if (function == "main") {
+        if (paren < statement + 2 || at(paren - 2) != "void")
+          return info;
+        info->main_type = code[paren - 2];
+        info->main_open = code[k];
+        main_open_code = k;
+      }
+      for (size_t p = paren; p < k; p++)
+        has_out_params |= at(p) == "out" || at(p) == "inout";
+      depth = 1;
+    } else if (t == ";") {
+      if (!declare(statement, k))
+        return info;
+      statement = k + 1;
+    }
+  }
+  if (depth != 0 || info->output.empty() || main_close_code == NONE)
+    return info;
+
+  // Texture coordinates at the texel of the fragment, returns the resolution uniform
+  auto own_uv = [&](size_t b, size_t e) -> std::optional<std::string> {
+    while (at(b) == "(" && closing(b) == e - 1) {
+      b++;
+      e--;
+    }
+    if (e - b != 5 && e - b != 7)
+      return {};
+    if (at(b) != "gl_FragCoord" || at(b + 1) != "." || at(b + 2) != "xy" || at(b + 3) != "/" ||
+        !vec2_uniforms.contains(at(b + 4)))
+      return {};
+    if (e - b == 7 && (at(b + 5) != "." || at(b + 6) != "xy"))
+      return {};
+    return at(b + 4);
+  };
+  // A vec2 local of main() initialized to own texel coordinates and never written again
+  auto alias_uv = [&](size_t k) -> std::optional<std::string> {
+    const std::string &name = at(k);
+    if (has_out_params || info->globals.contains(name) || k < main_open_code ||
+        k > main_close_code)
+      return {};
+    std::optional<std::string> resolution;
+    int declarations = 0;
+    for (size_t p = main_open_code; p < main_close_code; p++) {
+      if (at(p) != name || at(p - 1) == ".")
+        continue;
+      if (at(p - 1) == "vec2") {
+        if (at(p + 1) != "=")
+          return {};
+        size_t end = p + 2;
+        int nesting = 0;
+        for (; end < main_close_code && !(nesting == 0 && (at(end) == ";" || at(end) == ","));
+             end++) {
+          nesting += at(end) == "(" ? 1 : at(end) == ")" ? -1 : 0;
+        }
+        resolution = own_uv(p + 2, end);
+        declarations++;
+        continue;
+      }
+      if (ASSIGNMENTS.contains(at(p + 1)) || at(p - 1) == "++" || at(p - 1) == "--" ||
+          at(p + 1) == "[" || (at(p + 1) == "." && ASSIGNMENTS.contains(at(p + 3))))
+        return {};
+    }
+    if (declarations != 1)
+      return {};
+    return resolution;
+  };
+
+  for (size_t k = 0; k < code.size(); k++) {
+    auto it = info->samplers.find(at(k));
+    if (it == info->samplers.end() || code[k] == it->second.declaration || at(k - 1) == ".")
+      continue;
+    auto &sampler = it->second;
+    // Samples are hoisted to the start of main(), so they must not happen elsewhere
+    if (k < main_open_code || k > main_close_code) {
+      sampler.pointwise = false;
+      continue;
+    }
+    bool is_texture = at(k - 2) == "texture", is_fetch = at(k - 2) == "texelFetch";
+    size_t end = k >= 2 && at(k - 1) == "(" ? closing(k - 1) : NONE;
+    if ((!is_texture && !is_fetch) || end == NONE) {
+      sampler.pointwise = false;
+      continue;
+    }
+
+    // Arguments as token ranges
+    std::vector<std::pair<size_t, size_t>> args = {{k, k}};
+    int nesting = 0;
+    for (size_t p = k; p < end; p++) {
+      if (at(p) == "(" || at(p) == "[")
+        nesting++;
+      else if (at(p) == ")" || at(p) == "]")
+        nesting--;
+      else if (at(p) == "," && nesting == 0)
+        args.push_back({p + 1, p + 1});
+      if (!(at(p) == "," && nesting == 0))
+        args.back().second = p + 1;
+    }
+
+    std::optional<std::string> resolution;
+    if (is_texture && args.size() == 2) {
+      auto [b, e] = args[1];
+      resolution = e - b == 1 ? alias_uv(b) : own_uv(b, e);
+    } else if (is_fetch && args.size() == 3) {
+      auto [b, e] = args[1];
+      bool own = e - b == 6 && at(b) == "ivec2" && at(b + 1) == "(" &&
+                 at(b + 2) == "gl_FragCoord" && at(b + 3) == "." && at(b + 4) == "xy" &&
+                 at(b + 5) == ")";
+      if (own && args[2].second - args[2].first == 1 && at(args[2].first) == "0")
+        resolution = "";
+    }
+    if (!resolution) {
+      sampler.pointwise = false;
+      continue;
+    }
+    if (!resolution->empty())
+      sampler.resolutions.insert(*resolution);
+    sampler.calls.push_back({code[k - 2], code[end]});
+  }
+
+  info->fusable = true;
+  return info;
+}
+
+// Emits the shader as a function vec4 m<index>_main()
+// Inputs name fused samplers and the member producing them
+std::string emit_member(const ShaderInfo &info, size_t index,
+                        const std::vector<std::pair<std::string, size_t>> &inputs) {
+  std::string prefix = fmt::format("m{}_", index);
+  std::map<size_t, std::pair<size_t, std::string>> replace; // First token -> last token, text
+
+  std::string hoisted;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    auto &[sampler, producer] = inputs[i];
+    std::string name = fmt::format("fused{}_{}", index, i);
+    // Intermediate targets are RGB8, the alpha of the producer never reached the consumer
+    hoisted += fmt::format("\n  vec4 {} = vec4(clamp(m{}_main().rgb, 0.0, 1.0), 1.0);", name,
+                           producer);
+    for (auto &[first, last] : info.samplers.at(sampler).calls)
+      replace[first] = {last, name};
+  }
+  replace[info.output_begin] = {info.output_end, ""};
+  replace[info.main_type] = {info.main_type, "vec4"};
+  replace[info.main_open] = {info.main_open, "{" + hoisted};
+  replace[info.main_close] = {info.main_close,
+                              fmt::format("  return {}{};\n}}", prefix, info.output)};
+
+  std::string out;
+  const Token *prev = nullptr; // Previous token besides whitespace
+  for (size_t i = 0; i < info.tokens.size(); i++) {
+    auto &token = info.tokens[i];
+    bool in_main = i > info.main_open && i < info.main_close;
+    if (auto it = replace.find(i); it != replace.end()) {
+      out += it->second.second;
+      i = it->second.first;
+      prev = &info.tokens[i];
+      continue;
+    }
+    if (token.kind == Token::Directive)
+      continue;
+    if (token.kind == Token::Identifier && info.globals.contains(token.text) &&
+        !(prev && prev->text == "."))
+      out += prefix + token.text;
+    else if (in_main && token.text == ";" && prev && prev->text == "return")
+      out += fmt::format(" {}{};", prefix, info.output);
+    else
+      out += token.text;
+    if (token.kind != Token::Space)
+      prev = &token;
+  }
+  return out;
+}
+
+//! State
+
+// A shader of a fused pass
+struct Member {
+  FragmentShaderNode *node;
+  std::shared_ptr<Shader> shader;
+  std::shared_ptr<ShaderInfo> info;
+  std::vector<std::pair<std::string, size_t>> inputs = {}; // Fused sampler, producing member
+};
+struct FusedProgram {
+  std::shared_ptr<Shader> shader;
+  bool failed = false;
+};
+
+// Fragment shaders support at least 16 texture units
+constexpr int MAX_TEXTURE_UNITS = 16;
+constexpr size_t MAX_INFOS = 256;
+constexpr size_t MAX_PROGRAMS = 64;
+
+std::mutex mutex;
+std::map<uint64_t, std::shared_ptr<ShaderInfo>> infos; // By source hash
+std::map<uint64_t, FusedProgram> programs;
+std::deque<uint64_t> program_order; // Oldest first
+std::atomic<uint64_t> fused_passes = 0;
+std::atomic<uint64_t> bytes_saved = 0;
+
+// State of a running benchmark, see ShaderFusion::start_benchmark()
+struct Benchmark {
+  std::weak_ptr<RenderGraph> graph;
+  EvalContext context;
+  int frames = 0; // Per phase
+  int done = 0;   // Frames of both phases so far, the unfused ones first
+  double seconds[2] = {};
+  uint64_t saved[2] = {};
+};
+std::unique_ptr<Benchmark> benchmark;
+
+std::shared_ptr<ShaderInfo> get_info(const std::shared_ptr<Shader> &shader) {
+  if (!shader)
+    return nullptr;
+  uint64_t hash = Hash::of(shader->get_source());
+  std::lock_guard lock(mutex);
+  if (auto it = infos.find(hash); it != infos.end())
+    return it->second;
+  if (infos.size() >= MAX_INFOS)
+    infos.clear();
+  return infos[hash] = analyze(shader->get_source());
+}
+// Node connected to an input pin, -1 if none
+int input_node(RenderGraph &graph, int pinid) {
+  for (auto &pair : graph.get_edges()) {
+    if (pair.second.to == pinid)
+      return graph.get_pin(pair.second.from).node_id;
+  }
+  return -1;
+}
+// Returns true if the sampler reads the producer at the texel of the fragment
+bool is_pointwise(EvalContext &context, const Member &consumer, const std::string &sampler) {
+  auto it = consumer.info->samplers.find(sampler);
+  if (it == consumer.info->samplers.end() || !it->second.pointwise)
+    return false;
+  for (auto &resolution : it->second.resolutions) {
+    bool matches = false;
+    for (auto &pin : consumer.node->get_uniform_pins()) {
+      if (pin.identifier != resolution || pin.type != DataType::Vec2)
+        continue;
+      auto value = context.get_pin_data(pin.pinid).try_get<Data::Vec2>();
+      matches = value && (*value)[0] == context.resolution.x && (*value)[1] == context.resolution.y;
+    }
+    if (!matches)
+      return false;
+  }
+  return true;
+}
+int texture_count(FragmentShaderNode &node) {
+  auto &pins = node.get_uniform_pins();
+  return int(std::count_if(pins.begin(), pins.end(),
+                           [](auto &pin) { return pin.type == DataType::Texture2D; }));
+}
+FusedProgram &get_program(const std::vector<Member> &members, RenderGraph &graph) {
+  Hash hash;
+  for (auto &member : members) {
+    hash.add(member.shader->get_source()).add_value(member.inputs.size());
+    for (auto &[sampler, producer] : member.inputs)
+      hash.add(sampler).add_value(producer);
+  }
+
+  std::lock_guard lock(mutex);
+  if (auto it = programs.find(hash.get()); it != programs.end())
+    return it->second;
+  if (programs.size() >= MAX_PROGRAMS) {
+    if (auto &evicted = programs.at(program_order.front()); evicted.shader)
+      evicted.shader->destroy();
+    programs.erase(program_order.front());
+    program_order.pop_front();
+  }
+
+  std::string source = fmt::format("{}\n\nout vec4 fragColor;\n", members.front().info->version);
+  for (size_t i = 0; i < members.size(); i++) {
+    source += fmt::format("\n// {}\n", members[i].shader->get_name());
+    source += emit_member(*members[i].info, i, members[i].inputs);
+  }
+  source += fmt::format("\nvoid main() {{ fragColor = m{}_main(); }}\n", members.size() - 1);
+
+  auto &program = programs[hash.get()];
+  program_order.push_back(hash.get());
+  program.shader = std::make_shared<Shader>("Fused", source);
+  if (!program.shader->compile(graph.graph_geometry)) {
+    // Fusion must never break a graph, the members run on their own instead
+    spdlog::warn("Failed to compile a fused shader, running its passes separately:\n{}",
+                 program.shader->get_log());
+    program.failed = true;
+  }
+  return program;
+}
+
+} // namespace
+
+std::map<int, int> ShaderFusion::plan(RenderGraph &graph, const std::vector<int> &order) {
+  std::map<int, int> fusion;
+  std::set<int> included(order.begin(), order.end());
+  for (int nodeid : order) {
+    auto producer = dynamic_cast<FragmentShaderNode *>(graph.get_node(nodeid));
+    if (!producer || producer->feedback) // Feedback passes render into their own buffers
+      continue;
+
+    // Only outputs read by a single pin of another shader
+    std::vector<Edge> reads;
+    for (auto &pair : graph.get_edges()) {
+      if (pair.second.from == producer->output_pin)
+        reads.push_back(pair.second);
+    }
+    if (reads.size() != 1)
+      continue;
+    int consumer_id = graph.get_pin(reads[0].to).node_id;
+    auto consumer = dynamic_cast<FragmentShaderNode *>(graph.get_node(consumer_id));
+    if (!consumer || consumer->feedback || !included.contains(consumer_id))
+      continue;
+    auto pin = std::find_if(consumer->uniform_pins.begin(), consumer->uniform_pins.end(),
+                            [&](auto &pin) { return pin.pinid == reads[0].to; });
+    if (pin == consumer->uniform_pins.end())
+      continue;
+
+    auto producer_info = get_info(producer->shader.lock());
+    auto consumer_info = get_info(consumer->shader.lock());
+    if (!producer_info || !consumer_info || !producer_info->fusable || !consumer_info->fusable ||
+        producer_info->version != consumer_info->version)
+      continue;
+    auto sampler = consumer_info->samplers.find(pin->identifier);
+    if (sampler != consumer_info->samplers.end() && sampler->second.pointwise)
+      fusion[nodeid] = consumer_id;
+  }
+  return fusion;
+}
+bool ShaderFusion::run(EvalContext &context, FragmentShaderNode &consumer) {
+  auto &graph = context.get_graph();
+  bool has_producers =
+      std::any_of(consumer.uniform_pins.begin(), consumer.uniform_pins.end(), [&](auto &pin) {
+        return pin.type == DataType::Texture2D && context.is_deferred(input_node(graph, pin.pinid));
+      });
+  if (!has_producers)
+    return false;
+
+  std::vector<Member> members;
+  int units = 0;
+
+  // Collects the members producers first, returns the index of the node
+  std::function<std::optional<size_t>(FragmentShaderNode &)> collect;
+  collect = [&](FragmentShaderNode &node) -> std::optional<size_t> {
+    Member member = {&node, node.get_compiled_shader(graph), nullptr};
+    if (!member.shader)
+      return {};
+    member.info = get_info(member.shader);
+    units += texture_count(node);
+
+    for (auto &pin : node.uniform_pins) {
+      int producer_id = input_node(graph, pin.pinid);
+      if (pin.type != DataType::Texture2D || producer_id < 0 || !context.is_deferred(producer_id))
+        continue;
+      auto &producer = dynamic_cast<FragmentShaderNode &>(*graph.get_node(producer_id));
+      if (member.info->fusable && is_pointwise(context, member, pin.identifier) &&
+          units + texture_count(producer) <= MAX_TEXTURE_UNITS) {
+        auto index = collect(producer);
+        if (!index)
+          return {};
+        member.inputs.push_back({pin.identifier, *index});
+      } else {
+        context.run_deferred(producer_id);
+      }
+      if (context.is_failed())
+        return {};
+    }
+    members.push_back(std::move(member));
+    return members.size() - 1;
+  };
+  if (!collect(consumer)) {
+    if (!context.is_failed())
+      context.stop();
+    return true;
+  }
+  if (members.size() == 1)
+    return false;
+
+  auto &program = get_program(members, graph);
+  if (program.failed) {
+    for (auto &[sampler, producer] : members.back().inputs) {
+      context.run_deferred(members[producer].node->id);
+      if (context.is_failed())
+        return true;
+    }
+    return false;
+  }
+
+  auto &shader = *program.shader;
+  shader.use();
+  for (size_t i = 0; i < members.size(); i++) {
+    for (auto &pin : members[i].node->uniform_pins) {
+      bool fused = std::any_of(members[i].inputs.begin(), members[i].inputs.end(),
+                               [&](auto &input) { return input.first == pin.identifier; });
+      Data data = context.get_pin_data(pin.pinid);
+      if (!fused && data)
+        shader.set_uniform(fmt::format("m{}_{}", i, pin.identifier).c_str(), data);
+    }
+  }
+
+  int width = context.resolution.x, height = context.resolution.y;
+  auto &target = context.get_target(width, height);
+  if (!target.begin()) {
+    shader.clear_textures();
+    context.stop();
+    return true;
+  }
+  graph.graph_geometry->draw_geometry();
+  shader.clear_textures();
+  target.end();
+  context.set_pin_data(consumer.output_pin, (Data::Texture2D)target.get_texture());
+
+  for (size_t i = 0; i + 1 < members.size(); i++)
+    context.consume_deferred(members[i].node->id);
+  // Every folded pass would have written its target and the consumer read it back
+  fused_passes += members.size() - 1;
+  bytes_saved += uint64_t(members.size() - 1) * 2 * width * height * 4;
+  return true;
+}
+FusionStats ShaderFusion::get_stats() { return FusionStats{fused_passes, bytes_saved}; }
+void ShaderFusion::start_benchmark(std::shared_ptr<RenderGraph> graph, ImVec2 resolution,
+                                   int frames) {
+  if (benchmark)
+    return;
+  benchmark = std::make_unique<Benchmark>();
+  benchmark->graph = graph;
+  benchmark->context.resolution = resolution;
+  benchmark->frames = std::max(frames, 1);
+  FramePacer::request_redraw();
+  spdlog::info("Fusion benchmark started at {}x{}", resolution.x, resolution.y);
+}
+void ShaderFusion::update_benchmark(std::chrono::milliseconds budget) {
+  if (!benchmark)
+    return;
+  auto graph = benchmark->graph.lock();
+  if (!graph) { // Closed in the meantime
+    benchmark->context.release();
+    benchmark.reset();
+    return;
+  }
+
+  // Every frame is timed on its own, finishing the GPU makes it cover its GPU time
+  bool fuse = graph->fuse_shaders;
+  int frames = benchmark->frames;
+  auto start = std::chrono::steady_clock::now();
+  glFinish();
+  while (benchmark->done < 2 * frames) {
+    int fused = benchmark->done / frames;
+    graph->fuse_shaders = fused;
+    graph->invalidate(); // Otherwise the results are reused
+    uint64_t bytes = bytes_saved;
+    auto frame_start = std::chrono::steady_clock::now();
+    graph->evaluate(benchmark->context);
+    glFinish();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - frame_start;
+    benchmark->seconds[fused] += elapsed.count();
+    benchmark->saved[fused] += bytes_saved - bytes;
+    benchmark->done++;
+    if (std::chrono::steady_clock::now() - start >= budget)
+      break;
+  }
+  graph->fuse_shaders = fuse;
+  if (benchmark->done < 2 * frames) {
+    FramePacer::request_redraw();
+    return;
+  }
+  graph->invalidate();
+
+  double unfused_ms = benchmark->seconds[0] * 1000.0 / frames;
+  double fused_ms = benchmark->seconds[1] * 1000.0 / frames;
+  double saved_mb = double(benchmark->saved[1]) / frames / 1e6;
+  spdlog::info("Fusion benchmark at {}x{}: unfused {:.3f} ms, fused {:.3f} ms per frame, {:.2f} "
+               "MB of render target traffic saved per frame",
+               benchmark->context.resolution.x, benchmark->context.resolution.y, unfused_ms,
+               fused_ms, saved_mb);
+  EventQueue::push(StatusMessage(fmt::format("Fusion saves {:.2f} MB per frame, {:.3f} ms -> "
+                                             "{:.3f} ms",
+                                             saved_mb, unfused_ms, fused_ms)));
+  benchmark->context.release();
+  benchmark.reset();
+}
+std::optional<float> ShaderFusion::get_benchmark_progress() {
+  if (!benchmark)
+    return {};
+  return float(benchmark->done) / float(2 * benchmark->frames);
+}
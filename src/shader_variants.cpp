@@ -0,0 +1,146 @@
+#include "shader_variants.h"
+
+#include "geometry.h"
+#include "hash.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <iterator>
+#include <list>
+#include <map>
+#include <optional>
+#include <regex>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+struct Variant {
+  std::shared_ptr<Shader> shader; // nullptr if it failed to compile
+  std::list<uint64_t>::iterator position;
+};
+
+std::map<uint64_t, Variant> variants;
+std::list<uint64_t> recent; // Most recently used first
+// Read by the UI while the render thread evaluates
+std::atomic<size_t> cached = 0;
+std::atomic<uint64_t> compiles = 0;
+std::atomic<uint64_t> hits = 0;
+
+bool is_identifier(const std::string &name) {
+  if (name.empty() || std::isdigit((unsigned char)name[0]))
+    return false;
+  return std::all_of(name.begin(), name.end(),
+                     [](char c) { return std::isalnum((unsigned char)c) || c == '_'; });
+}
+// GLSL type and constructor of a value, empty if it can't be baked
+std::optional<std::pair<std::string, std::string>> literal(Data data) {
+  auto real = [](float v) { return fmt::format("{:.9g}", v); }; // Round trips
+  switch (data.type) {
+  case DataType::Int:
+    return std::pair("int", fmt::format("int({})", data.get<Data::Int>()));
+  case DataType::IVec2: {
+    auto v = data.get<Data::IVec2>();
+    return std::pair("ivec2", fmt::format("ivec2({}, {})", v[0], v[1]));
+  }
+  case DataType::Float: {
+    float v = data.get<Data::Float>();
+    if (!std::isfinite(v))
+      return {};
+    return std::pair("float", fmt::format("float({})", real(v)));
+  }
+  case DataType::Vec2: {
+    auto v = data.get<Data::Vec2>();
+    if (!std::isfinite(v[0]) || !std::isfinite(v[1]))
+      return {};
+    return std::pair("vec2", fmt::format("vec2({}, {})", real(v[0]), real(v[1])));
+  }
+  default:
+    return {};
+  }
+}
+// Replaces the uniform declarations of the constants, empty if none were replaced
+std::optional<std::string>
+specialize(std::string source, const std::vector<std::pair<std::string, Data>> &constants) {
+  bool baked = false;
+  for (auto &[name, data] : constants) {
+    auto value = literal(data);
+    if (!value || !is_identifier(name))
+      continue;
+    std::regex declaration("\\buniform\\s+(?:(?:lowp|mediump|highp)\\s+)?" + value->first +
+                           "\\s+" + name + "\\s*;");
+    // Skips names declared in comments or preprocessor branches as well
+    auto begin = std::sregex_iterator(source.begin(), source.end(), declaration);
+    if (std::distance(begin, std::sregex_iterator()) != 1)
+      continue;
+    auto match = *begin;
+    source.replace(match.position(), match.length(),
+                   fmt::format("const {} {} = {};", value->first, name, value->second));
+    baked = true;
+  }
+  if (!baked)
+    return {};
+  return source;
+}
+
+} // namespace
+
+std::shared_ptr<Shader>
+ShaderVariants::get(const std::shared_ptr<Shader> &shader,
+                    const std::vector<std::pair<std::string, Data>> &constants,
+                    std::shared_ptr<Geometry> geometry) {
+  if (!shader || constants.empty())
+    return nullptr;
+
+  Hash hash;
+  hash.add(shader->get_source()).add_value(geometry.get());
+  for (auto &[name, data] : constants) {
+    hash.add(name);
+    if (auto value = literal(data))
+      hash.add(value->second);
+  }
+  uint64_t key = hash.get();
+
+  if (auto it = variants.find(key); it != variants.end()) {
+    recent.splice(recent.begin(), recent, it->second.position);
+    hits += bool(it->second.shader);
+    return it->second.shader;
+  }
+
+  if (variants.size() >= MAX_VARIANTS) {
+    if (auto &evicted = variants.at(recent.back()).shader)
+      evicted->destroy();
+    variants.erase(recent.back());
+    recent.pop_back();
+  }
+  recent.push_front(key);
+  auto &variant = variants[key];
+  variant.position = recent.begin();
+  cached = variants.size();
+
+  auto source = specialize(shader->get_source(), constants);
+  if (!source)
+    return nullptr; // Remembered, so the source is not searched again
+  variant.shader = std::make_shared<Shader>(shader->get_name() + " (specialized)", *source);
+  compiles++;
+  if (!variant.shader->compile(geometry)) {
+    // Specialization must never break a graph, the generic program runs instead
+    spdlog::warn("Failed to compile a specialized shader, using the generic one:\n{}",
+                 variant.shader->get_log());
+    variant.shader->destroy();
+    variant.shader = nullptr;
+  }
+  return variant.shader;
+}
+void ShaderVariants::clear() {
+  for (auto &pair : variants) {
+    if (pair.second.shader)
+      pair.second.shader->destroy();
+  }
+  variants.clear();
+  recent.clear();
+  cached = 0;
+}
+VariantStats ShaderVariants::get_stats() { return VariantStats{cached, compiles, hits}; }
@@ -0,0 +1,134 @@
+#include "srpack.h"
+
+#include "hash.h"
+
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+constexpr char MAGIC[4] = {'S', 'R', 'P', 'K'};
+constexpr uint32_t VERSION = 1;
+
+struct FileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t names_size; // Size of the name table following the entries
+};
+struct FileEntry {
+  uint64_t offset, size;
+  uint32_t name_offset, name_size;
+};
+
+uint64_t align(uint64_t value) {
+  return (value + ProjectPack::BLOB_ALIGNMENT - 1) / ProjectPack::BLOB_ALIGNMENT *
+         ProjectPack::BLOB_ALIGNMENT;
+}
+
+} // namespace
+
+//! ProjectPack
+
+ProjectPack::ProjectPack(const std::filesystem::path &path) : path(path) {
+  MappedFile file(path);
+  if (!file || file.get_size() < sizeof(FileHeader))
+    return;
+
+  FileHeader header;
+  std::memcpy(&header, file.get_data(), sizeof(header));
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+    spdlog::error("Unknown pack format in {}", path.string());
+    return;
+  }
+
+  uint64_t entries_end = sizeof(FileHeader) + sizeof(FileEntry) * uint64_t(header.entry_count);
+  if (entries_end + header.names_size > file.get_size())
+    return;
+  const char *names = reinterpret_cast<const char *>(file.get_data() + entries_end);
+
+  for (uint32_t i = 0; i < header.entry_count; i++) {
+    FileEntry entry;
+    std::memcpy(&entry, file.get_data() + sizeof(FileHeader) + sizeof(FileEntry) * i,
+                sizeof(entry));
+    if (uint64_t(entry.name_offset) + entry.name_size > header.names_size ||
+        entry.offset > file.get_size() || entry.size > file.get_size() - entry.offset) {
+      spdlog::error("Corrupted pack index in {}", path.string());
+      index.clear();
+      return;
+    }
+    index[std::string(names + entry.name_offset, entry.name_size)] = {entry.offset, entry.size};
+  }
+  this->file = file;
+}
+std::optional<std::span<const unsigned char>> ProjectPack::find(const std::string &name) const {
+  auto it = index.find(name);
+  if (it == index.end())
+    return {};
+  return std::span<const unsigned char>(file.get_data() + it->second.offset, it->second.size);
+}
+std::vector<std::string> ProjectPack::get_entries() const {
+  std::vector<std::string> entries;
+  for (auto &pair : index)
+    entries.push_back(pair.first);
+  return entries;
+}
+bool ProjectPack::extract(const std::filesystem::path &dir) const {
+  bool success = true;
+  for (auto &pair : index) {
+    if (pair.first.starts_with("cache/"))
+      continue;
+    auto path = (dir / pair.first).lexically_normal();
+    // Refuse entries escaping the project directory
+    auto rel = path.lexically_relative(dir.lexically_normal());
+    if (rel.empty() || *rel.begin() == "..") {
+      spdlog::warn("Skipping pack entry {}", pair.first);
+      continue;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (!write_file_atomic(path, find(pair.first).value())) {
+      spdlog::error("Failed to extract {}", path.string());
+      success = false;
+    }
+  }
+  return success;
+}
+bool ProjectPack::write(const std::filesystem::path &path, const std::vector<PackEntry> &entries) {
+  FileHeader header;
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.entry_count = entries.size();
+
+  std::vector<FileEntry> table;
+  std::string names;
+  for (auto &entry : entries) {
+    table.push_back({0, entry.data.size(), uint32_t(names.size()), uint32_t(entry.name.size())});
+    names += entry.name;
+  }
+  header.names_size = names.size();
+
+  uint64_t names_offset = sizeof(FileHeader) + sizeof(FileEntry) * table.size();
+  uint64_t size = names_offset + names.size();
+  uint64_t offset = align(size);
+  for (auto &entry : table) {
+    entry.offset = offset;
+    size = offset + entry.size;
+    offset = align(size);
+  }
+
+  // Assembled in memory, blobs are zero padded up to their aligned offsets
+  std::vector<unsigned char> data(size, 0);
+  std::memcpy(data.data(), &header, sizeof(header));
+  std::memcpy(data.data() + names_offset, names.data(), names.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    std::memcpy(data.data() + sizeof(header) + sizeof(FileEntry) * i, &table[i], sizeof(FileEntry));
+    if (!entries[i].data.empty())
+      std::memcpy(data.data() + table[i].offset, entries[i].data.data(), entries[i].data.size());
+  }
+  return write_file_atomic(path, data);
+}
+std::string ProjectPack::cache_entry(uint64_t key) {
+  return "cache/" + Hash::to_hex(key) + ".srtex";
+}
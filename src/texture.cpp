@@ -11,38 +11,237 @@
 #endif
 
 #include "texture.h"
+#include "hash.h"
+#include "srpack.h"
 
+#include <algorithm>
 #include <glad/gl.h>
 
 //! Texture
 
-Texture::Texture(std::string name, std::filesystem::path path) : path(path) {
+Texture::Texture(std::string name, std::filesystem::path path, TextureSettings settings,
+                 std::shared_ptr<ProjectPack> pack)
+    : path(path), pack(pack), settings(settings) {
   this->name = name;
-  stbi_set_flip_vertically_on_load(true);
-  unsigned char *data = stbi_load(path.string().c_str(), &width, &height, &channels, 0);
-
-  if (data == NULL)
+}
+bool Texture::ensure_loaded() {
+  if (!load_attempted) {
+    load_attempted = true;
+    load_image();
+    if (!gpu)
+      spdlog::warn("Missing texture \"{}\" in {}", name, path.string());
+  }
+  return gpu != nullptr;
+}
+void Texture::reload(TextureSettings settings) {
+  generation++; // Background loads with the old settings are stale
+  destroy();
+  this->settings = settings;
+  load_attempted = true;
+  load_image();
+}
+void Texture::load_image() {
+  if (!resolve_keys())
     return;
+  if ((gpu = TextureCache::find_gpu(gpu_key)))
+    return;
+  if (prepare_payload())
+    finish_load();
+}
+void Texture::adopt_image(Texture &staging) {
+  cache_key = staging.cache_key;
+  gpu_key = staging.gpu_key;
+  source = staging.source;
+  gpu = std::move(staging.gpu);
+  load_attempted = true;
+}
+bool Texture::prepare() {
+  prepared.reset();
+  return resolve_keys() && prepare_payload();
+}
+bool Texture::finish_load() {
+  load_attempted = true;
+  auto prep = std::move(prepared);
+  if (!prep)
+    return false;
+  // Another texture may have uploaded the same image in the meantime
+  if (!(gpu = TextureCache::find_gpu(gpu_key))) {
+    upload(prep->view);
+    TextureCache::insert_gpu(gpu_key, gpu);
+  }
+  return true;
+}
+bool Texture::resolve_keys() {
+  TextureCompression compression = settings.compression;
+  if (!is_compression_supported(compression)) {
+    spdlog::warn("{} is not supported by the OpenGL context, loading \"{}\" uncompressed",
+                 TEXTURE_COMPRESSION_NAMES[int(compression)], name);
+    compression = TextureCompression::None;
+  }
+  TextureSettings effective = settings;
+  effective.compression = compression;
+
+  // The source is either a file or an entry of a pack
+  if (pack) {
+    auto packed = pack->find(path.generic_string());
+    if (!packed)
+      return false;
+    if (!source) { // Packs are immutable, saved metadata is always valid
+      Hash hash;
+      hash.add(packed->data(), packed->size());
+      source = SourceInfo{packed->size(), 0, hash.get()};
+    }
+  } else {
+    if (!(source = TextureCache::hash_file(path)))
+      return false;
+  }
+  cache_key = TextureCache::make_key(source->hash, effective);
+
+  // Anisotropy is a property of the OpenGL texture but not of the payload
+  Hash gpu_hash;
+  gpu_hash.add_value(cache_key);
+  gpu_hash.add_value(settings.anisotropy);
+  gpu_key = gpu_hash.get();
+  return true;
+}
+bool Texture::prepare_payload() {
+  auto prep = std::make_shared<PreparedTexture>();
+
+  std::optional<TextureView> view;
+  if (pack) { // Packs may carry pre-decoded payloads
+    if (auto entry = pack->find(ProjectPack::cache_entry(cache_key)))
+      view = TextureCache::parse(entry.value());
+  }
+  if (!view) {
+    if ((prep->cached = TextureCache::load(cache_key)))
+      view = prep->cached->view;
+  }
 
-  // Placeholder format checking
-  int format = (channels <= 3) ? GL_RGB : GL_RGBA;
+  if (!view) {
+    MappedFile file;
+    std::optional<TexturePayload> payload;
+    if (pack) {
+      if (auto packed = pack->find(path.generic_string()))
+        payload = decode_image(packed->data(), packed->size());
+    } else if ((file = MappedFile(path))) {
+      payload = decode_image(file.get_data(), file.get_size());
+    }
+    if (!payload)
+      return false;
 
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
+    // Mips are generated on the CPU so that they can be cached as well
+    if (settings.mipmaps)
+      generate_mipmaps(payload.value());
+    TextureCompression compression = settings.compression;
+    if (compression != TextureCompression::None && is_compression_supported(compression))
+      compress_payload(payload.value(), compression);
+    TextureCache::store(cache_key, payload.value());
+    prep->payload = std::move(payload.value());
+    view = TextureView(prep->payload);
+  }
+
+  prep->view = view.value();
+  prepared = prep;
+  return true;
+}
+void Texture::upload(const TextureView &view) {
+  gpu = std::make_shared<GpuTexture>();
+  gpu->width = view.width();
+  gpu->height = view.height();
+  gpu->levels = view.levels.size();
+  gpu->compressed = view.compressed;
+
+  glGenTextures(1, &gpu->id);
+  glBindTexture(GL_TEXTURE_2D, gpu->id);
   // set the texture wrapping/filtering options (on the currently bound
   // texture object)
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+  for (size_t l = 0; l < view.levels.size(); l++) {
+    auto &level = view.levels[l];
+    if (view.compressed)
+      glCompressedTexImage2D(GL_TEXTURE_2D, l, view.format, level.width, level.height, 0,
+                             level.size, view.level_data(l));
+    else
+      glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, level.width, level.height, 0, GL_RGBA,
+                   GL_UNSIGNED_BYTE, view.level_data(l));
+    gpu->vram_size += level.size;
+  }
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, gpu->levels - 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  (gpu->levels > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexImage2D(GL_TEXTURE_2D,
-               0,       // mip map
-               GL_RGBA, // format to store
-               width, height,
-               0, // always 0
-               format, GL_UNSIGNED_BYTE, data);
 
-  stbi_image_free(data);
+  if (settings.anisotropy > 1.0f &&
+      (GLAD_GL_ARB_texture_filter_anisotropic || GLAD_GL_EXT_texture_filter_anisotropic)) {
+    float max_anisotropy = 1.0f;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &max_anisotropy);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY,
+                    std::min(settings.anisotropy, max_anisotropy));
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+std::optional<FileWrite> Texture::save_source(std::filesystem::path project_root) {
+  if (!pack) // Regular textures are never written
+    return {};
+  auto abs_path = project_root / path;
+  std::error_code ec;
+  auto data = pack->find(path.generic_string());
+  if (std::filesystem::exists(abs_path, ec) || !data)
+    return {};
+  return FileWrite{abs_path, std::vector<unsigned char>(data->begin(), data->end())};
+}
+toml::table Texture::save(std::filesystem::path project_root) {
+  // Textures inside the project are saved relative to it
+  auto saved_path = path;
+  auto rel = path.lexically_relative(project_root);
+  if (!pack && !rel.empty() && *rel.begin() != "..")
+    saved_path = rel;
+
+  toml::table tbl{
+      {"name", name},                             //
+      {"path", saved_path.generic_string()},      //
+      {"mipmaps", settings.mipmaps},              //
+      {"anisotropy", settings.anisotropy},        //
+      {"compression", int(settings.compression)}, //
+  };
+  if (source) { // Lets the next open skip reading the image
+    tbl.insert("size", int64_t(source->size));
+    tbl.insert("mtime", source->mtime);
+    tbl.insert("hash", Hash::to_hex(source->hash));
+  }
+  return tbl;
+}
+std::shared_ptr<Texture> Texture::load(toml::table &tbl, std::shared_ptr<AssetManager> assets) {
+  std::string name = tbl["name"].value<std::string>().value();
+  // Absolute, relative to the project root or the name of a pack entry
+  std::filesystem::path path = tbl["path"].value<std::string>().value();
+
+  // Import settings are optional for older projects
+  TextureSettings settings;
+  settings.mipmaps = tbl["mipmaps"].value_or<bool>(true);
+  settings.anisotropy = tbl["anisotropy"].value_or<float>(1.0f);
+  settings.compression = TextureCompression(tbl["compression"].value_or<int>(0));
+
+  std::shared_ptr<ProjectPack> pack = nullptr;
+  if (assets->pack && assets->pack->contains(path.generic_string()))
+    pack = assets->pack;
+  else
+    path = assets->project_root / path; // Absolute paths replace the root
+
+  // Textures are loaded on first use
+  Texture texture(name, path, settings, pack);
+  auto size = tbl["size"].value<int64_t>();
+  auto hash = Hash::from_hex(tbl["hash"].value_or<std::string>(""));
+  if (size && hash) {
+    SourceInfo info = {uint64_t(size.value()), tbl["mtime"].value_or<int64_t>(0), hash.value()};
+    if (pack)
+      texture.source = info;
+    else
+      TextureCache::remember(path, info);
+  }
 
-  loaded = true;
+  return std::make_shared<Texture>(texture);
 }
@@ -0,0 +1,178 @@
+#include "texture_cache.h"
+
+#include "app_path.h"
+#include "hash.h"
+
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+constexpr char MAGIC[4] = {'S', 'R', 'T', 'X'};
+constexpr uint32_t VERSION = 2;
+// Payload data is aligned so it can be uploaded straight from a mapping
+constexpr uint64_t DATA_ALIGNMENT = 64;
+
+struct FileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t format;
+  uint32_t compressed;
+  uint32_t level_count;
+  uint32_t reserved;
+  uint64_t data_offset;
+  uint64_t data_size;
+};
+struct FileLevel {
+  int32_t width, height;
+  uint64_t offset, size;
+};
+
+std::filesystem::path entry_path(uint64_t key) {
+  return TextureCache::directory() / (Hash::to_hex(key) + ".srtex");
+}
+
+std::mutex mutex;
+// Content hashes by absolute path
+std::unordered_map<std::string, SourceInfo> file_hashes;
+std::unordered_map<uint64_t, std::weak_ptr<GpuTexture>> gpu_textures;
+
+} // namespace
+
+std::filesystem::path TextureCache::directory() { return getCacheDir() / "textures"; }
+std::optional<SourceInfo> TextureCache::hash_file(const std::filesystem::path &path) {
+  std::error_code ec;
+  uint64_t size = std::filesystem::file_size(path, ec);
+  if (ec)
+    return {};
+  int64_t mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+  if (ec)
+    return {};
+  std::string key = std::filesystem::absolute(path).string();
+
+  {
+    std::lock_guard lock(mutex);
+    auto it = file_hashes.find(key);
+    if (it != file_hashes.end() && it->second.size == size && it->second.mtime == mtime)
+      return it->second;
+  }
+
+  MappedFile file(path);
+  if (!file)
+    return {};
+  Hash hash;
+  hash.add(file.get_data(), file.get_size());
+
+  SourceInfo info = {size, mtime, hash.get()};
+  std::lock_guard lock(mutex);
+  file_hashes[key] = info;
+  return info;
+}
+void TextureCache::remember(const std::filesystem::path &path, const SourceInfo &info) {
+  std::lock_guard lock(mutex);
+  file_hashes[std::filesystem::absolute(path).string()] = info;
+}
+uint64_t TextureCache::make_key(uint64_t content_hash, const TextureSettings &settings) {
+  Hash hash;
+  hash.add_value(content_hash);
+  hash.add_value(settings.mipmaps);
+  hash.add_value(int(settings.compression));
+  hash.add_value(VERSION);
+  return hash.get();
+}
+std::optional<TextureView> TextureCache::parse(std::span<const unsigned char> entry) {
+  if (entry.size() < sizeof(FileHeader))
+    return {};
+
+  FileHeader header;
+  std::memcpy(&header, entry.data(), sizeof(header));
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION)
+    return {};
+  uint64_t table_end = sizeof(FileHeader) + sizeof(FileLevel) * uint64_t(header.level_count);
+  if (table_end > header.data_offset || header.data_offset > entry.size() ||
+      header.data_size > entry.size() - header.data_offset)
+    return {};
+
+  TextureView view;
+  view.format = header.format;
+  view.compressed = header.compressed;
+  view.data = entry.data() + header.data_offset;
+  for (uint32_t i = 0; i < header.level_count; i++) {
+    FileLevel level;
+    std::memcpy(&level, entry.data() + sizeof(FileHeader) + sizeof(FileLevel) * i, sizeof(level));
+    if (level.offset > header.data_size || level.size > header.data_size - level.offset)
+      return {};
+    view.levels.push_back({level.width, level.height, level.offset, level.size});
+  }
+  return view;
+}
+std::optional<CachedPayload> TextureCache::load(uint64_t key) {
+  MappedFile file(entry_path(key));
+  if (!file)
+    return {};
+  auto view = parse({file.get_data(), file.get_size()});
+  if (!view)
+    return {};
+  return CachedPayload{file, view.value()};
+}
+std::optional<std::vector<unsigned char>> TextureCache::read(uint64_t key) {
+  return read_file(entry_path(key));
+}
+bool TextureCache::store(uint64_t key, const TexturePayload &payload) {
+  std::error_code ec;
+  std::filesystem::create_directories(directory(), ec);
+
+  FileHeader header;
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.format = payload.format;
+  header.compressed = payload.compressed;
+  header.level_count = payload.levels.size();
+  header.reserved = 0;
+  header.data_size = payload.data.size();
+  uint64_t table_end = sizeof(FileHeader) + sizeof(FileLevel) * payload.levels.size();
+  header.data_offset = (table_end + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+
+  // Write to a temporary file first so readers never observe partial entries
+  // Jobs may store the same entry concurrently, so each thread has its own
+  auto path = entry_path(key);
+  auto tmp_path = path;
+  tmp_path += fmt::format(".{}.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      spdlog::warn("Failed to write texture cache entry {}", path.string());
+      return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (auto &level : payload.levels) {
+      FileLevel l = {level.width, level.height, level.offset, level.size};
+      file.write(reinterpret_cast<const char *>(&l), sizeof(l));
+    }
+    std::string padding(header.data_offset - table_end, '\0');
+    file.write(padding.data(), padding.size());
+    file.write(reinterpret_cast<const char *>(payload.data.data()), payload.data.size());
+    if (!file)
+      return false;
+  }
+  std::filesystem::rename(tmp_path, path, ec);
+  return !ec;
+}
+std::shared_ptr<GpuTexture> TextureCache::find_gpu(uint64_t key) {
+  std::lock_guard lock(mutex);
+  auto it = gpu_textures.find(key);
+  if (it == gpu_textures.end())
+    return nullptr;
+  if (auto gpu = it->second.lock())
+    return gpu;
+  gpu_textures.erase(it);
+  return nullptr;
+}
+void TextureCache::insert_gpu(uint64_t key, std::shared_ptr<GpuTexture> gpu) {
+  std::lock_guard lock(mutex);
+  gpu_textures[key] = gpu;
+}
@@ -0,0 +1,386 @@
+#include "texture_codec.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <glad/gl.h>
+#include <stb_image.h>
+
+//! Helpers
+
+namespace {
+
+constexpr int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Writes bit fields LSB first into a zeroed block
+struct BitWriter {
+  uint8_t *out;
+  int pos = 0;
+
+  BitWriter(uint8_t *out) : out(out) {}
+  void write(uint32_t value, int bits) {
+    for (int i = 0; i < bits; i++, pos++) {
+      if ((value >> i) & 1)
+        out[pos >> 3] |= uint8_t(1 << (pos & 7));
+    }
+  }
+};
+
+// Finds the two pixels at the extremes of the principal axis of a block
+// Only the first `channels` channels are considered (3 = RGB, 4 = RGBA)
+void principal_endpoints(const uint8_t rgba[64], int channels, std::array<float, 4> &lo,
+                         std::array<float, 4> &hi) {
+  std::array<float, 4> mean = {};
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < channels; c++)
+      mean[c] += rgba[i * 4 + c] / 16.0f;
+
+  float cov[4][4] = {};
+  for (int i = 0; i < 16; i++) {
+    for (int a = 0; a < channels; a++) {
+      for (int b = 0; b < channels; b++)
+        cov[a][b] += (rgba[i * 4 + a] - mean[a]) * (rgba[i * 4 + b] - mean[b]);
+    }
+  }
+
+  // Power iteration for the dominant eigenvector
+  std::array<float, 4> axis = {1.0f, 1.0f, 1.0f, channels == 4 ? 1.0f : 0.0f};
+  for (int iter = 0; iter < 8; iter++) {
+    std::array<float, 4> next = {};
+    for (int a = 0; a < channels; a++)
+      for (int b = 0; b < channels; b++)
+        next[a] += cov[a][b] * axis[b];
+    float len = 0.0f;
+    for (int c = 0; c < channels; c++)
+      len = std::max(len, std::abs(next[c]));
+    if (len < 1e-6f)
+      break;
+    for (int c = 0; c < channels; c++)
+      axis[c] = next[c] / len;
+  }
+
+  float min_t = 1e30f, max_t = -1e30f;
+  int min_i = 0, max_i = 0;
+  for (int i = 0; i < 16; i++) {
+    float t = 0.0f;
+    for (int c = 0; c < channels; c++)
+      t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+    if (t < min_t) {
+      min_t = t;
+      min_i = i;
+    }
+    if (t > max_t) {
+      max_t = t;
+      max_i = i;
+    }
+  }
+  for (int c = 0; c < 4; c++) {
+    lo[c] = rgba[min_i * 4 + c];
+    hi[c] = rgba[max_i * 4 + c];
+  }
+}
+
+uint16_t pack_565(const std::array<float, 4> &c) {
+  int r = std::clamp(int(std::lround(c[0] * 31.0f / 255.0f)), 0, 31);
+  int g = std::clamp(int(std::lround(c[1] * 63.0f / 255.0f)), 0, 63);
+  int b = std::clamp(int(std::lround(c[2] * 31.0f / 255.0f)), 0, 31);
+  return uint16_t(r << 11 | g << 5 | b);
+}
+std::array<int, 3> unpack_565(uint16_t c) {
+  int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+  return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+}
+
+// Encodes the color part of a BC1/BC3 block
+// If `punchthrough` is set, pixels with alpha < 128 are encoded as transparent
+void encode_color_block(const uint8_t rgba[64], uint8_t out[8], bool punchthrough) {
+  std::array<float, 4> lo, hi;
+  principal_endpoints(rgba, 3, lo, hi);
+  uint16_t c0 = pack_565(hi), c1 = pack_565(lo);
+
+  // 4 color mode requires c0 > c1, 3 color + transparent mode requires c0 <= c1
+  if ((!punchthrough && c0 < c1) || (punchthrough && c0 > c1))
+    std::swap(c0, c1);
+
+  auto e0 = unpack_565(c0), e1 = unpack_565(c1);
+  std::array<std::array<int, 3>, 4> palette;
+  palette[0] = e0;
+  palette[1] = e1;
+  for (int c = 0; c < 3; c++) {
+    if (c0 > c1) {
+      palette[2][c] = (2 * e0[c] + e1[c]) / 3;
+      palette[3][c] = (e0[c] + 2 * e1[c]) / 3;
+    } else {
+      palette[2][c] = (e0[c] + e1[c]) / 2;
+      palette[3][c] = 0;
+    }
+  }
+  int candidates = (c0 > c1) ? 4 : 3;
+
+  uint32_t indices = 0;
+  for (int i = 0; i < 16; i++) {
+    const uint8_t *px = rgba + i * 4;
+    int best = 0;
+    if (punchthrough && px[3] < 128) {
+      best = 3;
+    } else if (c0 != c1) {
+      int best_err = 1 << 30;
+      for (int p = 0; p < candidates; p++) {
+        int dr = px[0] - palette[p][0], dg = px[1] - palette[p][1], db = px[2] - palette[p][2];
+        int err = dr * dr + dg * dg + db * db;
+        if (err < best_err) {
+          best_err = err;
+          best = p;
+        }
+      }
+    }
+    indices |= uint32_t(best) << (2 * i);
+  }
+
+  out[0] = c0 & 0xff;
+  out[1] = c0 >> 8;
+  out[2] = c1 & 0xff;
+  out[3] = c1 >> 8;
+  for (int i = 0; i < 4; i++)
+    out[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+// Copies a 4x4 block from an RGBA8 image, clamping at the edges
+void fetch_block(const unsigned char *src, int width, int height, int bx, int by,
+                 uint8_t block[64]) {
+  for (int y = 0; y < 4; y++) {
+    int sy = std::min(by * 4 + y, height - 1);
+    for (int x = 0; x < 4; x++) {
+      int sx = std::min(bx * 4 + x, width - 1);
+      std::memcpy(block + (y * 4 + x) * 4, src + (size_t(sy) * width + sx) * 4, 4);
+    }
+  }
+}
+
+} // namespace
+
+//! Block encoders
+
+void encode_bc1_block(const uint8_t rgba[64], uint8_t out[8]) {
+  bool has_alpha = false;
+  for (int i = 0; i < 16; i++)
+    has_alpha |= rgba[i * 4 + 3] < 128;
+  encode_color_block(rgba, out, has_alpha);
+}
+void encode_bc3_block(const uint8_t rgba[64], uint8_t out[16]) {
+  int a_min = 255, a_max = 0;
+  for (int i = 0; i < 16; i++) {
+    a_min = std::min(a_min, int(rgba[i * 4 + 3]));
+    a_max = std::max(a_max, int(rgba[i * 4 + 3]));
+  }
+
+  std::memset(out, 0, 16);
+  out[0] = uint8_t(a_max);
+  out[1] = uint8_t(a_min);
+
+  if (a_max != a_min) { // 8 alpha mode (a0 > a1)
+    int palette[8] = {a_max, a_min};
+    for (int k = 2; k < 8; k++)
+      palette[k] = ((8 - k) * a_max + (k - 1) * a_min) / 7;
+
+    BitWriter bits(out + 2);
+    for (int i = 0; i < 16; i++) {
+      int a = rgba[i * 4 + 3], best = 0, best_err = 256;
+      for (int k = 0; k < 8; k++) {
+        int err = std::abs(a - palette[k]);
+        if (err < best_err) {
+          best_err = err;
+          best = k;
+        }
+      }
+      bits.write(best, 3);
+    }
+  }
+
+  // The color block of BC3 is always decoded in 4 color mode
+  encode_color_block(rgba, out + 8, false);
+}
+void encode_bc7_block(const uint8_t rgba[64], uint8_t out[16]) {
+  std::array<float, 4> lo, hi;
+  principal_endpoints(rgba, 4, lo, hi);
+
+  // Quantize endpoints to 7 bits + a shared p-bit per endpoint
+  int e[2][4], p[2];
+  const std::array<float, 4> *ends[2] = {&lo, &hi};
+  for (int n = 0; n < 2; n++) {
+    int best_err = 1 << 30;
+    for (int pbit = 0; pbit < 2; pbit++) {
+      int q[4], err = 0;
+      for (int c = 0; c < 4; c++) {
+        q[c] = std::clamp(int(std::lround(((*ends[n])[c] - pbit) / 2.0f)), 0, 127);
+        int d = ((q[c] << 1) | pbit) - int((*ends[n])[c]);
+        err += d * d;
+      }
+      if (err < best_err) {
+        best_err = err;
+        p[n] = pbit;
+        std::copy(q, q + 4, e[n]);
+      }
+    }
+  }
+
+  int palette[16][4];
+  for (int k = 0; k < 16; k++) {
+    for (int c = 0; c < 4; c++) {
+      int v0 = (e[0][c] << 1) | p[0], v1 = (e[1][c] << 1) | p[1];
+      palette[k][c] = ((64 - BC7_WEIGHTS[k]) * v0 + BC7_WEIGHTS[k] * v1 + 32) >> 6;
+    }
+  }
+
+  int indices[16];
+  for (int i = 0; i < 16; i++) {
+    int best = 0, best_err = 1 << 30;
+    for (int k = 0; k < 16; k++) {
+      int err = 0;
+      for (int c = 0; c < 4; c++) {
+        int d = rgba[i * 4 + c] - palette[k][c];
+        err += d * d;
+      }
+      if (err < best_err) {
+        best_err = err;
+        best = k;
+      }
+    }
+    indices[i] = best;
+  }
+
+  // The anchor index has an implicit 0 MSB, swap endpoints if necessary
+  if (indices[0] & 8) {
+    std::swap(e[0], e[1]);
+    std::swap(p[0], p[1]);
+    for (int &index : indices)
+      index = 15 - index;
+  }
+
+  std::memset(out, 0, 16);
+  BitWriter bits(out);
+  bits.write(1 << 6, 7); // Mode 6
+  for (int c = 0; c < 4; c++) {
+    bits.write(e[0][c], 7);
+    bits.write(e[1][c], 7);
+  }
+  bits.write(p[0], 1);
+  bits.write(p[1], 1);
+  bits.write(indices[0], 3);
+  for (int i = 1; i < 16; i++)
+    bits.write(indices[i], 4);
+}
+
+//! Payload processing
+
+std::optional<TexturePayload> decode_image(const unsigned char *data, size_t size) {
+  if (data == nullptr || size > size_t(INT32_MAX))
+    return {};
+  int width, height, channels;
+  // Always expand to RGBA, flipping is done here since the stb flag is global state
+  unsigned char *pixels = stbi_load_from_memory(data, int(size), &width, &height, &channels, 4);
+  if (pixels == NULL)
+    return {};
+
+  TexturePayload payload;
+  payload.format = GL_RGBA8;
+  payload.data.resize(size_t(width) * height * 4);
+  size_t stride = size_t(width) * 4;
+  for (int y = 0; y < height; y++)
+    std::memcpy(payload.data.data() + y * stride, pixels + (height - 1 - y) * stride, stride);
+  payload.levels.push_back({width, height, 0, payload.data.size()});
+
+  stbi_image_free(pixels);
+  return payload;
+}
+void generate_mipmaps(TexturePayload &payload) {
+  if (payload.compressed || payload.empty())
+    return;
+  payload.levels.resize(1);
+
+  while (payload.levels.back().width > 1 || payload.levels.back().height > 1) {
+    auto prev = payload.levels.back();
+    TexturePayload::Level level;
+    level.width = std::max(1, prev.width / 2);
+    level.height = std::max(1, prev.height / 2);
+    level.offset = payload.data.size();
+    level.size = size_t(level.width) * level.height * 4;
+    payload.data.resize(payload.data.size() + level.size);
+
+    const unsigned char *src = payload.data.data() + prev.offset;
+    unsigned char *dst = payload.data.data() + level.offset;
+    for (int y = 0; y < level.height; y++) {
+      int y0 = std::min(y * 2, prev.height - 1), y1 = std::min(y * 2 + 1, prev.height - 1);
+      for (int x = 0; x < level.width; x++) {
+        int x0 = std::min(x * 2, prev.width - 1), x1 = std::min(x * 2 + 1, prev.width - 1);
+        for (int c = 0; c < 4; c++) {
+          int sum = src[(size_t(y0) * prev.width + x0) * 4 + c] +
+                    src[(size_t(y0) * prev.width + x1) * 4 + c] +
+                    src[(size_t(y1) * prev.width + x0) * 4 + c] +
+                    src[(size_t(y1) * prev.width + x1) * 4 + c];
+          dst[(size_t(y) * level.width + x) * 4 + c] = uint8_t((sum + 2) / 4);
+        }
+      }
+    }
+    payload.levels.push_back(level);
+  }
+}
+bool compress_payload(TexturePayload &payload, TextureCompression compression) {
+  if (payload.compressed || compression == TextureCompression::None)
+    return false;
+
+  size_t block_size = (compression == TextureCompression::BC1) ? 8 : 16;
+  auto encode = (compression == TextureCompression::BC1)   ? encode_bc1_block
+                : (compression == TextureCompression::BC3) ? encode_bc3_block
+                                                           : encode_bc7_block;
+
+  TexturePayload out;
+  out.format = compression_format(compression);
+  out.compressed = true;
+
+  for (size_t l = 0; l < payload.levels.size(); l++) {
+    auto &src = payload.levels[l];
+    int bw = (src.width + 3) / 4, bh = (src.height + 3) / 4;
+
+    TexturePayload::Level level = {src.width, src.height, out.data.size(),
+                                   size_t(bw) * bh * block_size};
+    out.data.resize(out.data.size() + level.size);
+
+    uint8_t block[64];
+    unsigned char *dst = out.data.data() + level.offset;
+    for (int by = 0; by < bh; by++) {
+      for (int bx = 0; bx < bw; bx++) {
+        fetch_block(payload.level_data(l), src.width, src.height, bx, by, block);
+        encode(block, dst + (size_t(by) * bw + bx) * block_size);
+      }
+    }
+    out.levels.push_back(level);
+  }
+
+  payload = std::move(out);
+  return true;
+}
+unsigned int compression_format(TextureCompression compression) {
+  switch (compression) {
+  case TextureCompression::BC1:
+    return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+  case TextureCompression::BC3:
+    return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  case TextureCompression::BC7:
+    return GL_COMPRESSED_RGBA_BPTC_UNORM;
+  default:
+    return GL_RGBA8;
+  }
+}
+bool is_compression_supported(TextureCompression compression) {
+  switch (compression) {
+  case TextureCompression::BC1:
+  case TextureCompression::BC3:
+    return GLAD_GL_EXT_texture_compression_s3tc;
+  case TextureCompression::BC7:
+    return GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_compression_bptc;
+  default:
+    return true;
+  }
+}
@@ -2,6 +2,7 @@
 
 #include "editor.h"
 #include "events.h"
+#include "render_thread.h"
 #include "shader.h"
 #include "utils.h"
 
@@ -32,6 +33,7 @@ void EditorWidget::onStartup() {
   window = tab->AddWindow(buffer);
 
   last_update = buffer->GetUpdateCount();
+  revision = shader->get_revision();
 };
 void EditorWidget::onShutdown() {
   auto &zep = zep_get_editor();
@@ -46,6 +48,13 @@ void EditorWidget::onUpdate() {
     return;
   }
 
+  // Source was reloaded from disk
+  if (shader->get_revision() != revision) {
+    buffer->SetText(shader->get_source());
+    last_update = buffer->GetUpdateCount();
+    revision = shader->get_revision();
+  }
+
   uint64_t new_update = buffer->GetUpdateCount();
   if (new_update != last_update)
     this->is_dirty = true;
@@ -53,20 +62,28 @@ void EditorWidget::onUpdate() {
 
   if (is_dirty) {
     std::string text = get_buffer_text();
+    auto lock = RenderThread::lock_evaluation(); // The program may be in use right now
     shader->recompile_with_source(text);
+    revision = shader->get_revision();
     is_dirty = false;
+    EventQueue::push(AssetChanged(shader_id));
   }
 
   if (isKeyJustPressed(ImGuiKey_F5) && is_focused) {
+    auto lock = RenderThread::lock_evaluation();
     if (!shader->is_compiled())
       spdlog::error(shader->get_log());
     else
       shader->recompile();
+    EventQueue::push(AssetChanged(shader_id));
   }
 };
 void EditorWidget::render(bool *p_open) {
+  auto lock = RenderThread::lock(); // Sources are edited in place
   ImGui::SetNextWindowSize({600, 400}, ImGuiCond_FirstUseEver);
-  if (!ImGui::Begin(title.c_str(), p_open, ImGuiWindowFlags_NoScrollbar)) {
+  bool shown = ImGui::Begin(title.c_str(), p_open, ImGuiWindowFlags_NoScrollbar);
+  set_visible(shown);
+  if (!shown) {
     ImGui::End();
     return;
   }
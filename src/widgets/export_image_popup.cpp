@@ -1,55 +1,167 @@
 #include "widgets/export_image_popup.h"
 
+#include "events.h"
 #include "graph.h"
-#include "nodes/output_node.h"
+#include "jobs.h"
+#include "parameter_sweep.h"
 #include "portable-file-dialogs.h"
+#include "render_target.h"
+#include "render_thread.h"
 #include <GL/gl.h> // For glGetTexImage otherwise GLES/gl3.h
+#include <algorithm>
+#include <cctype>
 #include <imgui.h>
 #include <imgui_stdlib.h>
+#include <optional>
 #include <spdlog/spdlog.h>
 #include <stb_image.h>
 #include <stb_image_write.h>
 
+namespace {
+
+// Keeps the file of an output in the export directory, e.g. "../a/b" becomes "___a_b"
+std::string to_file_name(std::string name) {
+  for (auto &c : name) {
+    if (!std::isalnum((unsigned char)c) && c != '-' && c != '_' && c != ' ')
+      c = '_';
+  }
+  return name;
+}
+
+} // namespace
+
 void ExportImagePopup::export_image() {
-  graph->clear_graph_data();
-  graph->set_resolution(ImVec2({float(resolution[0]), float(resolution[1])}));
-  if (override_time)
-    graph->set_time(time);
-  graph->evaluate();
-
-  GLuint img = 0;
-  if (auto if_node = graph->get_root_node()) {
-    auto out = dynamic_cast<OutputNode *>(if_node.value());
-    img = out->get_image();
+  // All outputs come from a single evaluation, results matching a viewport are shared
+  EvalContext context;
+  context.resolution = ImVec2({float(resolution[0]), float(resolution[1])});
+  context.time = override_time ? time : graph->time;
+  context.outputs = std::vector<std::string>(outputs.begin(), outputs.end());
+  graph->evaluate(context);
+
+  if (outputs.empty()) {
+    encode(context.get_output(), resolution[0], resolution[1], export_path);
+    return;
+  }
+  // Every output gets its own file if there are several
+  std::set<std::string> file_names;
+  for (auto &name : outputs) {
+    std::string file_name = to_file_name(name);
+    while (!file_names.insert(file_name).second) // Names may match once sanitized
+      file_name += '_';
+    std::filesystem::path path(export_path);
+    if (outputs.size() > 1)
+      path.replace_filename(fmt::format("{}_{}{}", path.stem().string(), file_name,
+                                        path.extension().string()));
+    encode(context.get_output(name), resolution[0], resolution[1], path.string());
+  }
+}
+void ExportImagePopup::export_sweep() {
+  // Only the first selected output is swept
+  std::string output = outputs.empty() ? "" : *outputs.begin();
+  auto sheet = ParameterSweep::render(graph, axes, thumbnail[0], thumbnail[1],
+                                      override_time ? time : graph->time, output);
+  if (!sheet) {
+    EventQueue::push(ExportProgress(1.0f, "Failed to export image!"));
+    return;
+  }
+  encode(sheet->get_texture(), sheet->get_width(), sheet->get_height(), export_path);
+  RenderTargetPool::release(std::move(sheet));
+}
+void ExportImagePopup::encode(GLuint img, int width, int height, std::string path) {
+  if (img == 0) { // Failed, or the output was renamed in the meantime
+    spdlog::error("Nothing to export to {}!", path);
+    EventQueue::push(ExportProgress(1.0f, "Failed to export image!"));
+    return;
   }
 
   // unsigned char data[resolution[0] * resolution[1] * 4];
-  std::vector<unsigned char> data(resolution[0] * resolution[1] * 4);
+  std::vector<unsigned char> data(size_t(width) * height * 4);
   glBindTexture(GL_TEXTURE_2D, img);
   glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
 
-  bool success = false;
-
-  stbi_flip_vertically_on_write(true);
-
-  switch (format) {
-  case PNG:
-    success = stbi_write_png(export_path.c_str(), resolution[0], resolution[1], 4, data.data(),
-                             resolution[0] * 4);
-    break;
-  case JPEG:
-    success =
-        stbi_write_jpg(export_path.c_str(), resolution[0], resolution[1], 4, data.data(), quality);
-    break;
-  }
+  // Encoding runs as a job, only the readback needs the OpenGL context
+  Jobs::submit([data = std::move(data), path, width, height, format = format,
+                quality = quality]() mutable {
+    EventQueue::push(ExportProgress(0.0f, fmt::format("Encoding {}...", path)));
+    // Flipped by hand, stbi_flip_vertically_on_write() is global state
+    size_t stride = size_t(width) * 4;
+    for (int y = 0; y < height / 2; y++)
+      std::swap_ranges(data.begin() + y * stride, data.begin() + (y + 1) * stride,
+                       data.begin() + (height - 1 - y) * stride);
+
+    bool success = false;
+    switch (format) {
+    case PNG:
+      success = stbi_write_png(path.c_str(), width, height, 4, data.data(), stride);
+      break;
+    case JPEG:
+      success = stbi_write_jpg(path.c_str(), width, height, 4, data.data(), quality);
+      break;
+    }
 
-  if (success) {
-    spdlog::info("Image saved in {}", export_path);
-  } else {
-    spdlog::error("Failed to write image!");
+    if (success)
+      spdlog::info("Image saved in {}", path);
+    else
+      spdlog::error("Failed to write image!");
+    EventQueue::push(ExportProgress(1.0f, success ? "Image exported" : "Failed to export image!"));
+  });
+}
+void ExportImagePopup::render_sweep() {
+  // Nodes may have been deleted since the axes were set up
+  auto pins = ParameterSweep::get_sweepable_pins(*graph);
+  std::erase_if(axes, [&](auto &axis) {
+    return axis.pin >= 0 && std::find(pins.begin(), pins.end(), axis.pin) == pins.end();
+  });
+
+  ImGui::SetNextItemWidth(widget_width - ImGui::CalcTextSize("Thumbnail Size").x);
+  ImGui::InputInt2("Thumbnail Size", thumbnail);
+  thumbnail[0] = std::max(thumbnail[0], 1);
+  thumbnail[1] = std::max(thumbnail[1], 1);
+
+  std::optional<size_t> removed;
+  for (size_t i = 0; i < axes.size(); i++) {
+    auto &axis = axes[i];
+    ImGui::PushID(int(i));
+    ImGui::SetNextItemWidth(120);
+    if (ImGui::BeginCombo("##pin", ParameterSweep::get_axis_name(*graph, axis.pin).c_str())) {
+      if (ImGui::Selectable("Time", axis.pin < 0))
+        axis.pin = -1;
+      for (int pin : pins) {
+        if (ImGui::Selectable(ParameterSweep::get_axis_name(*graph, pin).c_str(), axis.pin == pin))
+          axis.pin = pin;
+      }
+      ImGui::EndCombo();
+    }
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(160);
+    ImGui::DragFloatRange2("##range", &axis.from, &axis.to, 0.01f);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    ImGui::InputInt("##steps", &axis.steps);
+    axis.steps = std::clamp(axis.steps, 1, ParameterSweep::MAX_VARIANTS);
+    ImGui::SameLine();
+    if (ImGui::Button("Remove"))
+      removed = i;
+    ImGui::PopID();
   }
+  if (removed)
+    axes.erase(axes.begin() + *removed);
+
+  if (ImGui::Button("Add Axis"))
+    axes.push_back(SweepAxis{.pin = pins.empty() ? -1 : pins.front()});
+  ImGui::SameLine();
+  int variants = ParameterSweep::count_variants(axes);
+  if (variants > ParameterSweep::MAX_VARIANTS)
+    ImGui::TextColored(ImVec4(0.92f, 0.18f, 0.29f, 1.00f), "More than %d variants!",
+                       ParameterSweep::MAX_VARIANTS);
+  else if (!ParameterSweep::fits(axes, thumbnail[0], thumbnail[1]))
+    ImGui::TextColored(ImVec4(0.92f, 0.18f, 0.29f, 1.00f), "%d variants, sheet over %d px!",
+                       variants, ParameterSweep::get_max_size());
+  else
+    ImGui::Text("%d variants", variants);
 }
 void ExportImagePopup::render(bool *) {
+  auto lock = RenderThread::lock(); // Exports evaluate the graph on this thread
   update_popup("Export Image");
 
   // Always center this window when appearing
@@ -72,8 +184,13 @@ void ExportImagePopup::render(bool *) {
         export_path = res;
     }
 
-    ImGui::SetNextItemWidth(widget_width - ImGui::CalcTextSize("Image Resolution").x);
-    ImGui::InputInt2("Image Resolution", resolution);
+    ImGui::Checkbox("Parameter Sweep", &sweep);
+    if (sweep) {
+      render_sweep();
+    } else {
+      ImGui::SetNextItemWidth(widget_width - ImGui::CalcTextSize("Image Resolution").x);
+      ImGui::InputInt2("Image Resolution", resolution);
+    }
 
     if (ImGui::Checkbox("Time Override", &override_time))
       time = graph->time;
@@ -92,14 +209,36 @@ void ExportImagePopup::render(bool *) {
     if (ImGui::RadioButton("JPEG", &format, JPEG))
       set_extension(".jpg");
 
+    if (ImGui::BeginCombo("Outputs", outputs.empty() ? "Default"
+                                                     : fmt::format("{} selected", outputs.size())
+                                                           .c_str())) {
+      for (auto &name : graph->get_output_names()) {
+        bool selected = outputs.contains(name);
+        if (ImGui::Checkbox(name.c_str(), &selected)) {
+          if (selected)
+            outputs.insert(name);
+          else
+            outputs.erase(name);
+        }
+      }
+      ImGui::EndCombo();
+    }
+
     if (format == JPEG) {
       ImGui::SetNextItemWidth(widget_width - ImGui::CalcTextSize("Image Quality").x);
       ImGui::DragInt("Image Quality", &quality, 1, 0, 100, "%d%%");
     }
 
-    ImGui::BeginDisabled(!graph); // Disable if graph is NULL
+    int variants = ParameterSweep::count_variants(axes);
+    // Disable if graph is NULL
+    ImGui::BeginDisabled(!graph ||
+                         (sweep && (variants == 0 || variants > ParameterSweep::MAX_VARIANTS ||
+                                    !ParameterSweep::fits(axes, thumbnail[0], thumbnail[1]))));
     if (ImGui::Button("Export", ImVec2(widget_width / 2, 0))) {
-      export_image();
+      if (sweep)
+        export_sweep();
+      else
+        export_image();
       ImGui::CloseCurrentPopup();
       is_open = false;
     }
@@ -1,4 +1,7 @@
 #include "widgets/node_editor_widget.h"
+#include "blur.h"
+#include "render_thread.h"
+#include "shader_fusion.h"
 #include <algorithm>
 
 //! AddNodes
@@ -40,6 +43,32 @@ void AddNodes::show(std::shared_ptr<AssetManager> assets) {
         insert_nodes.push_back(std::make_shared<Vec2Node>(Vec2Node()));
       if (ImGui::Selectable("Float"))
         insert_nodes.push_back(std::make_shared<FloatNode>(FloatNode()));
+      if (ImGui::Selectable("Expression"))
+        insert_nodes.push_back(std::make_shared<ExpressionNode>(ExpressionNode()));
+      ImGui::Spacing();
+      ImGui::EndMenu();
+    }
+    if (ImGui::BeginMenu("Blur Nodes")) {
+      ImGui::Dummy(ImVec2(150, 0)); // Min width
+      ImGui::Indent(5);
+      if (ImGui::Selectable("Gaussian Blur"))
+        insert_nodes.push_back(std::make_shared<GaussianBlurNode>(GaussianBlurNode()));
+      if (ImGui::Selectable("Dual-Kawase Blur"))
+        insert_nodes.push_back(std::make_shared<KawaseBlurNode>(KawaseBlurNode()));
+      if (ImGui::Selectable("Mip Chain"))
+        insert_nodes.push_back(std::make_shared<MipChainNode>(MipChainNode()));
+      ImGui::Spacing();
+      ImGui::EndMenu();
+    }
+    if (ImGui::BeginMenu("Compute Nodes")) {
+      ImGui::Dummy(ImVec2(150, 0)); // Min width
+      ImGui::Indent(5);
+      if (ImGui::Selectable("Compute Shader"))
+        insert_nodes.push_back(std::make_shared<ComputeShaderNode>(ComputeShaderNode(assets)));
+      if (ImGui::Selectable("Reduction"))
+        insert_nodes.push_back(std::make_shared<ReductionNode>(ReductionNode()));
+      if (!Compute::is_supported())
+        ImGui::TextDisabled("%s", Compute::get_fallback_message().c_str());
       ImGui::Spacing();
       ImGui::EndMenu();
     }
@@ -163,14 +192,36 @@ void Clipboard::paste(RenderGraph *graph) {
 //! NodeEditorWidget
 
 void NodeEditorWidget::render(bool *) {
+  auto lock = RenderThread::lock(); // Nodes are edited in place
   ImGui::SetNextWindowSize({640, 480}, ImGuiCond_FirstUseEver);
-  ImGui::Begin(title.c_str());
+  bool shown = ImGui::Begin(title.c_str(), nullptr, ImGuiWindowFlags_MenuBar);
+  set_visible(shown);
+  if (!shown) {
+    ImGui::End();
+    return;
+  }
+  if (ImGui::BeginMenuBar()) {
+    if (ImGui::BeginMenu("Graph")) {
+      if (ImGui::Checkbox("Fuse Shader Passes", &graph->fuse_shaders))
+        graph->invalidate();
+      // Both run over the next frames, see App::update()
+      if (ImGui::MenuItem("Benchmark Shader Fusion"))
+        ShaderFusion::start_benchmark(graph, ImVec2(1920, 1080));
+      if (ImGui::MenuItem("Benchmark Blur"))
+        Blur::start_benchmark(graph, ImVec2(1920, 1080));
+      ImGui::EndMenu();
+    }
+    ImGui::EndMenuBar();
+  }
   ImNodes::EditorContextSet(context);
   ImNodes::PushColorStyle(ImNodesCol_Link, Data::COLORS_HOVER[current_link_type]);
   ImNodes::BeginNodeEditor();
 
   Global::setUndoContext(&history);
   graph.get()->render();
+  // Node parameters are edited in place, any active item may have changed one
+  if (ImGui::IsAnyItemActive() && ImGui::IsWindowFocused(ImGuiFocusedFlags_ChildWindows))
+    graph->invalidate();
 
   if (auto assets = this->assets.lock())
     add_nodes.show(assets);
@@ -185,10 +236,13 @@ void NodeEditorWidget::render(bool *) {
 void NodeEditorWidget::process_input() {
   auto io = ImGui::GetIO();
 
-  if (isKeyJustPressed(ImGuiKey_Z) && io.KeyCtrl && io.KeyShift)
+  if (isKeyJustPressed(ImGuiKey_Z) && io.KeyCtrl && io.KeyShift) {
     history.redo();
-  else if (isKeyJustPressed(ImGuiKey_Z) && io.KeyCtrl)
+    graph->invalidate(); // Parameters are restored in place
+  } else if (isKeyJustPressed(ImGuiKey_Z) && io.KeyCtrl) {
     history.undo();
+    graph->invalidate();
+  }
   if (isKeyJustPressed(ImGuiKey_A) && io.KeyShift)
     add_nodes.open_popup();
   if (io.MouseClicked[1]) // Right-click
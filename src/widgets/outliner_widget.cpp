@@ -3,9 +3,13 @@
 #include <imgui.h>
 #include <imgui_stdlib.h>
 
+#include <cmath>
+#include <set>
+
 #include "assets.h"
 #include "events.h"
 #include "geometry.h"
+#include "render_thread.h"
 #include "shader.h"
 #include "texture.h"
 #include "widgets/editor_widget.h"
@@ -13,7 +17,8 @@
 #include "IconsFontAwesome6.h"
 
 void render_entry(AssetId<Asset> asset_id, std::string &name, AssetId<Asset> &editing,
-                  std::string &input, std::vector<AssetId<Asset>> &deferred_delete) {
+                  std::string &input, std::vector<AssetId<Asset>> &deferred_delete,
+                  std::string info = "", bool *settings_clicked = nullptr) {
   ImGui::TableNextRow();
   ImGui::TableNextColumn();
 
@@ -30,6 +35,13 @@ void render_entry(AssetId<Asset> asset_id, std::string &name, AssetId<Asset> &ed
   }
 
   ImGui::TableNextColumn();
+  ImGui::TextDisabled("%s", info.c_str());
+
+  ImGui::TableNextColumn();
+  if (settings_clicked) {
+    *settings_clicked = ImGui::Button(ICON_FA_GEAR);
+    ImGui::SameLine();
+  }
   if (ImGui::Button(ICON_FA_PENCIL)) {
     editing = asset_id;
     input = name;
@@ -41,16 +53,52 @@ void render_entry(AssetId<Asset> asset_id, std::string &name, AssetId<Asset> &ed
   ImGui::SameLine();
   ImGui::Dummy({5, 0});
 }
+std::string format_size(size_t bytes) {
+  if (bytes >= 1024 * 1024)
+    return fmt::format("{:.1f} MB", bytes / (1024.0 * 1024.0));
+  return fmt::format("{:.1f} KB", bytes / 1024.0);
+}
+// Popup editing the import settings of a texture
+void render_texture_settings(AssetId<Texture> id, Texture &texture) {
+  if (ImGui::BeginPopup("TextureSettings")) {
+    TextureSettings settings = texture.get_settings();
+
+    ImGui::TextDisabled("%dx%d, %d levels", texture.get_width(), texture.get_height(),
+                        texture.get_levels());
+    ImGui::Checkbox("Mipmaps", &settings.mipmaps);
+    // Whole steps only, every distinct value is a separate OpenGL texture
+    ImGui::SliderFloat("Anisotropy", &settings.anisotropy, 1.0f, 16.0f, "%.0fx");
+    settings.anisotropy = std::round(settings.anisotropy);
+    int compression = int(settings.compression);
+    ImGui::Combo("Compression", &compression, TEXTURE_COMPRESSION_NAMES,
+                 IM_ARRAYSIZE(TEXTURE_COMPRESSION_NAMES));
+    settings.compression = TextureCompression(compression);
+
+    if (!is_compression_supported(settings.compression))
+      ImGui::TextDisabled("Not supported by this GPU");
+
+    if (settings != texture.get_settings()) {
+      auto lock = RenderThread::lock_evaluation(); // The image may be sampled right now
+      texture.reload(settings);
+      EventQueue::push(AssetChanged(id));
+    }
+    ImGui::EndPopup();
+  }
+}
 void OutlinerWidget::render(bool *p_open) {
+  auto lock = RenderThread::lock(); // Assets may be reloaded or deleted
   ImGui::SetNextWindowSize({400, 200}, ImGuiCond_FirstUseEver);
-  if (!ImGui::Begin(title.c_str(), p_open)) {
+  bool shown = ImGui::Begin(title.c_str(), p_open);
+  set_visible(shown);
+  if (!shown) {
     ImGui::End();
     return;
   }
 
-  ImGui::BeginTable("Scene", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerH);
+  ImGui::BeginTable("Scene", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerH);
 
   ImGui::TableSetupColumn("Assets", ImGuiTableColumnFlags_WidthStretch);
+  ImGui::TableSetupColumn("Size", ImGuiTableColumnFlags_WidthFixed);
   ImGui::TableSetupColumn("Edit", ImGuiTableColumnFlags_WidthFixed);
 
   ImGui::TableNextRow();
@@ -59,14 +107,35 @@ void OutlinerWidget::render(bool *p_open) {
   static std::string input;
 
   // Textures
-  if (ImGui::TreeNodeEx("Textures")) {
+  bool textures_open = ImGui::TreeNodeEx("Textures");
+  ImGui::TableNextColumn();
+  { // Total video memory used by textures, shared textures are counted once
+    size_t vram_size = 0;
+    std::set<GLuint> counted;
+    for (auto &pair : *assets->getTextureCollection()) {
+      if (pair.second->is_loaded() && counted.insert(pair.second->get_texture()).second)
+        vram_size += pair.second->get_vram_size();
+    }
+    ImGui::TextDisabled("%s", format_size(vram_size).c_str());
+  }
+  if (textures_open) {
     std::vector<AssetId<Texture>> deferred_delete = {};
     for (auto &pair : *assets->getTextureCollection()) {
+      auto &texture = pair.second;
       ImGui::PushID(pair.first);
-      render_entry(pair.first, pair.second->get_name(), editing, input, deferred_delete);
+      std::string info = texture->is_loaded()           ? format_size(texture->get_vram_size())
+                         : texture->is_load_attempted() ? "Missing"
+                                                        : "Not loaded";
+      bool settings_clicked = false;
+      render_entry(pair.first, texture->get_name(), editing, input, deferred_delete, info,
+                   &settings_clicked);
+      if (settings_clicked)
+        ImGui::OpenPopup("TextureSettings");
+      render_texture_settings(pair.first, *texture);
       ImGui::PopID();
     }
     for (auto id : deferred_delete) {
+      auto lock = RenderThread::lock_evaluation();
       assets->getTextureCollection()->at(id)->destroy();
       assets->getTextureCollection()->erase(id);
     }
@@ -93,6 +162,7 @@ void OutlinerWidget::render(bool *p_open) {
       ImGui::PopID();
     }
     for (auto id : deferred_delete) { // Handle deletion
+      auto lock = RenderThread::lock_evaluation();
       assets->getShaderCollection()->at(id)->destroy();
       assets->getShaderCollection()->erase(id);
     }
@@ -3,37 +3,96 @@
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <imgui.h>
 
 #include "IconsFontAwesome6.h"
+#include "frame_pacer.h"
 #include "graph.h"
-#include "nodes/output_node.h"
+#include "graph_scheduler.h"
+#include "render_thread.h"
 
+void ViewportWidget::update_clock() {
+  double current = glfwGetTime();
+  if (!paused)
+    time += current - last_time;
+  last_time = current;
+
+  // Graphs not depending on time only update when resized or edited
+  if (!paused && viewgraph->is_animated()) {
+    // Vsync jitter may wake the loop slightly early, which would skip every other frame
+    constexpr double FRAME_SLACK = 0.002;
+    if (current + FRAME_SLACK >= next_frame) {
+      next_frame = max_fps > 0.0f ? std::max(next_frame + 1.0 / max_fps, current) : current;
+      frame_time = time;
+    }
+    FramePacer::request_frame_at(next_frame);
+  }
+}
+std::vector<std::string> ViewportWidget::get_outputs() {
+  // Falls back to the default output if the chosen one was renamed or deleted
+  if (!output_name.empty() && !viewgraph->find_output(output_name))
+    output_name.clear();
+  if (output_name.empty())
+    return {};
+  return {output_name};
+}
+void ViewportWidget::onUpdate() {
+  if (!is_visible())
+    return;
+  update_clock();
+
+  // Evaluated with the other viewports in one batch before the widgets render
+  if (!RenderThread::is_running()) {
+    context.resolution = wsize;
+    context.time = frame_time;
+    context.outputs = get_outputs();
+    GraphScheduler::submit(viewgraph, context);
+  }
+}
 void ViewportWidget::render(bool *p_open) {
+  auto lock = RenderThread::lock(); // Graphs are shared with the render thread
   ImGui::SetNextWindowSize({400, 400}, ImGuiCond_FirstUseEver);
-  ImGui::Begin(title.c_str(), p_open,
-               ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+  bool shown = ImGui::Begin(title.c_str(), p_open,
+                            ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+  set_visible(shown);
+  if (!shown) { // Collapsed or behind another tab, nothing to evaluate
+    ImGui::End();
+    return;
+  }
   ImGui::BeginChild("ViewportRender");
 
   ImVec2 new_wsize = ImGui::GetWindowSize();
   bool resized = (wsize.x != new_wsize.x || wsize.y != new_wsize.y);
   wsize = new_wsize;
-  double current = glfwGetTime();
-  double delta = current - last_time;
-  last_time = current;
-
-  if (!paused || resized) {
-    viewgraph->clear_graph_data();
-    viewgraph->set_resolution(wsize);
-    if (!paused)
-      viewgraph->time += delta;
-    viewgraph->evaluate();
-  }
+  std::vector<std::string> outputs = get_outputs();
 
   GLuint output = 0;
-  if (auto if_node = viewgraph->get_root_node()) {
-    auto out = dynamic_cast<OutputNode *>(if_node.value());
-    output = out->get_image();
+  if (RenderThread::is_running()) {
+    // The render thread keeps up as well as it can, the UI shows its latest frame
+    bool update = resized || viewgraph->get_revision() != last_revision ||
+                  frame_time != requested_time || output_name != requested_output;
+    if (!async) {
+      async = std::make_shared<AsyncViewport>();
+      RenderThread::add(async);
+      update = true;
+    }
+    if (update) {
+      async->request_frame(viewgraph, wsize, frame_time, outputs);
+      last_revision = viewgraph->get_revision();
+      requested_time = frame_time;
+      requested_output = output_name;
+    }
+    output = async->acquire();
+  } else {
+    async.reset();
+    context.resolution = wsize;
+    context.time = frame_time;
+    context.outputs = outputs;
+    // Usually done by the batch, unless just shown or resized
+    if (!viewgraph->is_evaluated(context))
+      viewgraph->evaluate(context);
+    output = context.get_output();
   }
 
   ImGui::Image((ImTextureID)output, wsize, ImVec2(0, 1), ImVec2(1, 0));
@@ -50,10 +109,10 @@ void ViewportWidget::render(bool *p_open) {
                       ImGuiWindowFlags_NoResize | ImGuiWindowFlags_MenuBar);
 
     if (ImGui::BeginMenuBar()) {
-      ImGui::Text("Time: %.2f", viewgraph->time);
+      ImGui::Text("Time: %.2f", time);
       ImGui::SameLine();
       if (ImGui::Button(ICON_FA_REPEAT))
-        viewgraph->time = 0.0f;
+        time = frame_time = 0.0;
       if (paused) {
         if (ImGui::Button(ICON_FA_PLAY))
           paused = false;
@@ -61,6 +120,19 @@ void ViewportWidget::render(bool *p_open) {
         if (ImGui::Button(ICON_FA_PAUSE))
           paused = true;
       }
+      ImGui::SetNextItemWidth(100);
+      if (ImGui::BeginCombo("##Output", output_name.empty() ? "Default" : output_name.c_str())) {
+        if (ImGui::Selectable("Default", output_name.empty()))
+          output_name.clear();
+        for (auto &name : viewgraph->get_output_names()) {
+          if (ImGui::Selectable(name.c_str(), name == output_name))
+            output_name = name;
+        }
+        ImGui::EndCombo();
+      }
+      ImGui::SetNextItemWidth(80);
+      ImGui::DragFloat("##MaxFps", &max_fps, 1.0f, 0.0f, 240.0f,
+                       max_fps > 0.0f ? "%.0f fps" : "Uncapped", ImGuiSliderFlags_AlwaysClamp);
 
       ImGui::EndMenuBar();
     }
@@ -69,3 +141,15 @@ void ViewportWidget::render(bool *p_open) {
     ImGui::End();
   }
 }
+void ViewportWidget::onVisibilityChanged(bool visible) {
+  // The clock stands still while hidden
+  if (visible)
+    last_time = glfwGetTime();
+}
+void ViewportWidget::onShutdown() {
+  auto lock = RenderThread::lock();
+  context.release();
+  if (async)
+    async->close();
+  async.reset();
+}